@@ -38,6 +38,7 @@ void S_Activate(void);
 
 void S_BeginRegistration(void);
 qhandle_t S_RegisterSound(const char *sample);
+void S_PrefetchSound(const char *sample);
 void S_EndRegistration(void);
 
 #define MAX_RAW_SAMPLES     8192
@@ -112,6 +112,7 @@ typedef struct mface_s {
     unsigned        drawframe;
     unsigned        dlightframe;
     uint64_t        dlightbits;
+    uint32_t        dlightkey;  // lights lightmap was last built with
 
     struct lightmap_s   *light_m;
     struct entity_s     *entity;
@@ -148,7 +149,6 @@ typedef struct {
     int                 contents;
     int                 numsides;
     mbrushside_t        *firstbrushside;
-    unsigned            checkcount;         // to avoid repeated testings
 } mbrush_t;
 
 typedef struct {
@@ -270,6 +270,7 @@ typedef struct {
     int             numvisibility;
     int             visrowsize;
     dvis_t          *vis;
+    struct bspvis_s *viscache;
 
     int             numentitychars;
     char            *entitystring;
@@ -335,6 +336,7 @@ const lightgrid_sample_t *BSP_LookupLightgrid(const lightgrid_t *grid, const uin
 #endif
 
 void BSP_ClusterVis(const bsp_t *bsp, visrow_t *mask, int cluster, int vis);
+const visrow_t *BSP_GetClusterVis(const bsp_t *bsp, visrow_t *temp, int cluster, int vis);
 const mleaf_t *BSP_PointLeaf(const mnode_t *node, const vec3_t p);
 const mmodel_t *BSP_InlineModel(const bsp_t *bsp, const char *name);
 
@@ -36,6 +36,44 @@ typedef struct {
 
 extern const mleaf_t    nullleaf;
 
+// clipping hull for an arbitrary box
+typedef struct {
+    cplane_t        planes[12];
+    mnode_t         nodes[6];
+    mbrush_t        brush;
+    mbrush_t        *leafbrush;
+    mbrushside_t    brushsides[6];
+    mleaf_t         leaf;
+    mleaf_t         emptyleaf;
+} cm_boxhull_t;
+
+#define CM_TRACE_CHECKED_BITS   8
+#define CM_TRACE_CHECKED        (1 << CM_TRACE_CHECKED_BITS)
+
+// reentrant trace context, one per thread
+typedef struct {
+    trace_t         *trace;
+    vec3_t          start, end;
+    vec3_t          offsets[8];
+    vec3_t          extents;
+    int             contents;
+    bool            ispoint;        // optimized case
+    bool            extended;       // remaster fixes
+
+    // brushes already checked during current trace
+    unsigned        checkcount;
+    int             numchecked;
+    unsigned        checkstamps[CM_TRACE_CHECKED];
+    const mbrush_t  *checked[CM_TRACE_CHECKED];
+
+    cm_boxhull_t    box;
+} cm_trace_t;
+
+typedef struct {
+    vec3_t      start;
+    vec3_t      end;
+} cm_ray_t;
+
 void        CM_Init(void);
 
 void        CM_FreeMap(cm_t *cm);
@@ -50,8 +88,11 @@ const mleaf_t   *CM_LeafNum(const cm_t *cm, int number);
 #define CM_NumNode(cm, node) ((node) ? ((node) - (cm)->cache->nodes) : -1)
 #define CM_NumLeaf(cm, leaf) ((cm)->cache ? ((leaf) - (cm)->cache->leafs) : 0)
 
+void        CM_InitTrace(cm_trace_t *tr);
+
 // creates a clipping hull for an arbitrary box
 const mnode_t   *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs);
+const mnode_t   *CM_HeadnodeForBoxEx(cm_trace_t *tr, const vec3_t mins, const vec3_t maxs);
 
 // returns an ORed contents mask
 static inline int CM_PointContents(const vec3_t p, const mnode_t *headnode, bool extended)
@@ -76,6 +117,25 @@ void        CM_TransformedBoxTrace(trace_t *trace,
                                    const mnode_t *headnode, int brushmask,
                                    const vec3_t origin, const vec3_t angles,
                                    bool extended);
+
+// reentrant versions of the above, using caller provided context
+void        CM_BoxTraceEx(cm_trace_t *tr, trace_t *trace,
+                          const vec3_t start, const vec3_t end,
+                          const vec3_t mins, const vec3_t maxs,
+                          const mnode_t *headnode, int brushmask,
+                          bool extended);
+void        CM_TransformedBoxTraceEx(cm_trace_t *tr, trace_t *trace,
+                                     const vec3_t start, const vec3_t end,
+                                     const vec3_t mins, const vec3_t maxs,
+                                     const mnode_t *headnode, int brushmask,
+                                     const vec3_t origin, const vec3_t angles,
+                                     bool extended);
+void        CM_BoxTraceBatch(cm_trace_t *tr, trace_t *traces,
+                             const cm_ray_t *rays, int count,
+                             const vec3_t mins, const vec3_t maxs,
+                             const mnode_t *headnode, int brushmask,
+                             bool extended);
+
 void        CM_ClipEntity(trace_t *dst, const trace_t *src, struct edict_s *ent);
 
 // call with topnode set to the headnode, returns with topnode
@@ -103,6 +163,7 @@ void        CM_FatPVS(const cm_t *cm, visrow_t *mask, const vec3_t org);
 
 void        CM_SetAreaPortalState(const cm_t *cm, int portalnum, bool open);
 bool        CM_AreasConnected(const cm_t *cm, int area1, int area2);
+void        CM_ConnectedAreas(const cm_t *cm, byte *buffer, int area);
 
 int         CM_WriteAreaBits(const cm_t *cm, byte *buffer, int area);
 int         CM_WritePortalBits(const cm_t *cm, byte *buffer);
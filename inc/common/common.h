@@ -84,6 +84,12 @@ void        Com_EndRedirect(void);
 
 void        Com_AbortFunc(void (*func)(void *), void *arg);
 
+// called by Com_Error on current thread instead of aborting the frame,
+// must not return
+typedef void (*errorfunc_t)(error_type_t code, const char *msg);
+
+void        Com_SetErrorFunc(errorfunc_t func);
+
 q_cold
 void        Com_SetLastError(const char *msg);
 
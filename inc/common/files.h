@@ -31,11 +31,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents integer overflows
 #define MAX_LOADFILE            0x4001000   // 64 MiB + some slop
 
+// FS_LoadFileEx() may map stored pack entry instead of reading it,
+// buffer is not NUL terminated then and is released by FS_FreeFile()
+#define FS_FLAG_MMAP            0x00002000
+
 #define FS_Malloc(size)         Z_TagMalloc(size, TAG_FILESYSTEM)
 #define FS_Mallocz(size)        Z_TagMallocz(size, TAG_FILESYSTEM)
 #define FS_CopyString(string)   Z_TagCopyString(string, TAG_FILESYSTEM)
 #define FS_LoadFile(path, buf)  FS_LoadFileEx(path, buf, 0, TAG_FILESYSTEM)
-#define FS_FreeFile(buf)        Z_Free(buf)
 
 // just regular malloc for now
 #define FS_AllocTempMem(size)   FS_Malloc(size)
@@ -73,6 +76,22 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
 // a NULL buffer will just return the file length without loading
 // length < 0 indicates error
 
+void FS_FreeFile(void *buf);
+
+#if USE_CLIENT
+typedef struct {
+    unsigned    queued;     // files queued for reading
+    unsigned    hits;       // loads that used prefetched result
+    unsigned    waits;      // loads that had to wait for worker thread
+    unsigned    read_msec;  // time spent reading by worker threads
+    unsigned    wait_msec;  // time spent waiting by main thread
+} prefetch_stats_t;
+
+void FS_BeginPrefetch(void);
+void FS_PrefetchFile(const char *path, unsigned flags);
+void FS_EndPrefetch(prefetch_stats_t *stats);
+#endif
+
 int FS_WriteFile(const char *path, const void *data, size_t len);
 
 bool FS_EasyWriteFile(char *buf, size_t size, unsigned mode,
@@ -100,7 +100,9 @@ typedef enum {
     MSG_ES_REMOVE       = BIT(9),   // entity is removed (MVD stream only)
 } msgEsFlags_t;
 
-extern sizebuf_t    msg_write;
+// each thread encoding messages has its own msg_write,
+// but only main thread's one points to msg_write_buffer
+extern q_thread_local sizebuf_t msg_write;
 extern byte         msg_write_buffer[MAX_MSGLEN];
 
 extern sizebuf_t    msg_read;
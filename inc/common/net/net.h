@@ -193,6 +193,9 @@ bool        NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
 bool        NET_SendPacket(netsrc_t sock, const void *data,
                            size_t len, const netadr_t *to);
+void        NET_BeginSendBatch(netsrc_t sock);
+void        NET_FlushSendBatch(void);
+void        NET_AbortSendBatch(void);
 
 const char  *NET_AdrToString(const netadr_t *a);
 bool        NET_StringToAdr(const char *s, netadr_t *a, int default_port);
@@ -223,3 +226,4 @@ extern cvar_t       *net_ip;
 extern cvar_t       *net_port;
 
 extern netadr_t     net_from;
+extern unsigned     net_from_time;
@@ -0,0 +1,43 @@
+/*
+Copyright (C) 2026 Q2PRO contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#pragma once
+
+#include "shared/atomic.h"
+
+//
+// Zone profiler. Zones are recorded into per-thread ring buffers while
+// `com_profile' is enabled and can be dumped as Chrome trace JSON. Zone
+// names must be string literals or otherwise remain valid until dumped.
+//
+
+extern atomic_int               com_profiling;
+extern q_thread_local int       com_profdepth;
+
+void Com_ProfileBegin(const char *name);
+void Com_ProfileEnd(void);
+void Com_ProfileUnwind(void);
+void Com_ProfileClear(void);
+
+void Com_InitProfiler(void);
+
+#define PROF_BEGIN(name) \
+    do { if (atomic_load(&com_profiling)) Com_ProfileBegin(name); } while (0)
+
+#define PROF_END() \
+    do { if (com_profdepth) Com_ProfileEnd(); } while (0)
@@ -41,7 +41,6 @@ typedef enum {
     TAG_MAX
 } memtag_t;
 
-void    Z_Init(void);
 void    Z_Free(void *ptr);
 void    Z_Freep(void *ptr);
 void    *Z_Realloc(void *ptr, size_t size);
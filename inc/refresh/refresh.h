@@ -210,6 +210,10 @@ qhandle_t R_RegisterImage(const char *name, imagetype_t type,
 void    R_SetSky(const char *name, float rotate, bool autorotate, const vec3_t axis);
 void    R_EndRegistration(void);
 
+// queue files the above functions are going to load for background reading
+void    R_PrefetchModel(const char *name);
+void    R_PrefetchImage(const char *name, imagetype_t type);
+
 #define R_RegisterPic(name)     R_RegisterImage(name, IT_PIC, IF_PERMANENT)
 #define R_RegisterTempPic(name) R_RegisterImage(name, IT_PIC, IF_NONE)
 #define R_RegisterFont(name)    R_RegisterImage(name, IT_FONT, IF_PERMANENT)
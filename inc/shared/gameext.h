@@ -137,3 +137,13 @@ typedef struct {
     void (*AddDebugText)(const vec3_t origin, const vec3_t angles, const char *text,
                          float size, uint32_t color, uint32_t time, qboolean depth_test);
 } debug_draw_api_v1_t;
+
+#define PROFILE_API_V1 "PROFILE_API_V1"
+
+// Zones are recorded only while profiler is enabled and must be properly
+// nested. Name is not copied and must remain valid until game library is
+// unloaded. Events recorded so far are discarded when that happens.
+typedef struct {
+    void (*BeginZone)(const char *name);
+    void (*EndZone)(void);
+} profile_api_v1_t;
@@ -35,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/chan.h"
 #include "common/net/net.h"
 #include "common/pmove.h"
+#include "common/profile.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/sizebuf.h"
@@ -482,6 +483,12 @@ typedef struct {
         sizebuf_t   buffer;
         demosnap_t  **snapshots;
         int         numsnapshots;
+        int         numindexed;         // number of snapshots in index file
+        char        path[MAX_OSPATH];   // demo file being played back
+        char        index_name[MAX_OSPATH];
+        byte        index_hash[16];     // hash of current demo segment header
+        bool        build_index;        // read through entire demo on next frame
+        bool        indexing;
         bool        paused;
         bool        seeking;
         bool        eof;
@@ -588,6 +595,7 @@ extern cvar_t   *cl_thirdperson_angle;
 extern cvar_t   *cl_thirdperson_range;
 
 extern cvar_t   *cl_async;
+extern cvar_t   *cl_async_precache;
 
 //
 // userinfo
@@ -657,6 +665,7 @@ typedef enum {
 void CL_ParsePlayerSkin(char *name, char *model, char *skin, const char *s);
 void CL_LoadClientinfo(clientinfo_t *ci, const char *s);
 void CL_LoadState(load_state_t state);
+void CL_UpdateLoadTimes(load_state_t state);
 void CL_RegisterSounds(void);
 void CL_RegisterBspModels(void);
 void CL_RegisterVWepModels(void);
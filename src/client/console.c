@@ -568,6 +568,7 @@ CL_LoadState
 */
 void CL_LoadState(load_state_t state)
 {
+    CL_UpdateLoadTimes(state);
     con.loadstate = state;
     SCR_UpdateScreen();
     if (vid)
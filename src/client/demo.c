@@ -21,10 +21,13 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 //
 
 #include "client.h"
+#include "common/intreadwrite.h"
+#include "common/mdfour.h"
 
 static byte     demo_buffer[MAX_MSGLEN];
 
 static cvar_t   *cl_demosnaps;
+static cvar_t   *cl_demoindex;
 static cvar_t   *cl_demomsglen;
 static cvar_t   *cl_demowait;
 static cvar_t   *cl_demosuspendtoggle;
@@ -752,6 +755,7 @@ static void CL_PlayDemo_f(void)
 
     cls.demo.playback = f;
     cls.demo.compat = !strcmp(Cmd_Argv(2), "compat");
+    Q_strlcpy(cls.demo.path, name, sizeof(cls.demo.path));
     cls.state = ca_connected;
     Q_strlcpy(cls.servername, COM_SkipPath(name), sizeof(cls.servername));
     cls.serverAddress.type = NA_LOOPBACK;
@@ -896,6 +900,230 @@ static demosnap_t *find_snapshot(int64_t dest, bool byte_seek)
     return cls.demo.snapshots[max(r, 0)];
 }
 
+static void free_snapshots(void)
+{
+    for (int i = 0; i < cls.demo.numsnapshots; i++)
+        Z_Free(cls.demo.snapshots[i]);
+    cls.demo.numsnapshots = 0;
+    cls.demo.numindexed = 0;
+
+    Z_Freep(&cls.demo.snapshots);
+}
+
+#define DEMO_INDEX_MAGIC    MakeLittleLong('D','I','D','X')
+#define DEMO_INDEX_VERSION  2
+
+/*
+====================
+hash_demo_header
+
+Hashes gamestate of current demo segment. Each segment of multi-map demo
+gets its own index file named after this hash.
+====================
+*/
+static void hash_demo_header(byte *out)
+{
+    int32_t info[4] = { cls.serverProtocol, cls.protocolVersion, cl.servercount, cl.clientNum };
+    mdfour_t md;
+
+    mdfour_begin(&md);
+    mdfour_update(&md, (const byte *)info, sizeof(info));
+    mdfour_update(&md, (const byte *)cl.gamedir, strlen(cl.gamedir) + 1);
+    for (int i = 0; i < cl.csr.end; i++) {
+        const char *s = cl.baseconfigstrings[i];
+        if (!*s)
+            continue;
+        mdfour_update(&md, (const byte *)&i, sizeof(i));
+        mdfour_update(&md, (const byte *)s, Q_strnlen(s, MAX_QPATH));
+    }
+    mdfour_result(&md, out);
+}
+
+/*
+====================
+load_demo_index
+
+Index file stores demo snapshots along with header hash and position of demo
+segment they were made for. Snapshots are deflated if zlib is available.
+====================
+*/
+static int64_t read_index_pos(sizebuf_t *sb)
+{
+    uint32_t lo = SZ_ReadLong(sb);
+    uint32_t hi = SZ_ReadLong(sb);
+
+    return lo | (int64_t)hi << 32;
+}
+
+static bool load_demo_index(void)
+{
+    demosnap_t *snap;
+    sizebuf_t sb;
+    byte *data;
+    const byte *in;
+    int i, ret, count, framenum, prevnum;
+    int64_t filepos;
+    unsigned msglen, complen;
+
+    if (!cls.demo.index_name[0])
+        return false;
+
+    ret = FS_LoadFile(cls.demo.index_name, (void **)&data);
+    if (!data) {
+        if (ret != Q_ERR(ENOENT))
+            Com_WPrintf("Couldn't load %s: %s\n", cls.demo.index_name, Q_ErrorString(ret));
+        return false;
+    }
+
+    SZ_InitRead(&sb, data, ret);
+    if ((uint32_t)SZ_ReadLong(&sb) != DEMO_INDEX_MAGIC || SZ_ReadLong(&sb) != DEMO_INDEX_VERSION)
+        goto fail;
+
+    // index made for different file or demo segment
+    in = SZ_ReadData(&sb, sizeof(cls.demo.index_hash));
+    if (!in)
+        goto fail;
+    if (memcmp(in, cls.demo.index_hash, sizeof(cls.demo.index_hash)) ||
+        read_index_pos(&sb) != cls.demo.file_offset || read_index_pos(&sb) != cls.demo.file_size) {
+        Com_DPrintf("%s doesn't match demo, ignored\n", cls.demo.index_name);
+        FS_FreeFile(data);
+        return false;
+    }
+
+    count = SZ_ReadLong(&sb);
+    if (count < 1 || count > MAX_SNAPSHOTS)
+        goto fail;
+
+    prevnum = INT_MIN;
+    for (i = 0; i < count; i++) {
+        framenum = SZ_ReadLong(&sb);
+        filepos = read_index_pos(&sb);
+        msglen = SZ_ReadLong(&sb);
+        complen = SZ_ReadLong(&sb);
+        if (framenum <= prevnum)
+            goto fail;
+        if (filepos < cls.demo.file_offset || filepos > cls.demo.file_offset + cls.demo.file_size)
+            goto fail;
+        if (!msglen || msglen > MAX_MSGLEN || complen > msglen)
+            goto fail;
+        in = SZ_ReadData(&sb, complen);
+        if (!in)
+            goto fail;
+
+        snap = Z_Malloc(sizeof(*snap) + msglen - 1);
+        snap->framenum = framenum;
+        snap->filepos = filepos;
+        snap->msglen = msglen;
+
+        if (complen == msglen) {
+            memcpy(snap->data, in, msglen);
+        } else {
+#if USE_ZLIB
+            uLongf len = msglen;
+            ret = uncompress(snap->data, &len, in, complen);
+            if (ret != Z_OK || len != msglen) {
+                Z_Free(snap);
+                goto fail;
+            }
+#else
+            Z_Free(snap);
+            goto fail;
+#endif
+        }
+
+        cls.demo.snapshots = Z_Realloc(cls.demo.snapshots, sizeof(cls.demo.snapshots[0]) * Q_ALIGN(cls.demo.numsnapshots + 1, MIN_SNAPSHOTS));
+        cls.demo.snapshots[cls.demo.numsnapshots++] = snap;
+        prevnum = framenum;
+    }
+
+    FS_FreeFile(data);
+
+    Com_DPrintf("Loaded %d snapshots from %s\n", count, cls.demo.index_name);
+    cls.demo.numindexed = count;
+    return true;
+
+fail:
+    Com_WPrintf("%s is corrupted, ignored\n", cls.demo.index_name);
+    FS_FreeFile(data);
+    free_snapshots();
+    return false;
+}
+
+static int write_demo_index(qhandle_t f)
+{
+    byte header[48];
+    sizebuf_t sb;
+    int i, ret;
+#if USE_ZLIB
+    byte buffer[MAX_MSGLEN];
+#endif
+
+    SZ_InitWrite(&sb, header, sizeof(header));
+    SZ_WriteLong(&sb, DEMO_INDEX_MAGIC);
+    SZ_WriteLong(&sb, DEMO_INDEX_VERSION);
+    SZ_Write(&sb, cls.demo.index_hash, sizeof(cls.demo.index_hash));
+    SZ_WriteLong(&sb, cls.demo.file_offset);
+    SZ_WriteLong(&sb, cls.demo.file_offset >> 32);
+    SZ_WriteLong(&sb, cls.demo.file_size);
+    SZ_WriteLong(&sb, cls.demo.file_size >> 32);
+    SZ_WriteLong(&sb, cls.demo.numsnapshots);
+    ret = FS_Write(sb.data, sb.cursize, f);
+
+    for (i = 0; i < cls.demo.numsnapshots && ret >= 0; i++) {
+        demosnap_t *snap = cls.demo.snapshots[i];
+        const byte *data = snap->data;
+        size_t len = snap->msglen;
+
+#if USE_ZLIB
+        // keep uncompressed if it doesn't get smaller
+        uLongf complen = len - 1;
+        if (compress2(buffer, &complen, data, len, Z_BEST_SPEED) == Z_OK) {
+            data = buffer;
+            len = complen;
+        }
+#endif
+
+        SZ_Clear(&sb);
+        SZ_WriteLong(&sb, snap->framenum);
+        SZ_WriteLong(&sb, snap->filepos);
+        SZ_WriteLong(&sb, snap->filepos >> 32);
+        SZ_WriteLong(&sb, snap->msglen);
+        SZ_WriteLong(&sb, len);
+        ret = FS_Write(sb.data, sb.cursize, f);
+        if (ret >= 0)
+            ret = FS_Write(data, len, f);
+    }
+
+    return ret;
+}
+
+static void save_demo_index(void)
+{
+    qhandle_t f;
+    int ret, ret2;
+
+    if (!cls.demo.index_name[0])
+        return;
+
+    ret = FS_OpenFile(cls.demo.index_name, &f, FS_MODE_WRITE);
+    if (!f) {
+        Com_EPrintf("Couldn't open %s for writing: %s\n", cls.demo.index_name, Q_ErrorString(ret));
+        return;
+    }
+
+    ret = write_demo_index(f);
+    ret2 = FS_CloseFile(f);
+    if (ret >= 0)
+        ret = ret2;
+    if (ret < 0) {
+        Com_EPrintf("Couldn't write %s: %s\n", cls.demo.index_name, Q_ErrorString(ret));
+        return;
+    }
+
+    Com_DPrintf("Saved %d snapshots to %s\n", cls.demo.numsnapshots, cls.demo.index_name);
+    cls.demo.numindexed = cls.demo.numsnapshots;
+}
+
 /*
 ====================
 CL_FirstDemoFrame
@@ -928,6 +1156,24 @@ void CL_FirstDemoFrame(void)
 
     // force initial snapshot
     cls.demo.last_snapshot = INT_MIN;
+
+    cls.demo.index_name[0] = 0;
+    if (cl_demoindex->integer <= 0 || cl_demosnaps->integer <= 0 || !cls.demo.file_size)
+        return;
+
+    // name index after segment header so that multi-map demos get one per map
+    hash_demo_header(cls.demo.index_hash);
+    if (Q_snprintf(cls.demo.index_name, sizeof(cls.demo.index_name), "%s.%08x.idx",
+                   cls.demo.path, RL32(cls.demo.index_hash)) >= sizeof(cls.demo.index_name)) {
+        cls.demo.index_name[0] = 0;
+        return;
+    }
+
+    // load snapshots from previous playback
+    if (load_demo_index())
+        cls.demo.last_snapshot = cls.demo.snapshots[cls.demo.numsnapshots - 1]->framenum;
+    else if (cl_demoindex->integer > 1 && !com_timedemo->integer)
+        cls.demo.build_index = true;
 }
 
 /*
@@ -937,90 +1183,19 @@ CL_FreeDemoSnapshots
 */
 void CL_FreeDemoSnapshots(void)
 {
-    for (int i = 0; i < cls.demo.numsnapshots; i++)
-        Z_Free(cls.demo.snapshots[i]);
-    cls.demo.numsnapshots = 0;
+    // keep snapshots for the next playback
+    if (cls.demo.numsnapshots > cls.demo.numindexed && cl_demoindex->integer > 0)
+        save_demo_index();
 
-    Z_Freep(&cls.demo.snapshots);
+    free_snapshots();
 }
 
-/*
-====================
-CL_Seek_f
-====================
-*/
-static void CL_Seek_f(void)
+static void seek_demo(int64_t dest, bool byte_seek, bool back_seek)
 {
     demosnap_t *snap;
-    int i, j, ret, index, frames, prev;
-    int64_t dest;
-    bool byte_seek, back_seek;
+    int i, j, ret, index, prev;
     char *from, *to;
 
-    if (Cmd_Argc() < 2) {
-        Com_Printf("Usage: %s [+-]<timespec|percent>[%%]\n", Cmd_Argv(0));
-        return;
-    }
-
-#if USE_MVD_CLIENT
-    if (sv_running->integer == ss_broadcast) {
-        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
-        return;
-    }
-#endif
-
-    if (!cls.demo.playback) {
-        Com_Printf("Not playing a demo.\n");
-        return;
-    }
-
-    to = Cmd_Argv(1);
-
-    if (strchr(to, '%')) {
-        char *suf;
-        float percent = strtof(to, &suf);
-        if (suf == to || strcmp(suf, "%") || !isfinite(percent)) {
-            Com_Printf("Invalid percentage.\n");
-            return;
-        }
-
-        if (!cls.demo.file_size) {
-            Com_Printf("Unknown file size, can't seek.\n");
-            return;
-        }
-
-        percent = Q_clipf(percent, 0, 100);
-        dest = cls.demo.file_offset + cls.demo.file_size * percent / 100;
-
-        byte_seek = true;
-        back_seek = dest < FS_Tell(cls.demo.playback);
-    } else {
-        if (*to == '-' || *to == '+') {
-            // relative to current frame
-            if (!Com_ParseTimespec(to + 1, &frames)) {
-                Com_Printf("Invalid relative timespec.\n");
-                return;
-            }
-            if (*to == '-')
-                frames = -frames;
-            dest = cls.demo.frames_read + frames;
-        } else {
-            // relative to first frame
-            if (!Com_ParseTimespec(to, &i)) {
-                Com_Printf("Invalid absolute timespec.\n");
-                return;
-            }
-            dest = i;
-            frames = i - cls.demo.frames_read;
-        }
-
-        if (!frames)
-            return; // already there
-
-        byte_seek = false;
-        back_seek = frames < 0;
-    }
-
     if (!back_seek && cls.demo.eof && cl_demowait->integer)
         return; // already at end
 
@@ -1083,7 +1258,7 @@ static void CL_Seek_f(void)
             break;
 
         ret = read_next_message(cls.demo.playback);
-        if (ret == 0 && cl_demowait->integer) {
+        if (ret == 0 && (cl_demowait->integer || cls.demo.indexing)) {
             cls.demo.eof = true;
             break;
         }
@@ -1138,6 +1313,114 @@ done:
     cls.demo.seeking = false;
 }
 
+/*
+====================
+CL_Seek_f
+====================
+*/
+static void CL_Seek_f(void)
+{
+    int i, frames;
+    int64_t dest;
+    bool byte_seek, back_seek;
+    char *to;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s [+-]<timespec|percent>[%%]\n", Cmd_Argv(0));
+        return;
+    }
+
+#if USE_MVD_CLIENT
+    if (sv_running->integer == ss_broadcast) {
+        Cbuf_InsertText(&cmd_buffer, va("mvdseek \"%s\" @@\n", Cmd_Argv(1)));
+        return;
+    }
+#endif
+
+    if (!cls.demo.playback) {
+        Com_Printf("Not playing a demo.\n");
+        return;
+    }
+
+    to = Cmd_Argv(1);
+
+    if (strchr(to, '%')) {
+        char *suf;
+        float percent = strtof(to, &suf);
+        if (suf == to || strcmp(suf, "%") || !isfinite(percent)) {
+            Com_Printf("Invalid percentage.\n");
+            return;
+        }
+
+        if (!cls.demo.file_size) {
+            Com_Printf("Unknown file size, can't seek.\n");
+            return;
+        }
+
+        percent = Q_clipf(percent, 0, 100);
+        dest = cls.demo.file_offset + cls.demo.file_size * percent / 100;
+
+        byte_seek = true;
+        back_seek = dest < FS_Tell(cls.demo.playback);
+    } else {
+        if (*to == '-' || *to == '+') {
+            // relative to current frame
+            if (!Com_ParseTimespec(to + 1, &frames)) {
+                Com_Printf("Invalid relative timespec.\n");
+                return;
+            }
+            if (*to == '-')
+                frames = -frames;
+            dest = cls.demo.frames_read + frames;
+        } else {
+            // relative to first frame
+            if (!Com_ParseTimespec(to, &i)) {
+                Com_Printf("Invalid absolute timespec.\n");
+                return;
+            }
+            dest = i;
+            frames = i - cls.demo.frames_read;
+        }
+
+        if (!frames)
+            return; // already there
+
+        byte_seek = false;
+        back_seek = frames < 0;
+    }
+
+    seek_demo(dest, byte_seek, back_seek);
+}
+
+/*
+====================
+build_demo_index
+
+Reads through the entire demo making snapshots, then returns back to the
+current frame and saves the index, so that any position can be reached by
+the next seek without parsing everything in between.
+====================
+*/
+static void build_demo_index(void)
+{
+    int framenum = cls.demo.frames_read;
+    unsigned start = Sys_Milliseconds();
+
+    cls.demo.build_index = false;
+
+    Com_Printf("Building demo index...\n");
+
+    cls.demo.indexing = true;
+    seek_demo(INT_MAX, false, false);
+    cls.demo.indexing = false;
+
+    Com_DPrintf("Indexed %d frames in %u ms\n", cls.demo.frames_read, Sys_Milliseconds() - start);
+
+    seek_demo(framenum, false, true);
+
+    save_demo_index();
+}
+
 static void parse_info_string(demoInfo_t *info, int clientNum, int index, const cs_remap_t *csr)
 {
     char string[MAX_QPATH], *p;
@@ -1305,6 +1588,11 @@ void CL_DemoFrame(void)
         return;
     }
 
+    if (cls.demo.build_index) {
+        build_demo_index();
+        return;
+    }
+
     if (com_timedemo->integer) {
         parse_next_message(0);
         cl.time = cl.servertime;
@@ -1348,6 +1636,7 @@ CL_InitDemos
 void CL_InitDemos(void)
 {
     cl_demosnaps = Cvar_Get("cl_demosnaps", "10", 0);
+    cl_demoindex = Cvar_Get("cl_demoindex", "0", 0);
     cl_demomsglen = Cvar_Get("cl_demomsglen", va("%d", MAX_PACKETLEN_WRITABLE_DEFAULT), 0);
     cl_demowait = Cvar_Get("cl_demowait", "0", 0);
     cl_demosuspendtoggle = Cvar_Get("cl_demosuspendtoggle", "1", 0);
@@ -34,6 +34,7 @@ cvar_t  *cl_gun_z;
 cvar_t  *cl_warn_on_fps_rounding;
 cvar_t  *cl_maxfps;
 cvar_t  *cl_async;
+cvar_t  *cl_async_precache;
 cvar_t  *r_maxfps;
 cvar_t  *cl_autopause;
 
@@ -738,6 +739,9 @@ void CL_Disconnect(error_type_t type)
     // stop download
     CL_CleanupDownloads();
 
+    // loading might have been interrupted
+    FS_EndPrefetch(NULL);
+
     CL_ClearState();
 
     CL_GTV_Suspend();
@@ -2742,6 +2746,7 @@ static void CL_InitLocal(void)
     cl_maxfps->changed = cl_sync_changed;
     cl_async = Cvar_Get("cl_async", "1", 0);
     cl_async->changed = cl_sync_changed;
+    cl_async_precache = Cvar_Get("cl_async_precache", "1", 0);
     r_maxfps = Cvar_Get("r_maxfps", "0", 0);
     r_maxfps->changed = cl_sync_changed;
     cl_autopause = Cvar_Get("cl_autopause", "1", 0);
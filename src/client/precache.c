@@ -318,27 +318,148 @@ void CL_SetSky(void)
 
 /*
 =================
-CL_RegisterImage
+CL_ImageType
 
 Hack to handle RF_CUSTOMSKIN for remaster
 =================
 */
-static qhandle_t CL_RegisterImage(const char *s)
+static imagetype_t CL_ImageType(const char *s, imageflags_t *flags)
 {
+    *flags = IF_NONE;
+
     // if it's in a subdir and has an extension, it's either a sprite or a skin
     // allow /some/pic.pcx escape syntax
     if (cl.csr.extended && *s != '/' && *s != '\\' && *COM_FileExtension(s)) {
-        if (!FS_pathcmpn(s, CONST_STR_LEN("sprites/psx_flare")))
-            return R_RegisterImage(s, IT_SPRITE, IF_DEFAULT_FLARE);
+        if (!FS_pathcmpn(s, CONST_STR_LEN("sprites/psx_flare"))) {
+            *flags = IF_DEFAULT_FLARE;
+            return IT_SPRITE;
+        }
 
         if (!FS_pathcmpn(s, CONST_STR_LEN("sprites/")))
-            return R_RegisterSprite(s);
+            return IT_SPRITE;
 
         if (strchr(s, '/'))
-            return R_RegisterSkin(s);
+            return IT_SKIN;
+    }
+
+    return IT_PIC;
+}
+
+static qhandle_t CL_RegisterImage(const char *s)
+{
+    imageflags_t flags;
+    imagetype_t type = CL_ImageType(s, &flags);
+
+    return R_RegisterImage(s, type, flags);
+}
+
+/*
+=================
+CL_PrefetchMedia
+
+Queues files CL_PrepRefresh and CL_RegisterSounds are about to load for
+reading by worker threads, in the order they are going to be loaded.
+Decoding and uploading still happens on the main thread, but overlaps
+with reading of subsequent files.
+=================
+*/
+static void CL_PrefetchMedia(void)
+{
+    char            buffer[MAX_QPATH];
+    imageflags_t    flags;
+    int             i;
+    char            *name;
+
+    FS_BeginPrefetch();
+
+    // world textures, see GL_LoadWorld
+    if (cl.bsp) {
+        for (i = 0; i < cl.bsp->numtexinfo; i++) {
+            const mtexinfo_t *info = &cl.bsp->texinfo[i];
+            if (info->c.flags & SURF_SKY)
+                continue;
+            if (info->c.flags & SURF_NODRAW && cl.bsp->has_bspx)
+                continue;
+            if (Q_concat(buffer, sizeof(buffer), "/textures/", info->name, ".wal") < sizeof(buffer))
+                R_PrefetchImage(buffer, IT_WALL);
+        }
+    }
+
+    for (i = 2; i < cl.csr.max_models; i++) {
+        name = cl.configstrings[cl.csr.models + i];
+        if (!name[0] && i != MODELINDEX_PLAYER)
+            break;
+        if (name[0] != '#')
+            R_PrefetchModel(name);
+    }
+
+    for (i = 1; i < cl.csr.max_images; i++) {
+        name = cl.configstrings[cl.csr.images + i];
+        if (!name[0])
+            break;
+        R_PrefetchImage(name, CL_ImageType(name, &flags));
     }
 
-    return R_RegisterTempPic(s);
+    for (i = 1; i < cl.csr.max_sounds; i++) {
+        name = cl.configstrings[cl.csr.sounds + i];
+        if (!name[0])
+            break;
+        S_PrefetchSound(name);
+    }
+}
+
+static const char *const load_stages[] = {
+    [LOAD_MAP]      = "map",
+    [LOAD_MODELS]   = "models",
+    [LOAD_IMAGES]   = "images",
+    [LOAD_CLIENTS]  = "clients",
+    [LOAD_SOUNDS]   = "sounds",
+};
+
+static struct {
+    load_state_t    state;
+    unsigned        start;
+    unsigned        msec[q_countof(load_stages)];
+} load_times;
+
+/*
+=================
+CL_UpdateLoadTimes
+
+Accounts time spent in each loading stage since CL_PrepRefresh. Prints
+the summary and finishes prefetching once loading is done.
+=================
+*/
+void CL_UpdateLoadTimes(load_state_t state)
+{
+    prefetch_stats_t stats;
+    unsigned now, total;
+    int i;
+
+    if (load_times.state == LOAD_NONE)
+        return;
+
+    now = Sys_Milliseconds();
+    load_times.msec[load_times.state] += now - load_times.start;
+    load_times.start = now;
+    load_times.state = state;
+
+    if (state != LOAD_NONE)
+        return;
+
+    FS_EndPrefetch(&stats);
+
+    for (i = LOAD_MAP, total = 0; i < q_countof(load_times.msec); i++)
+        total += load_times.msec[i];
+
+    Com_DPrintf("Loaded %s in %u ms:", cl.mapname, total);
+    for (i = LOAD_MAP; i < q_countof(load_times.msec); i++)
+        Com_DPrintf(" %s %u", load_stages[i], load_times.msec[i]);
+    Com_DPrintf("\n");
+
+    if (stats.queued)
+        Com_DPrintf("Prefetched %u of %u files, %u ms reading, %u waits for %u ms\n",
+                   stats.hits, stats.queued, stats.read_msec, stats.waits, stats.wait_msec);
 }
 
 /*
@@ -358,6 +479,13 @@ void CL_PrepRefresh(void)
     if (!cl.mapname[0])
         return;     // no map loaded
 
+    memset(&load_times, 0, sizeof(load_times));
+    load_times.state = LOAD_MAP;
+    load_times.start = Sys_Milliseconds();
+
+    if (cl_async_precache->integer)
+        CL_PrefetchMedia();
+
     // register models, pics, and skins
     R_BeginRegistration(cl.mapname);
 
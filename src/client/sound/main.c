@@ -357,6 +357,23 @@ S_RegisterSound
 
 ==================
 */
+static size_t S_SoundPath(char *buffer, const char *name)
+{
+    size_t  len;
+
+    if (*name == '*') {
+        len = Q_strlcpy(buffer, name, MAX_QPATH);
+    } else if (*name == '#') {
+        len = FS_NormalizePathBuffer(buffer, name + 1, MAX_QPATH);
+    } else {
+        len = Q_concat(buffer, MAX_QPATH, "sound/", name);
+        if (len < MAX_QPATH)
+            len = FS_NormalizePath(buffer);
+    }
+
+    return len;
+}
+
 qhandle_t S_RegisterSound(const char *name)
 {
     char    buffer[MAX_QPATH];
@@ -372,15 +389,7 @@ qhandle_t S_RegisterSound(const char *name)
     if (!*name)
         return 0;
 
-    if (*name == '*') {
-        len = Q_strlcpy(buffer, name, MAX_QPATH);
-    } else if (*name == '#') {
-        len = FS_NormalizePathBuffer(buffer, name + 1, MAX_QPATH);
-    } else {
-        len = Q_concat(buffer, MAX_QPATH, "sound/", name);
-        if (len < MAX_QPATH)
-            len = FS_NormalizePath(buffer);
-    }
+    len = S_SoundPath(buffer, name);
 
     // this MAY happen after prepending "sound/"
     if (len >= MAX_QPATH) {
@@ -407,6 +416,34 @@ qhandle_t S_RegisterSound(const char *name)
     return (sfx - known_sfx) + 1;
 }
 
+/*
+==================
+S_PrefetchSound
+
+Queues sound file for background reading, unless it is already cached.
+==================
+*/
+void S_PrefetchSound(const char *name)
+{
+    char    buffer[MAX_QPATH];
+    sfx_t   *sfx;
+    size_t  len;
+    int     i;
+
+    if (!s_started || *name == '*')
+        return;
+
+    len = S_SoundPath(buffer, name);
+    if (!len || len >= MAX_QPATH)
+        return;
+
+    for (i = 0, sfx = known_sfx; i < num_sfx; i++, sfx++)
+        if (sfx->cache && !FS_pathcmp(sfx->name, buffer))
+            return;
+
+    FS_PrefetchFile(buffer, FS_FLAG_MMAP);
+}
+
 /*
 ====================
 S_RegisterSexedSound
@@ -912,7 +949,8 @@ void S_Update(void)
         listener_entnum = cl.frame.clientNum + 1;
     }
 
+    PROF_BEGIN("S_Update");
     OGG_Update();
-
     s_api->update();
+    PROF_END();
 }
@@ -18,64 +18,177 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 #include "common/async.h"
+#include "common/common.h"
+#include "common/cvar.h"
 #include "common/zone.h"
 #include "system/pthread.h"
 
+#define MAX_WORK_THREADS    16
+
+typedef struct {
+    asyncwork_t *head;
+    asyncwork_t *tail;
+} workqueue_t;
+
+static cvar_t *com_async_threads;
+
 static bool work_initialized;
 static bool work_terminate;
 static pthread_mutex_t work_lock;
 static pthread_cond_t work_cond;
-static pthread_t work_thread;
-static asyncwork_t *pend_head;
-static asyncwork_t *done_head;
+static pthread_t work_threads[MAX_WORK_THREADS];
+static int work_numthreads;
+static unsigned work_sequence;
+static workqueue_t pend_queues[ASYNC_PRIO_MAX];
+static workqueue_t done_queue;
 
-static void append_work(asyncwork_t **head, asyncwork_t *work)
+static void append_work(workqueue_t *q, asyncwork_t *work)
 {
-    asyncwork_t *c, **p;
-    for (p = head, c = *head; c; p = &c->next, c = c->next)
-        ;
     work->next = NULL;
-    *p = work;
+    if (q->tail)
+        q->tail->next = work;
+    else
+        q->head = work;
+    q->tail = work;
+}
+
+static asyncwork_t *remove_work(workqueue_t *q)
+{
+    asyncwork_t *work = q->head;
+
+    if (work) {
+        q->head = work->next;
+        if (!q->head)
+            q->tail = NULL;
+    }
+
+    return work;
+}
+
+static asyncwork_t *next_work(void)
+{
+    for (int i = 0; i < ASYNC_PRIO_MAX; i++) {
+        asyncwork_t *work = remove_work(&pend_queues[i]);
+        if (work)
+            return work;
+    }
+    return NULL;
 }
 
 static void *work_func(void *arg)
 {
     pthread_mutex_lock(&work_lock);
     while (1) {
-        while (!pend_head && !work_terminate)
+        asyncwork_t *work;
+
+        while (!(work = next_work()) && !work_terminate)
             pthread_cond_wait(&work_cond, &work_lock);
 
-        asyncwork_t *work = pend_head;
         if (!work)
             break;
-        pend_head = work->next;
 
         pthread_mutex_unlock(&work_lock);
         work->work_cb(work->cb_arg);
         pthread_mutex_lock(&work_lock);
 
-        append_work(&done_head, work);
+        append_work(&done_queue, work);
     }
     pthread_mutex_unlock(&work_lock);
 
     return NULL;
 }
 
-void Com_QueueAsyncWork(asyncwork_t *work)
+static void init_work(void)
 {
-    if (!work_initialized) {
-        pthread_mutex_init(&work_lock, NULL);
-        pthread_cond_init(&work_cond, NULL);
-        if (pthread_create(&work_thread, NULL, work_func, NULL))
-            Com_Error(ERR_FATAL, "Couldn't create async work thread");
-        work_initialized = true;
-    }
+    int i, count = Cvar_ClampInteger(com_async_threads, 1, MAX_WORK_THREADS);
+
+    pthread_mutex_init(&work_lock, NULL);
+    pthread_cond_init(&work_cond, NULL);
+
+    for (i = 0; i < count; i++)
+        if (pthread_create(&work_threads[i], NULL, work_func, NULL))
+            break;
+
+    if (!i)
+        Com_Error(ERR_FATAL, "Couldn't create async work thread");
+    if (i < count)
+        Com_WPrintf("Created only %d of %d async work threads\n", i, count);
+
+    work_numthreads = i;
+    work_initialized = true;
+}
+
+/*
+Queues a copy of `work' for execution on one of the worker threads.
+Work callbacks are started in priority order, then in order of queueing,
+but may complete out of order if there is more than one worker thread.
+Completion callbacks run on the main thread. Returns handle that can be
+passed to Com_CancelAsyncWork. Must be called from the main thread.
+*/
+unsigned Com_QueueAsyncWork(const asyncwork_t *work)
+{
+    asyncwork_t *copy;
+
+    Q_assert(work->priority >= 0 && work->priority < ASYNC_PRIO_MAX);
+
+    if (!work_initialized)
+        init_work();
+
+    copy = Z_CopyStruct(work);
 
     pthread_mutex_lock(&work_lock);
-    append_work(&pend_head, Z_CopyStruct(work));
+    if (!++work_sequence)
+        work_sequence = 1;
+    copy->handle = work_sequence;
+    append_work(&pend_queues[work->priority], copy);
     pthread_mutex_unlock(&work_lock);
 
     pthread_cond_signal(&work_cond);
+
+    return copy->handle;
+}
+
+/*
+Cancels pending work that has not been started yet. If successful, work
+callback is never called, cancel callback (if any) is called immediately
+instead of completion callback. Work that is already running or completed
+can't be canceled.
+*/
+bool Com_CancelAsyncWork(unsigned handle)
+{
+    asyncwork_t *work = NULL;
+    int i;
+
+    if (!work_initialized || !handle)
+        return false;
+
+    pthread_mutex_lock(&work_lock);
+    for (i = 0; i < ASYNC_PRIO_MAX && !work; i++) {
+        workqueue_t *q = &pend_queues[i];
+        asyncwork_t *c, *prev = NULL;
+
+        for (c = q->head; c; prev = c, c = c->next) {
+            if (c->handle != handle)
+                continue;
+            if (prev)
+                prev->next = c->next;
+            else
+                q->head = c->next;
+            if (q->tail == c)
+                q->tail = prev;
+            work = c;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&work_lock);
+
+    if (!work)
+        return false;
+
+    if (work->cancel_cb)
+        work->cancel_cb(work->cb_arg);
+    Z_Free(work);
+    return true;
 }
 
 void Com_CompleteAsyncWork(void)
@@ -86,16 +199,21 @@ void Com_CompleteAsyncWork(void)
         return;
     if (pthread_mutex_trylock(&work_lock))
         return;
-    if (q_unlikely(done_head)) {
-        for (work = done_head; work; work = next) {
-            next = work->next;
-            if (work->done_cb)
-                work->done_cb(work->cb_arg);
-            Z_Free(work);
-        }
-        done_head = NULL;
-    }
+    work = done_queue.head;
+    done_queue.head = done_queue.tail = NULL;
     pthread_mutex_unlock(&work_lock);
+
+    for (; work; work = next) {
+        next = work->next;
+        if (work->done_cb)
+            work->done_cb(work->cb_arg);
+        Z_Free(work);
+    }
+}
+
+void Com_InitAsyncWork(void)
+{
+    com_async_threads = Cvar_Get("com_async_threads", "2", 0);
 }
 
 void Com_ShutdownAsyncWork(void)
@@ -107,12 +225,15 @@ void Com_ShutdownAsyncWork(void)
     work_terminate = true;
     pthread_mutex_unlock(&work_lock);
 
-    pthread_cond_signal(&work_cond);
+    pthread_cond_broadcast(&work_cond);
 
-    Q_assert(!pthread_join(work_thread, NULL));
+    for (int i = 0; i < work_numthreads; i++)
+        Q_assert(!pthread_join(work_threads[i], NULL));
     Com_CompleteAsyncWork();
 
     pthread_mutex_destroy(&work_lock);
     pthread_cond_destroy(&work_cond);
+    work_numthreads = 0;
+    work_terminate = false;
     work_initialized = false;
 }
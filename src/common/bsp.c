@@ -32,10 +32,33 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/sizebuf.h"
 #include "common/utils.h"
 #include "system/hunk.h"
+#include "system/pthread.h"
 
 extern mtexinfo_t nulltexinfo;
 
 static cvar_t *map_visibility_patch;
+static cvar_t *map_visibility_cache;
+
+// decompressed PVS/PHS rows, indexed by cluster * 2 + vis
+typedef struct bspvis_s {
+    size_t      rowstride;  // multiple of sizeof(size_t)
+    size_t      memsize;
+    int         numrows;
+    byte        *rows;
+
+    // if the full cache doesn't fit, rows are kept in LRU slots
+    bool        lru;
+    int         numslots;
+    int         usedslots;
+    int         *slotmap;   // row -> slot, -1 if not cached
+    int         *rowmap;    // slot -> row
+    int         *prev, *next;
+    int         head, tail; // most and least recently used slot
+    pthread_mutex_t lock;
+} bspvis_t;
+
+static void BSP_InitVisCache(bsp_t *bsp);
+static void BSP_FreeVisCache(bsp_t *bsp);
 
 /*
 ===============================================================================
@@ -206,6 +229,12 @@ static void BSP_List_f(void)
     LIST_FOR_EACH(bsp_t, bsp, &bsp_cache, entry) {
         Com_Printf("%8zu : %s (%d refs)\n",
                    bsp->hunk.mapped, bsp->name, bsp->refcount);
+        if (bsp->viscache) {
+            const bspvis_t *c = bsp->viscache;
+            Com_Printf("%8zu : vis cache (%s, %d rows)\n", c->memsize,
+                       c->lru ? "lru" : "full", c->lru ? c->numslots : c->numrows);
+            bytes += c->memsize;
+        }
         if (verbose)
             BSP_PrintStats(bsp);
         bytes += bsp->hunk.mapped;
@@ -332,6 +361,7 @@ void BSP_Free(bsp_t *bsp)
     }
     Q_assert(bsp->refcount > 0);
     if (--bsp->refcount == 0) {
+        BSP_FreeVisCache(bsp);
         Hunk_Free(&bsp->hunk);
         List_Remove(&bsp->entry);
         Z_Free(bsp);
@@ -777,7 +807,7 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
     //
     // load the file
     //
-    filelen = FS_LoadFile(name, (void **)&buf);
+    filelen = FS_LoadFileEx(name, (void **)&buf, FS_FLAG_MMAP, TAG_FILESYSTEM);
     if (!buf) {
         return filelen;
     }
@@ -889,6 +919,8 @@ int BSP_Load(const char *name, bsp_t **bsp_p)
 
     Hunk_End(&bsp->hunk);
 
+    BSP_InitVisCache(bsp);
+
     List_Append(&bsp_cache, &bsp->entry);
 
     FS_FreeFile(buf);
@@ -1036,31 +1068,25 @@ void BSP_TransformedLightPoint(lightpoint_t *point, const vec3_t start, const ve
 
 #endif
 
-void BSP_ClusterVis(const bsp_t *bsp, visrow_t *mask, int cluster, int vis)
+/*
+===============================================================================
+
+                    VISIBILITY
+
+===============================================================================
+*/
+
+static void BSP_DecompressVis(const bsp_t *bsp, byte *mask, int cluster, int vis)
 {
     const byte  *in, *in_end;
     byte        *out, *out_end;
     int         c;
 
-    Q_assert(vis == DVIS_PVS || vis == DVIS_PHS);
-
-    if (!bsp || !bsp->vis) {
-        memset(mask, 0xff, sizeof(*mask));
-        return;
-    }
-    if (cluster == -1) {
-        memset(mask, 0, bsp->visrowsize);
-        return;
-    }
-    if (cluster < 0 || cluster >= bsp->vis->numclusters) {
-        Com_Error(ERR_DROP, "%s: bad cluster", __func__);
-    }
-
     // decompress vis
     in_end = (const byte *)bsp->vis + bsp->numvisibility;
     in = (const byte *)bsp->vis + bsp->vis->bitofs[cluster][vis];
-    out_end = mask->b + bsp->visrowsize;
-    out = mask->b;
+    out_end = mask + bsp->visrowsize;
+    out = mask;
     do {
         if (in >= in_end) {
             goto overrun;
@@ -1124,6 +1150,186 @@ overrun:
     }
 }
 
+static void BSP_UnlinkVisSlot(bspvis_t *c, int slot)
+{
+    if (c->prev[slot] != -1)
+        c->next[c->prev[slot]] = c->next[slot];
+    else
+        c->head = c->next[slot];
+
+    if (c->next[slot] != -1)
+        c->prev[c->next[slot]] = c->prev[slot];
+    else
+        c->tail = c->prev[slot];
+}
+
+static void BSP_LinkVisSlot(bspvis_t *c, int slot)
+{
+    c->prev[slot] = -1;
+    c->next[slot] = c->head;
+    if (c->head != -1)
+        c->prev[c->head] = slot;
+    else
+        c->tail = slot;
+    c->head = slot;
+}
+
+static byte *BSP_CachedVis(const bsp_t *bsp, int cluster, int vis)
+{
+    bspvis_t *c = bsp->viscache;
+    int row = cluster * 2 + vis;
+    int slot;
+
+    if (!c->lru)
+        return c->rows + row * c->rowstride;
+
+    // caller holds the lock
+    slot = c->slotmap[row];
+    if (slot == -1) {
+        if (c->usedslots < c->numslots) {
+            slot = c->usedslots++;
+        } else {
+            // evict least recently used row
+            slot = c->tail;
+            BSP_UnlinkVisSlot(c, slot);
+            c->slotmap[c->rowmap[slot]] = -1;
+        }
+        BSP_DecompressVis(bsp, c->rows + slot * c->rowstride, cluster, vis);
+        c->slotmap[row] = slot;
+        c->rowmap[slot] = row;
+    } else if (slot == c->head) {
+        return c->rows + slot * c->rowstride;
+    } else {
+        BSP_UnlinkVisSlot(c, slot);
+    }
+
+    BSP_LinkVisSlot(c, slot);
+    return c->rows + slot * c->rowstride;
+}
+
+static void BSP_InitVisCache(bsp_t *bsp)
+{
+    bspvis_t *c;
+    size_t limit, stride, total;
+    int i, numrows;
+
+    if (!bsp->vis || map_visibility_cache->integer <= 0)
+        return;
+
+    limit = (size_t)map_visibility_cache->integer << 20;
+    stride = VIS_FAST_LONGS(bsp->visrowsize) * sizeof(size_t);
+    numrows = bsp->vis->numclusters * 2;
+    total = stride * numrows;
+
+    c = Z_Mallocz(sizeof(*c));
+    c->rowstride = stride;
+    c->numrows = numrows;
+
+    if (total <= limit) {
+        // decompress everything now
+        c->rows = Z_Mallocz(total);
+        c->memsize = total;
+        bsp->viscache = c;
+        for (i = 0; i < numrows; i++)
+            BSP_DecompressVis(bsp, c->rows + i * stride, i >> 1, i & 1);
+        return;
+    }
+
+    c->lru = true;
+    c->numslots = max(limit / stride, 1);
+    c->rows = Z_Mallocz(stride * c->numslots);
+    c->slotmap = Z_Malloc(sizeof(c->slotmap[0]) * numrows);
+    c->rowmap = Z_Malloc(sizeof(c->rowmap[0]) * c->numslots);
+    c->prev = Z_Malloc(sizeof(c->prev[0]) * c->numslots);
+    c->next = Z_Malloc(sizeof(c->next[0]) * c->numslots);
+    for (i = 0; i < numrows; i++)
+        c->slotmap[i] = -1;
+    c->head = c->tail = -1;
+    c->memsize = (stride + sizeof(int) * 3) * c->numslots + sizeof(int) * numrows;
+    pthread_mutex_init(&c->lock, NULL);
+    bsp->viscache = c;
+}
+
+static void BSP_FreeVisCache(bsp_t *bsp)
+{
+    bspvis_t *c = bsp->viscache;
+
+    if (!c)
+        return;
+
+    if (c->lru) {
+        pthread_mutex_destroy(&c->lock);
+        Z_Free(c->slotmap);
+        Z_Free(c->rowmap);
+        Z_Free(c->prev);
+        Z_Free(c->next);
+    }
+    Z_Free(c->rows);
+    Z_Free(c);
+    bsp->viscache = NULL;
+}
+
+static void map_visibility_changed(cvar_t *self)
+{
+    bsp_t *bsp;
+
+    LIST_FOR_EACH(bsp_t, bsp, &bsp_cache, entry) {
+        BSP_FreeVisCache(bsp);
+        BSP_InitVisCache(bsp);
+    }
+}
+
+void BSP_ClusterVis(const bsp_t *bsp, visrow_t *mask, int cluster, int vis)
+{
+    bspvis_t *c;
+
+    Q_assert(vis == DVIS_PVS || vis == DVIS_PHS);
+
+    if (!bsp || !bsp->vis) {
+        memset(mask, 0xff, sizeof(*mask));
+        return;
+    }
+    if (cluster == -1) {
+        memset(mask, 0, bsp->visrowsize);
+        return;
+    }
+    if (cluster < 0 || cluster >= bsp->vis->numclusters) {
+        Com_Error(ERR_DROP, "%s: bad cluster", __func__);
+    }
+
+    c = bsp->viscache;
+    if (!c) {
+        BSP_DecompressVis(bsp, mask->b, cluster, vis);
+    } else if (c->lru) {
+        pthread_mutex_lock(&c->lock);
+        memcpy(mask, BSP_CachedVis(bsp, cluster, vis), bsp->visrowsize);
+        pthread_mutex_unlock(&c->lock);
+    } else {
+        memcpy(mask, BSP_CachedVis(bsp, cluster, vis), bsp->visrowsize);
+    }
+}
+
+/*
+==================
+BSP_GetClusterVis
+
+Returns pointer to read-only visibility row if it is fully cached,
+otherwise decompresses it into `temp' and returns that. Only the first
+VIS_FAST_LONGS(visrowsize) longs of returned row are valid.
+==================
+*/
+const visrow_t *BSP_GetClusterVis(const bsp_t *bsp, visrow_t *temp, int cluster, int vis)
+{
+    if (bsp && bsp->vis && bsp->viscache && !bsp->viscache->lru &&
+        cluster >= 0 && cluster < bsp->vis->numclusters) {
+        Q_assert(vis == DVIS_PVS || vis == DVIS_PHS);
+        return (const visrow_t *)BSP_CachedVis(bsp, cluster, vis);
+    }
+
+    BSP_ClusterVis(bsp, temp, cluster, vis);
+    return temp;
+}
+
 const mleaf_t *BSP_PointLeaf(const mnode_t *node, const vec3_t p)
 {
     float d;
@@ -1160,6 +1366,9 @@ const mmodel_t *BSP_InlineModel(const bsp_t *bsp, const char *name)
 void BSP_Init(void)
 {
     map_visibility_patch = Cvar_Get("map_visibility_patch", "1", 0);
+    map_visibility_patch->changed = map_visibility_changed;
+    map_visibility_cache = Cvar_Get("map_visibility_cache", "32", 0);
+    map_visibility_cache->changed = map_visibility_changed;
 
     Cmd_AddCommand("bsplist", BSP_List_f);
 
@@ -172,7 +172,6 @@ BSP_LOAD(Brushes)
         out->firstbrushside = bsp->brushsides + firstside;
         out->numsides = numsides;
         out->contents = BSP_Long();
-        out->checkcount = 0;
     }
 
     return Q_ERR_SUCCESS;
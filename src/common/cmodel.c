@@ -35,7 +35,6 @@ mtexinfo_t nulltexinfo;
 const mleaf_t       nullleaf = { .cluster = -1 };
 
 static unsigned     floodvalid;
-static unsigned     checkcount;
 
 static cvar_t       *map_noareas;
 static cvar_t       *map_override_path;
@@ -257,96 +256,116 @@ const mleaf_t *CM_LeafNum(const cm_t *cm, int number)
 
 //=======================================================================
 
-static cplane_t box_planes[12];
-static mnode_t  box_nodes[6];
-static mnode_t  *box_headnode;
-static mbrush_t box_brush;
-static mbrush_t *box_leafbrush;
-static mbrushside_t box_brushsides[6];
-static mleaf_t  box_leaf;
-static mleaf_t  box_emptyleaf;
+// default context for non-reentrant functions, one per thread
+static q_thread_local cm_trace_t    cm_trace;
 
 /*
 ===================
-CM_InitBoxHull
+CM_InitTrace
 
 Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-static void CM_InitBoxHull(void)
+void CM_InitTrace(cm_trace_t *tr)
 {
+    cm_boxhull_t    *box = &tr->box;
     int         i;
     int         side;
     mnode_t     *c;
     cplane_t    *p;
     mbrushside_t    *s;
 
-    box_headnode = &box_nodes[0];
+    memset(tr, 0, sizeof(*tr));
 
-    box_brush.numsides = 6;
-    box_brush.firstbrushside = &box_brushsides[0];
-    box_brush.contents = CONTENTS_MONSTER;
+    box->brush.numsides = 6;
+    box->brush.firstbrushside = &box->brushsides[0];
+    box->brush.contents = CONTENTS_MONSTER;
 
-    box_leaf.contents[0] = box_leaf.contents[1] = CONTENTS_MONSTER;
-    box_leaf.firstleafbrush = &box_leafbrush;
-    box_leaf.numleafbrushes = 1;
+    box->leaf.contents[0] = box->leaf.contents[1] = CONTENTS_MONSTER;
+    box->leaf.firstleafbrush = &box->leafbrush;
+    box->leaf.numleafbrushes = 1;
 
-    box_leafbrush = &box_brush;
+    box->leafbrush = &box->brush;
 
     for (i = 0; i < 6; i++) {
         side = i & 1;
 
         // brush sides
-        s = &box_brushsides[i];
-        s->plane = &box_planes[i * 2 + side];
+        s = &box->brushsides[i];
+        s->plane = &box->planes[i * 2 + side];
         s->texinfo = &nulltexinfo;
 
         // nodes
-        c = &box_nodes[i];
-        c->plane = &box_planes[i * 2];
-        c->children[side] = (mnode_t *)&box_emptyleaf;
+        c = &box->nodes[i];
+        c->plane = &box->planes[i * 2];
+        c->children[side] = (mnode_t *)&box->emptyleaf;
         if (i != 5)
-            c->children[side ^ 1] = &box_nodes[i + 1];
+            c->children[side ^ 1] = &box->nodes[i + 1];
         else
-            c->children[side ^ 1] = (mnode_t *)&box_leaf;
+            c->children[side ^ 1] = (mnode_t *)&box->leaf;
 
         // planes
-        p = &box_planes[i * 2];
+        p = &box->planes[i * 2];
         p->type = i >> 1;
         p->normal[i >> 1] = 1;
 
-        p = &box_planes[i * 2 + 1];
+        p = &box->planes[i * 2 + 1];
         p->type = 3 + (i >> 1);
         p->signbits = 1 << (i >> 1);
         p->normal[i >> 1] = -1;
     }
+
+    // box hull headnode is marked by pointing parent to itself,
+    // this never happens for BSP nodes
+    box->nodes[0].parent = &box->nodes[0];
+}
+
+static inline bool CM_IsBoxHull(const mnode_t *headnode)
+{
+    return headnode->parent == headnode;
+}
+
+static cm_trace_t *CM_DefaultTrace(void)
+{
+    if (q_unlikely(!cm_trace.box.brush.numsides))
+        CM_InitTrace(&cm_trace);
+    return &cm_trace;
 }
 
 /*
 ===================
-CM_HeadnodeForBox
+CM_HeadnodeForBoxEx
 
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
+
+Returned hull is owned by trace context and is valid until the next call.
 ===================
 */
+const mnode_t *CM_HeadnodeForBoxEx(cm_trace_t *tr, const vec3_t mins, const vec3_t maxs)
+{
+    cplane_t *planes = tr->box.planes;
+
+    planes[0].dist = maxs[0];
+    planes[1].dist = -maxs[0];
+    planes[2].dist = mins[0];
+    planes[3].dist = -mins[0];
+    planes[4].dist = maxs[1];
+    planes[5].dist = -maxs[1];
+    planes[6].dist = mins[1];
+    planes[7].dist = -mins[1];
+    planes[8].dist = maxs[2];
+    planes[9].dist = -maxs[2];
+    planes[10].dist = mins[2];
+    planes[11].dist = -mins[2];
+
+    return &tr->box.nodes[0];
+}
+
 const mnode_t *CM_HeadnodeForBox(const vec3_t mins, const vec3_t maxs)
 {
-    box_planes[0].dist = maxs[0];
-    box_planes[1].dist = -maxs[0];
-    box_planes[2].dist = mins[0];
-    box_planes[3].dist = -mins[0];
-    box_planes[4].dist = maxs[1];
-    box_planes[5].dist = -maxs[1];
-    box_planes[6].dist = mins[1];
-    box_planes[7].dist = -mins[1];
-    box_planes[8].dist = maxs[2];
-    box_planes[9].dist = -maxs[2];
-    box_planes[10].dist = mins[2];
-    box_planes[11].dist = -mins[2];
-
-    return box_headnode;
+    return CM_HeadnodeForBoxEx(CM_DefaultTrace(), mins, maxs);
 }
 
 /*
@@ -356,31 +375,33 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int              leaf_count, leaf_maxcount;
-static const mleaf_t    **leaf_list;
-static const vec_t      *leaf_mins, *leaf_maxs;
-static const mnode_t    *leaf_topnode;
-
-static void CM_BoxLeafs_r(const mnode_t *node)
+typedef struct {
+    int             count, maxcount;
+    const mleaf_t   **list;
+    const vec_t     *mins, *maxs;
+    const mnode_t   *topnode;
+} boxleafs_t;
+
+static void CM_BoxLeafs_r(boxleafs_t *bl, const mnode_t *node)
 {
     while (node->plane) {
-        box_plane_t s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        box_plane_t s = BoxOnPlaneSideFast(bl->mins, bl->maxs, node->plane);
         if (s == BOX_INFRONT) {
             node = node->children[0];
         } else if (s == BOX_BEHIND) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!bl->topnode) {
+                bl->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(bl, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (const mleaf_t *)node;
+    if (bl->count < bl->maxcount) {
+        bl->list[bl->count++] = (const mleaf_t *)node;
     }
 }
 
@@ -388,20 +409,19 @@ int CM_BoxLeafs_headnode(const vec3_t mins, const vec3_t maxs,
                          const mleaf_t **list, int listsize,
                          const mnode_t *headnode, const mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
+    boxleafs_t bl = {
+        .maxcount = listsize,
+        .list = list,
+        .mins = mins,
+        .maxs = maxs,
+    };
 
-    leaf_topnode = NULL;
-
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&bl, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = bl.topnode;
 
-    return leaf_count;
+    return bl.count;
 }
 
 /*
@@ -426,7 +446,7 @@ int CM_TransformedPointContents(const vec3_t p, const mnode_t *headnode,
     VectorSubtract(p, origin, p_l);
 
     // rotate start and end into the models frame of reference
-    if (headnode != box_headnode && !VectorEmpty(angles)) {
+    if (!CM_IsBoxHull(headnode) && !VectorEmpty(angles)) {
         AnglesToAxis(angles, axis);
         RotatePoint(p_l, axis);
     }
@@ -445,21 +465,61 @@ BOX TRACING
 // 1/32 epsilon to keep floating point happy
 #define DIST_EPSILON    0.03125f
 
-static vec3_t   trace_start, trace_end;
-static vec3_t   trace_offsets[8];
-static vec3_t   trace_extents;
+/*
+================
+CM_CheckedBrush
+
+Returns true if brush was already checked during current trace, otherwise
+marks it checked. Brushes are tracked in a small generation stamped hash
+table private to trace context, so that BSP data is never written to and
+several contexts can trace through the same map concurrently. If the table
+fills up, brush is simply clipped again, which is harmless.
+================
+*/
+static bool CM_CheckedBrush(cm_trace_t *tr, const mbrush_t *brush)
+{
+    uint32_t h = (uint32_t)((uintptr_t)brush / sizeof(*brush)) * 0x9E3779B1;
+    int i;
+
+    for (i = h >> (32 - CM_TRACE_CHECKED_BITS); ; i = (i + 1) & (CM_TRACE_CHECKED - 1)) {
+        if (tr->checkstamps[i] != tr->checkcount) {
+            if (tr->numchecked >= CM_TRACE_CHECKED * 3 / 4)
+                return false;
+            tr->checkstamps[i] = tr->checkcount;
+            tr->checked[i] = brush;
+            tr->numchecked++;
+            return false;
+        }
+        if (tr->checked[i] == brush)
+            return true;
+    }
+}
+
+static void CM_BeginTrace(cm_trace_t *tr, trace_t *trace, int brushmask, bool extended)
+{
+    // for multi-check avoidance
+    if (++tr->checkcount == 0) {
+        memset(tr->checkstamps, 0, sizeof(tr->checkstamps));
+        tr->checkcount = 1;
+    }
+    tr->numchecked = 0;
+
+    // fill in a default trace
+    tr->trace = trace;
+    memset(trace, 0, sizeof(*trace));
+    trace->fraction = 1;
+    trace->surface = &(nulltexinfo.c);
 
-static trace_t  *trace_trace;
-static int      trace_contents;
-static bool     trace_ispoint;      // optimized case
-static bool     trace_extended;     // remaster fixes
+    tr->contents = brushmask;
+    tr->extended = extended;
+}
 
 /*
 ================
 CM_ClipBoxToBrush
 ================
 */
-static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace, const mbrush_t *brush)
+static void CM_ClipBoxToBrush(const cm_trace_t *tr, const vec3_t p1, const vec3_t p2, trace_t *trace, const mbrush_t *brush)
 {
     int         i;
     const cplane_t  *plane, *clipplane;
@@ -486,10 +546,10 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         plane = side->plane;
 
         // FIXME: special case for axial
-        if (!trace_ispoint) {
+        if (!tr->ispoint) {
             // general box case
             // push the plane out apropriately for mins/maxs
-            dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+            dist = DotProduct(tr->offsets[plane->signbits], plane->normal);
             dist = plane->dist - dist;
         } else {
             // special point case
@@ -537,7 +597,7 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
         trace->startsolid = true;
         if (!getout) {
             trace->allsolid = true;
-            if (trace_extended) {
+            if (tr->extended) {
                 // original Q2 didn't set these
                 trace->fraction = 0;
                 trace->contents = brush->contents;
@@ -560,7 +620,7 @@ static void CM_ClipBoxToBrush(const vec3_t p1, const vec3_t p2, trace_t *trace,
 CM_TestBoxInBrush
 ================
 */
-static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, const mbrush_t *brush)
+static void CM_TestBoxInBrush(const cm_trace_t *tr, const vec3_t p1, trace_t *trace, const mbrush_t *brush)
 {
     int         i;
     const cplane_t  *plane;
@@ -578,7 +638,7 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, const mbrush_t *b
         // FIXME: special case for axial
         // general box case
         // push the plane out apropriately for mins/maxs
-        dist = DotProduct(trace_offsets[plane->signbits], plane->normal);
+        dist = DotProduct(tr->offsets[plane->signbits], plane->normal);
         dist = plane->dist - dist;
 
         d1 = DotProduct(p1, plane->normal) - dist;
@@ -599,25 +659,25 @@ static void CM_TestBoxInBrush(const vec3_t p1, trace_t *trace, const mbrush_t *b
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(const mleaf_t *leaf)
+static void CM_TraceToLeaf(cm_trace_t *tr, const mleaf_t *leaf)
 {
     int         k;
-    mbrush_t    *b, **leafbrush;
+    const mbrush_t  *b;
+    mbrush_t    **leafbrush;
 
-    if (!(leaf->contents[trace_extended] & trace_contents))
+    if (!(leaf->contents[tr->extended] & tr->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_CheckedBrush(tr, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tr->contents))
             continue;
-        CM_ClipBoxToBrush(trace_start, trace_end, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_ClipBoxToBrush(tr, tr->start, tr->end, tr->trace, b);
+        if (!tr->trace->fraction)
             return;
     }
 }
@@ -627,25 +687,25 @@ static void CM_TraceToLeaf(const mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(const mleaf_t *leaf)
+static void CM_TestInLeaf(cm_trace_t *tr, const mleaf_t *leaf)
 {
     int         k;
-    mbrush_t    *b, **leafbrush;
+    const mbrush_t  *b;
+    mbrush_t    **leafbrush;
 
-    if (!(leaf->contents[trace_extended] & trace_contents))
+    if (!(leaf->contents[tr->extended] & tr->contents))
         return;
     // trace line against all brushes in the leaf
     leafbrush = leaf->firstleafbrush;
     for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
         b = *leafbrush;
-        if (b->checkcount == checkcount)
+        if (CM_CheckedBrush(tr, b))
             continue;   // already checked this brush in another leaf
-        b->checkcount = checkcount;
 
-        if (!(b->contents & trace_contents))
+        if (!(b->contents & tr->contents))
             continue;
-        CM_TestBoxInBrush(trace_start, trace_trace, b);
-        if (!trace_trace->fraction)
+        CM_TestBoxInBrush(tr, tr->start, tr->trace, b);
+        if (!tr->trace->fraction)
             return;
     }
 }
@@ -656,7 +716,7 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(const mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
+static void CM_RecursiveHullCheck(cm_trace_t *tr, const mnode_t *node, float p1f, float p2f, const vec3_t p1, const vec3_t p2)
 {
     const cplane_t  *plane;
     float       t1, t2, offset;
@@ -666,14 +726,14 @@ static void CM_RecursiveHullCheck(const mnode_t *node, float p1f, float p2f, con
     int         side;
     float       midf;
 
-    if (trace_trace->fraction <= p1f)
+    if (tr->trace->fraction <= p1f)
         return;     // already hit something nearer
 
 recheck:
     // if plane is NULL, we are in a leaf node
     plane = node->plane;
     if (!plane) {
-        CM_TraceToLeaf((const mleaf_t *)node);
+        CM_TraceToLeaf(tr, (const mleaf_t *)node);
         return;
     }
 
@@ -684,16 +744,16 @@ recheck:
     if (plane->type < 3) {
         t1 = p1[plane->type] - plane->dist;
         t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+        offset = tr->extents[plane->type];
     } else {
         t1 = PlaneDiff(p1, plane);
         t2 = PlaneDiff(p2, plane);
-        if (trace_ispoint)
+        if (tr->ispoint)
             offset = 0;
         else
-            offset = fabsf(trace_extents[0] * plane->normal[0]) +
-                     fabsf(trace_extents[1] * plane->normal[1]) +
-                     fabsf(trace_extents[2] * plane->normal[2]);
+            offset = fabsf(tr->extents[0] * plane->normal[0]) +
+                     fabsf(tr->extents[1] * plane->normal[1]) +
+                     fabsf(tr->extents[2] * plane->normal[2]);
     }
 
     // see which sides we need to consider
@@ -730,49 +790,47 @@ recheck:
     midf = p1f + (p2f - p1f) * frac;
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(tr, node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     midf = p1f + (p2f - p1f) * frac2;
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(tr, node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
 //======================================================================
 
-/*
-==================
-CM_BoxTrace
-==================
-*/
-void CM_BoxTrace(trace_t *trace,
-                 const vec3_t start, const vec3_t end,
-                 const vec3_t mins, const vec3_t maxs,
-                 const mnode_t *headnode, int brushmask,
-                 bool extended)
+static void CM_SetTraceBounds(cm_trace_t *tr, const vec3_t mins, const vec3_t maxs)
 {
     const vec_t *bounds[2] = { mins, maxs };
     int i, j;
 
-    checkcount++;       // for multi-check avoidance
+    for (i = 0; i < 8; i++)
+        for (j = 0; j < 3; j++)
+            tr->offsets[i][j] = bounds[(i >> j) & 1][j];
 
-    // fill in a default trace
-    trace_trace = trace;
-    memset(trace_trace, 0, sizeof(*trace_trace));
-    trace_trace->fraction = 1;
-    trace_trace->surface = &(nulltexinfo.c);
+    //
+    // check for point special case
+    //
+    if (VectorEmpty(mins) && VectorEmpty(maxs)) {
+        tr->ispoint = true;
+        VectorClear(tr->extents);
+    } else {
+        tr->ispoint = false;
+        tr->extents[0] = max(-mins[0], maxs[0]);
+        tr->extents[1] = max(-mins[1], maxs[1]);
+        tr->extents[2] = max(-mins[2], maxs[2]);
+    }
+}
 
-    if (!headnode)
-        return;
+static void CM_TraceBox(cm_trace_t *tr, const vec3_t start, const vec3_t end, const mnode_t *headnode)
+{
+    trace_t *trace = tr->trace;
+    int i;
 
-    trace_contents = brushmask;
-    trace_extended = extended;
-    VectorCopy(start, trace_start);
-    VectorCopy(end, trace_end);
-    for (i = 0; i < 8; i++)
-        for (j = 0; j < 3; j++)
-            trace_offsets[i][j] = bounds[(i >> j) & 1][j];
+    VectorCopy(start, tr->start);
+    VectorCopy(end, tr->end);
 
     //
     // check for position test special case
@@ -783,58 +841,111 @@ void CM_BoxTrace(trace_t *trace,
         vec3_t          c1, c2;
 
         for (i = 0; i < 3; i++) {
-            c1[i] = start[i] + mins[i] - 1;
-            c2[i] = start[i] + maxs[i] + 1;
+            c1[i] = start[i] + tr->offsets[0][i] - 1;
+            c2[i] = start[i] + tr->offsets[7][i] + 1;
         }
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, q_countof(leafs), headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
-            if (trace_trace->allsolid)
+            CM_TestInLeaf(tr, leafs[i]);
+            if (trace->allsolid)
                 break;
         }
-        VectorCopy(start, trace_trace->endpos);
+        VectorCopy(start, trace->endpos);
         return;
     }
 
-    //
-    // check for point special case
-    //
-    if (VectorEmpty(mins) && VectorEmpty(maxs)) {
-        trace_ispoint = true;
-        VectorClear(trace_extents);
-    } else {
-        trace_ispoint = false;
-        trace_extents[0] = max(-mins[0], maxs[0]);
-        trace_extents[1] = max(-mins[1], maxs[1]);
-        trace_extents[2] = max(-mins[2], maxs[2]);
-    }
-
     //
     // general sweeping through world
     //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+    CM_RecursiveHullCheck(tr, headnode, 0, 1, start, end);
 
-    if (trace_trace->fraction == 1)
-        VectorCopy(end, trace_trace->endpos);
+    if (trace->fraction == 1)
+        VectorCopy(end, trace->endpos);
     else
-        LerpVector(start, end, trace_trace->fraction, trace_trace->endpos);
+        LerpVector(start, end, trace->fraction, trace->endpos);
+}
+
+/*
+==================
+CM_BoxTraceEx
+
+Reentrant version of CM_BoxTrace. Each thread must use its own context.
+==================
+*/
+void CM_BoxTraceEx(cm_trace_t *tr, trace_t *trace,
+                   const vec3_t start, const vec3_t end,
+                   const vec3_t mins, const vec3_t maxs,
+                   const mnode_t *headnode, int brushmask,
+                   bool extended)
+{
+    CM_BeginTrace(tr, trace, brushmask, extended);
+
+    if (!headnode)
+        return;
+
+    CM_SetTraceBounds(tr, mins, maxs);
+    CM_TraceBox(tr, start, end, headnode);
+}
+
+/*
+==================
+CM_BoxTraceBatch
+
+Traces a batch of rays sharing the same bounds, headnode and contents mask.
+Bounds are set up only once for the whole batch.
+==================
+*/
+void CM_BoxTraceBatch(cm_trace_t *tr, trace_t *traces,
+                      const cm_ray_t *rays, int count,
+                      const vec3_t mins, const vec3_t maxs,
+                      const mnode_t *headnode, int brushmask,
+                      bool extended)
+{
+    int i;
+
+    if (count <= 0)
+        return;
+
+    if (headnode)
+        CM_SetTraceBounds(tr, mins, maxs);
+
+    for (i = 0; i < count; i++) {
+        CM_BeginTrace(tr, &traces[i], brushmask, extended);
+        if (headnode)
+            CM_TraceBox(tr, rays[i].start, rays[i].end, headnode);
+    }
+}
+
+/*
+==================
+CM_BoxTrace
+==================
+*/
+void CM_BoxTrace(trace_t *trace,
+                 const vec3_t start, const vec3_t end,
+                 const vec3_t mins, const vec3_t maxs,
+                 const mnode_t *headnode, int brushmask,
+                 bool extended)
+{
+    CM_BoxTraceEx(CM_DefaultTrace(), trace, start, end, mins, maxs,
+                  headnode, brushmask, extended);
 }
 
 /*
 ==================
-CM_TransformedBoxTrace
+CM_TransformedBoxTraceEx
 
 Handles offseting and rotation of the end points for moving and
 rotating entities
 ==================
 */
-void CM_TransformedBoxTrace(trace_t *trace,
-                            const vec3_t start, const vec3_t end,
-                            const vec3_t mins, const vec3_t maxs,
-                            const mnode_t *headnode, int brushmask,
-                            const vec3_t origin, const vec3_t angles,
-                            bool extended)
+void CM_TransformedBoxTraceEx(cm_trace_t *tr, trace_t *trace,
+                              const vec3_t start, const vec3_t end,
+                              const vec3_t mins, const vec3_t maxs,
+                              const mnode_t *headnode, int brushmask,
+                              const vec3_t origin, const vec3_t angles,
+                              bool extended)
 {
     vec3_t      start_l, end_l;
     vec3_t      axis[3];
@@ -845,7 +956,7 @@ void CM_TransformedBoxTrace(trace_t *trace,
     VectorSubtract(end, origin, end_l);
 
     // rotate start and end into the models frame of reference
-    rotated = headnode != box_headnode && !VectorEmpty(angles);
+    rotated = headnode && !CM_IsBoxHull(headnode) && !VectorEmpty(angles);
     if (rotated) {
         AnglesToAxis(angles, axis);
         RotatePoint(start_l, axis);
@@ -853,7 +964,7 @@ void CM_TransformedBoxTrace(trace_t *trace,
     }
 
     // sweep the box through the model
-    CM_BoxTrace(trace, start_l, end_l, mins, maxs, headnode, brushmask, extended);
+    CM_BoxTraceEx(tr, trace, start_l, end_l, mins, maxs, headnode, brushmask, extended);
 
     if (trace->fraction != 1.0f) {
         // rotate plane normal into the worlds frame of reference
@@ -870,6 +981,17 @@ void CM_TransformedBoxTrace(trace_t *trace,
     LerpVector(start, end, trace->fraction, trace->endpos);
 }
 
+void CM_TransformedBoxTrace(trace_t *trace,
+                            const vec3_t start, const vec3_t end,
+                            const vec3_t mins, const vec3_t maxs,
+                            const mnode_t *headnode, int brushmask,
+                            const vec3_t origin, const vec3_t angles,
+                            bool extended)
+{
+    CM_TransformedBoxTraceEx(CM_DefaultTrace(), trace, start, end, mins, maxs,
+                             headnode, brushmask, origin, angles, extended);
+}
+
 void CM_ClipEntity(trace_t *dst, const trace_t *src, struct edict_s *ent)
 {
     dst->allsolid |= src->allsolid;
@@ -971,6 +1093,40 @@ bool CM_AreasConnected(const cm_t *cm, int area1, int area2)
     return false;
 }
 
+/*
+=================
+CM_ConnectedAreas
+
+Writes a byte for each of MAX_MAP_AREAS areas, set to 1 if that area is
+connected to the area parameter, as CM_AreasConnected would tell.
+=================
+*/
+void CM_ConnectedAreas(const cm_t *cm, byte *buffer, int area)
+{
+    int     i, numareas;
+
+    if (!cm->cache) {
+        memset(buffer, 0, MAX_MAP_AREAS);
+        return;
+    }
+
+    if (map_noareas->integer) {
+        memset(buffer, 1, MAX_MAP_AREAS);
+        return;
+    }
+
+    memset(buffer, 0, MAX_MAP_AREAS);
+
+    numareas = cm->cache->numareas;
+    if (area < 1 || area >= numareas) {
+        return;
+    }
+
+    for (i = 1; i < numareas; i++) {
+        buffer[i] = cm->floodnums[i] == cm->floodnums[area];
+    }
+}
+
 /*
 =================
 CM_WriteAreaBits
@@ -1144,8 +1300,6 @@ CM_Init
 */
 void CM_Init(void)
 {
-    CM_InitBoxHull();
-
     map_noareas = Cvar_Get("map_noareas", "0", 0);
     map_override_path = Cvar_Get("map_override_path", "", 0);
 }
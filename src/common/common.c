@@ -38,6 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/chan.h"
 #include "common/net/net.h"
 #include "common/pmove.h"
+#include "common/profile.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/tests.h"
@@ -48,6 +49,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "server/server.h"
 #include "system/system.h"
 #include "system/hunk.h"
+#include "system/pthread.h"
 
 #if USE_DEBUG
 #include "features.h"
@@ -60,11 +62,20 @@ static jmp_buf  com_abortframe;    // an ERR_DROP occured, exit the entire frame
 static void     (*com_abort_func)(void *);
 static void     *com_abort_arg;
 
+static q_thread_local errorfunc_t   com_error_func;
+
 static bool     com_errorEntered;
 static char     com_errorMsg[MAXERRORMSG]; // from Com_Printf/Com_Error
 
 static int      com_printEntered;
 
+// messages printed from worker threads are queued here
+#define PRINT_QUEUE_SIZE    0x4000
+
+static pthread_mutex_t  com_printLock = PTHREAD_MUTEX_INITIALIZER;
+static char             com_printQueue[PRINT_QUEUE_SIZE];
+static size_t           com_printQueueLen;
+
 static qhandle_t    com_logFile;
 static bool         com_logNewline;
 #if USE_SYSCON
@@ -413,12 +424,51 @@ const char *Com_GetLastError(void)
     return com_errorMsg[0] ? com_errorMsg : "No error";
 }
 
+static void Com_QueuePrint(print_type_t type, const char *msg, size_t len)
+{
+    char *p;
+
+    pthread_mutex_lock(&com_printLock);
+    if (com_printQueueLen + len + 2 <= sizeof(com_printQueue)) {
+        p = com_printQueue + com_printQueueLen;
+        p[0] = type;
+        memcpy(p + 1, msg, len + 1);
+        com_printQueueLen += len + 2;
+    }
+    pthread_mutex_unlock(&com_printLock);
+}
+
+/*
+=============
+Com_FlushPrints
+
+Outputs messages queued by worker threads. Main thread only.
+=============
+*/
+static void Com_FlushPrints(void)
+{
+    char    buffer[PRINT_QUEUE_SIZE];
+    size_t  pos, len;
+
+    pthread_mutex_lock(&com_printLock);
+    len = com_printQueueLen;
+    memcpy(buffer, com_printQueue, len);
+    com_printQueueLen = 0;
+    pthread_mutex_unlock(&com_printLock);
+
+    for (pos = 0; pos < len; pos += strlen(buffer + pos + 1) + 2)
+        Com_LPrintf(buffer[pos], "%s", buffer + pos + 1);
+}
+
 /*
 =============
 Com_Printf
 
 Both client and server can use this, and it will output
 to the apropriate place.
+
+Messages printed from other threads are deferred until
+the next frame on the main thread.
 =============
 */
 void Com_LPrintf(print_type_t type, const char *fmt, ...)
@@ -427,6 +477,15 @@ void Com_LPrintf(print_type_t type, const char *fmt, ...)
     char        msg[MAXPRINTMSG];
     size_t      len;
 
+    if (!Sys_IsMainThread()) {
+        va_start(argptr, fmt);
+        len = Q_vscnprintf(msg, sizeof(msg), fmt, argptr);
+        va_end(argptr);
+
+        Com_QueuePrint(type, msg, len);
+        return;
+    }
+
     // may be entered recursively only once
     if (com_printEntered >= 2) {
         return;
@@ -515,6 +574,16 @@ void Com_Error(error_type_t code, const char *fmt, ...)
     va_list         argptr;
     size_t          len;
 
+    // let worker thread handle its own errors
+    if (com_error_func) {
+        va_start(argptr, fmt);
+        Q_vscnprintf(msg, sizeof(msg), fmt, argptr);
+        va_end(argptr);
+
+        com_error_func(code, msg);
+        Sys_Error("%s: error function returned", __func__);
+    }
+
     // may not be entered recursively
     if (com_errorEntered) {
 #if USE_DEBUG
@@ -542,6 +611,9 @@ void Com_Error(error_type_t code, const char *fmt, ...)
     // abort any console redirects
     Com_AbortRedirect();
 
+    // drop packets queued for batched send
+    NET_AbortSendBatch();
+
     // call custom cleanup function if set
     if (com_abort_func) {
         com_abort_func(com_abort_arg);
@@ -600,6 +672,20 @@ abort:
     longjmp(com_abortframe, -1);
 }
 
+/*
+=============
+Com_SetErrorFunc
+
+Errors raised on threads other than main can't abort the frame. Threads
+that may call Com_Error set a function that records the error and unwinds
+back to the thread entry point, so that it can be raised on main thread.
+=============
+*/
+void Com_SetErrorFunc(errorfunc_t func)
+{
+    com_error_func = func;
+}
+
 void Com_AbortFunc(void (*func)(void *), void *arg)
 {
     com_abort_func = func;
@@ -885,7 +971,6 @@ void Qcommon_Init(int argc, char **argv)
 
     // prepare enough of the subsystems to handle
     // cvar and command buffer management
-    Z_Init();
     Hunk_Init();
     MSG_Init();
     Cbuf_Init();
@@ -936,6 +1021,9 @@ void Qcommon_Init(int argc, char **argv)
     com_debug_break = Cvar_Get("com_debug_break", "0", 0);
 #endif
     com_fatal_error = Cvar_Get("com_fatal_error", "0", 0);
+
+    Com_InitAsyncWork();
+    Com_InitProfiler();
     com_version = Cvar_Get("version", com_version_string, CVAR_SERVERINFO | CVAR_ROM);
 
     allow_download = Cvar_Get("allow_download", COM_DEDICATED ? "0" : "1", CVAR_ARCHIVE);
@@ -1068,11 +1156,14 @@ void Qcommon_Frame(void)
     static float frac;
 
     if (setjmp(com_abortframe)) {
+        Com_ProfileUnwind();
         return; // an ERR_DROP was thrown
     }
 
     Com_CompleteAsyncWork();
 
+    Com_FlushPrints();
+
 #if USE_CLIENT
     time_before = time_event = time_between = time_after = 0;
 
@@ -1134,13 +1225,17 @@ void Qcommon_Frame(void)
 
     NET_UpdateStats();
 
+    PROF_BEGIN("SV_Frame");
     remaining = SV_Frame(msec);
+    PROF_END();
 
 #if USE_CLIENT
     if (host_speeds->integer)
         time_between = Sys_Milliseconds();
 
+    PROF_BEGIN("CL_Frame");
     clientrem = CL_Frame(msec);
+    PROF_END();
     if (remaining > clientrem) {
         remaining = clientrem;
     }
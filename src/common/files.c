@@ -18,19 +18,26 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 #include "shared/list.h"
+#include "common/async.h"
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/error.h"
 #include "common/files.h"
+#include "common/profile.h"
 #include "common/prompt.h"
 #include "common/intreadwrite.h"
 #include "system/system.h"
+#include "system/pthread.h"
 #include "client/client.h"
 #include "server/server.h"
 #include "format/pak.h"
 
 #include <fcntl.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #if USE_ZLIB
 #include <zlib.h>
 #endif
@@ -51,6 +58,17 @@ QUAKE FILESYSTEM
 
 #define MAX_FILE_HANDLES    1024
 
+#ifdef HAVE_MMAP
+#define MAX_FILE_VIEWS      64
+#endif
+
+#if USE_CLIENT
+#define MIN_PREFETCH_FILES  256
+#define MAX_PREFETCH_QUEUED 16          // files queued or being read
+#define MAX_PREFETCH_BYTES  0x4000000   // 64 MiB of unclaimed data
+#define PREFETCH_HASH_SIZE  256
+#endif
+
 #if USE_ZLIB
 #define ZIP_BUFSIZE     (1 << 16)   // inflate in blocks of 64k
 #define ZIP_MAXFILES    (1 << 20)   // 1 million files
@@ -157,6 +175,39 @@ typedef struct {
     int64_t     length;     // total cached file length
 } file_t;
 
+#ifdef HAVE_MMAP
+// private mapping of stored pack entry handed out by FS_LoadFile
+typedef struct {
+    void        *data;      // what caller got
+    void        *base;      // page aligned start of mapping
+    size_t      size;
+    pack_t      *pack;      // keeps pack referenced while mapped
+} fileview_t;
+#endif
+
+#if USE_CLIENT
+typedef enum {
+    PF_PENDING,     // waiting to be queued
+    PF_QUEUED,      // queued for async work
+    PF_RUNNING,     // being read by worker thread
+    PF_DONE,        // read finished, waiting to be claimed
+    PF_CLAIMED      // handed over to FS_LoadFile or discarded
+} pfstate_t;
+
+// file read ahead of time by worker thread
+typedef struct prefetch_s {
+    struct prefetch_s   *hash_next;
+    pfstate_t   state;
+    unsigned    mode;       // lookup flags file must be loaded with
+    unsigned    handle;     // async work handle while queued
+    int         index;
+    int64_t     ret;        // file length or error code
+    byte        *data;
+    unsigned    msec;       // time it took to read
+    char        path[1];
+} prefetch_t;
+#endif
+
 typedef struct {
     list_t      entry;
     unsigned    targlen;
@@ -180,11 +231,34 @@ static int          fs_num_files;
 
 static bool         fs_non_uniq_open;
 
+#ifdef HAVE_MMAP
+static fileview_t   fs_views[MAX_FILE_VIEWS];
+static int          fs_num_views;
+#endif
+
+// packs can be referenced from prefetch threads
+static pthread_mutex_t  fs_pack_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#if USE_CLIENT
+static pthread_mutex_t  fs_prefetch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   fs_prefetch_cond = PTHREAD_COND_INITIALIZER;
+static bool             fs_prefetching;
+static prefetch_t       **fs_prefetch;
+static int              fs_num_prefetch;
+static int              fs_next_prefetch;       // next entry to queue
+static int              fs_first_prefetch;      // first entry not yet passed by
+static int              fs_prefetch_queued;     // queued or running entries
+static size_t           fs_prefetch_bytes;      // done, but not claimed
+static prefetch_t       *fs_prefetch_hash[PREFETCH_HASH_SIZE];
+static prefetch_stats_t fs_prefetch_stats;
+#endif
+
 #if USE_DEBUG
-static unsigned     fs_count_read;
-static unsigned     fs_count_open;
-static unsigned     fs_count_strcmp;
-static unsigned     fs_count_strlwr;
+// only main thread lookups are counted
+static q_thread_local unsigned  fs_count_read;
+static q_thread_local unsigned  fs_count_open;
+static q_thread_local unsigned  fs_count_strcmp;
+static q_thread_local unsigned  fs_count_strlwr;
 #define FS_COUNT_READ       fs_count_read++
 #define FS_COUNT_OPEN       fs_count_open++
 #define FS_COUNT_STRCMP     fs_count_strcmp++
@@ -198,6 +272,10 @@ static unsigned     fs_count_strlwr;
 
 static cvar_t       *fs_autoexec;
 
+#ifdef HAVE_MMAP
+static cvar_t       *fs_mmap;
+#endif
+
 #if USE_DEBUG
 static cvar_t       *fs_debug;
 #endif
@@ -219,6 +297,10 @@ static int seek_zip_file(file_t *file, int64_t offset, int whence);
 static pack_t *pack_get(pack_t *pack);
 static void pack_put(pack_t *pack);
 
+#if USE_CLIENT
+static int64_t claim_prefetch(const char *path, unsigned flags, void **buffer);
+#endif
+
 /*
 
 All of Quake's data access is through a hierchal file system,
@@ -632,20 +714,10 @@ int FS_CreatePath(char *path)
     return Q_ERR_SUCCESS;
 }
 
-/*
-==============
-FS_CloseFile
-==============
-*/
-int FS_CloseFile(qhandle_t f)
+static int close_file(file_t *file)
 {
-    file_t *file = file_for_handle(f);
-    int ret;
+    int ret = file->error;
 
-    if (!file)
-        return Q_ERR(EBADF);
-
-    ret = file->error;
     switch (file->type) {
     case FS_REAL:
         if (fclose(file->fp))
@@ -681,6 +753,21 @@ int FS_CloseFile(qhandle_t f)
     return ret;
 }
 
+/*
+==============
+FS_CloseFile
+==============
+*/
+int FS_CloseFile(qhandle_t f)
+{
+    file_t *file = file_for_handle(f);
+
+    if (!file)
+        return Q_ERR(EBADF);
+
+    return close_file(file);
+}
+
 static int get_path_info(const char *path, file_info_t *info)
 {
     Q_STATBUF st;
@@ -1475,6 +1562,33 @@ static int read_phys_file(file_t *file, void *buf, size_t len)
     return result;
 }
 
+static int read_file(file_t *file, void *buf, size_t len)
+{
+#if USE_ZLIB
+    int ret;
+#endif
+
+    switch (file->type) {
+    case FS_REAL:
+        return read_phys_file(file, buf, len);
+    case FS_PAK:
+        return read_pak_file(file, buf, len);
+#if USE_ZLIB
+    case FS_GZ:
+        ret = gzread(file->zfp, buf, len);
+        if (ret < 0) {
+            return Q_ERR_LIBRARY_ERROR;
+        }
+        return ret;
+    case FS_ZIP:
+        return read_zip_file(file, buf, len);
+#endif
+    default:
+        Q_assert(!"bad file type");
+        return 0;
+    }
+}
+
 /*
 =================
 FS_Read
@@ -1483,9 +1597,6 @@ FS_Read
 int FS_Read(void *buf, size_t len, qhandle_t f)
 {
     file_t *file = file_for_handle(f);
-#if USE_ZLIB
-    int ret;
-#endif
 
     if (!file)
         return Q_ERR(EBADF);
@@ -1503,25 +1614,7 @@ int FS_Read(void *buf, size_t len, qhandle_t f)
     if (len == 0)
         return 0;
 
-    switch (file->type) {
-    case FS_REAL:
-        return read_phys_file(file, buf, len);
-    case FS_PAK:
-        return read_pak_file(file, buf, len);
-#if USE_ZLIB
-    case FS_GZ:
-        ret = gzread(file->zfp, buf, len);
-        if (ret < 0) {
-            return Q_ERR_LIBRARY_ERROR;
-        }
-        return ret;
-    case FS_ZIP:
-        return read_zip_file(file, buf, len);
-#endif
-    default:
-        Q_assert(!"bad file type");
-        return 0;
-    }
+    return read_file(file, buf, len);
 }
 
 int FS_ReadLine(qhandle_t f, char *buffer, size_t size)
@@ -1825,6 +1918,62 @@ static void fuzz_data(const char *path, byte *buf, int size)
 }
 #endif
 
+#ifdef HAVE_MMAP
+/*
+============
+map_pack_file
+
+Maps stored pack entry into memory instead of reading it. Mapping is
+private, so caller can modify the data without touching the pack.
+============
+*/
+static void *map_pack_file(file_t *file)
+{
+    fileview_t *view;
+    Q_STATBUF st;
+    int64_t pos, ofs;
+    size_t size;
+    void *base;
+    int fd;
+
+    if (!fs_mmap->integer)
+        return NULL;
+
+    // only stored entries can be mapped
+    if (file->type != FS_PAK || !file->length)
+        return NULL;
+
+    if (fs_num_views == MAX_FILE_VIEWS)
+        return NULL;
+
+    // touching pages past end of truncated pack would fault
+    fd = os_fileno(file->fp);
+    pos = file->entry->filepos;
+    if (os_fstat(fd, &st) == -1 || pos + file->length > st.st_size)
+        return NULL;
+
+    ofs = pos % sysconf(_SC_PAGESIZE);
+    size = file->length + ofs;
+
+    base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, pos - ofs);
+    if (base == MAP_FAILED) {
+        FS_DPrintf("%s: %s: %s\n", __func__, file->pack->filename, strerror(errno));
+        return NULL;
+    }
+
+    view = &fs_views[fs_num_views++];
+    view->data = (byte *)base + ofs;
+    view->base = base;
+    view->size = size;
+    view->pack = pack_get(file->pack);
+
+    FS_DPrintf("%s: %s/%s: %zu bytes\n", __func__, file->pack->filename,
+               file->pack->names + file->entry->nameofs, size - ofs);
+
+    return view->data;
+}
+#endif
+
 /*
 ============
 FS_LoadFile
@@ -1833,7 +1982,7 @@ opens non-unique file handle as an optimization
 a NULL buffer will just return the file length without loading
 ============
 */
-int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
+static int load_file_ex(const char *path, void **buffer, unsigned flags, memtag_t tag)
 {
     file_t *file;
     qhandle_t f;
@@ -1855,6 +2004,20 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
         return Q_ERR(EINVAL);
     }
 
+#if USE_CLIENT
+    // see if worker thread has already read it
+    if (buffer && fs_prefetching && tag == TAG_FILESYSTEM) {
+        len = claim_prefetch(path, flags, buffer);
+        if (len != Q_ERR(EAGAIN)) {
+#if USE_TESTS
+            if (*buffer)
+                fuzz_data(path, *buffer, len);
+#endif
+            return len;
+        }
+    }
+#endif
+
     // allocate new file handle
     file = alloc_handle(&f);
     if (!file) {
@@ -1880,6 +2043,19 @@ int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
         goto done;
     }
 
+#ifdef HAVE_MMAP
+    if (flags & FS_FLAG_MMAP) {
+        buf = map_pack_file(file);
+        if (buf) {
+#if USE_TESTS
+            fuzz_data(path, buf, len);
+#endif
+            *buffer = buf;
+            goto done;
+        }
+    }
+#endif
+
     // allocate chunk of memory, +1 for NUL
     buf = Z_TagMalloc(len + 1, tag);
 
@@ -1903,6 +2079,372 @@ done:
     return len;
 }
 
+int FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
+{
+    int ret;
+
+    PROF_BEGIN("FS_LoadFileEx");
+    ret = load_file_ex(path, buffer, flags, tag);
+    PROF_END();
+
+    return ret;
+}
+
+/*
+============
+FS_FreeFile
+
+releases buffer returned by FS_LoadFile
+============
+*/
+void FS_FreeFile(void *buf)
+{
+#ifdef HAVE_MMAP
+    fileview_t *view;
+    int i;
+
+    for (i = 0, view = fs_views; i < fs_num_views; i++, view++) {
+        if (view->data == buf) {
+            munmap(view->base, view->size);
+            pack_put(view->pack);
+            *view = fs_views[--fs_num_views];
+            return;
+        }
+    }
+#endif
+
+    Z_Free(buf);
+}
+
+#if USE_CLIENT
+/*
+=============================================================================
+
+FILE PREFETCHING
+
+Files expected to be loaded soon are read by async work threads in order
+they were queued. FS_LoadFile claims the data when it gets to the file,
+otherwise falls back to reading it normally.
+
+=============================================================================
+*/
+
+static prefetch_t *find_prefetch(const char *path, unsigned mode)
+{
+    prefetch_t *pf;
+    unsigned hash;
+
+    hash = FS_HashPath(path, PREFETCH_HASH_SIZE);
+    for (pf = fs_prefetch_hash[hash]; pf; pf = pf->hash_next) {
+        if (pf->mode == mode && !FS_pathcmp(pf->path, path)) {
+            return pf;
+        }
+    }
+
+    return NULL;
+}
+
+// runs on worker thread, must only touch local file handle
+static int64_t prefetch_file(const prefetch_t *pf, byte **data_p)
+{
+    file_t file = { .mode = pf->mode | FS_MODE_READ };
+    int64_t len;
+    byte *buf;
+    int read;
+
+    len = expand_open_file_read(&file, pf->path);
+    if (len < 0) {
+        return len;
+    }
+
+    if (len > MAX_LOADFILE) {
+        len = Q_ERR(EFBIG);
+        goto done;
+    }
+
+#ifdef HAVE_MMAP
+    // leave stored pack entries to map_pack_file()
+    if ((pf->mode & FS_FLAG_MMAP) && fs_mmap->integer && file.type == FS_PAK) {
+        goto done;
+    }
+#endif
+
+    buf = FS_Malloc(len + 1);
+
+    read = len ? read_file(&file, buf, len) : 0;
+    if (read != len) {
+        len = read < 0 ? read : Q_ERR_UNEXPECTED_EOF;
+        Z_Free(buf);
+        goto done;
+    }
+
+    *data_p = buf;
+    buf[len] = 0;
+
+done:
+    close_file(&file);
+    return len;
+}
+
+static void prefetch_work_cb(void *arg)
+{
+    prefetch_t *pf = arg;
+    byte *data = NULL;
+    unsigned start;
+    int64_t ret;
+
+    pthread_mutex_lock(&fs_prefetch_lock);
+    if (pf->state != PF_QUEUED) {
+        // discarded before it could be canceled
+        fs_prefetch_queued--;
+        pthread_mutex_unlock(&fs_prefetch_lock);
+        pthread_cond_broadcast(&fs_prefetch_cond);
+        return;
+    }
+    pf->state = PF_RUNNING;
+    pthread_mutex_unlock(&fs_prefetch_lock);
+
+    start = Sys_Milliseconds();
+    ret = prefetch_file(pf, &data);
+
+    pthread_mutex_lock(&fs_prefetch_lock);
+    if (pf->state == PF_RUNNING) {
+        pf->state = PF_DONE;
+        pf->ret = ret;
+        pf->data = data;
+        pf->msec = Sys_Milliseconds() - start;
+        if (data) {
+            fs_prefetch_bytes += ret;
+        }
+    } else {
+        // discarded while running
+        Z_Free(data);
+    }
+    fs_prefetch_queued--;
+    pthread_mutex_unlock(&fs_prefetch_lock);
+    pthread_cond_broadcast(&fs_prefetch_cond);
+}
+
+// called with prefetch lock held
+static void discard_prefetch(prefetch_t *pf)
+{
+    switch (pf->state) {
+    case PF_QUEUED:
+        if (Com_CancelAsyncWork(pf->handle)) {
+            fs_prefetch_queued--;
+        }
+        break;
+    case PF_DONE:
+        if (pf->data) {
+            fs_prefetch_bytes -= pf->ret;
+            Z_Free(pf->data);
+            pf->data = NULL;
+        }
+        break;
+    default:
+        break;
+    }
+
+    pf->state = PF_CLAIMED;
+}
+
+static void pump_prefetch(void)
+{
+    asyncwork_t work = {
+        .work_cb = prefetch_work_cb,
+        .priority = ASYNC_PRIO_LOW,
+    };
+    prefetch_t *pf;
+
+    pthread_mutex_lock(&fs_prefetch_lock);
+    while (fs_next_prefetch < fs_num_prefetch &&
+           fs_prefetch_queued < MAX_PREFETCH_QUEUED &&
+           fs_prefetch_bytes < MAX_PREFETCH_BYTES) {
+        pf = fs_prefetch[fs_next_prefetch++];
+        if (pf->state != PF_PENDING) {
+            continue;
+        }
+        pf->state = PF_QUEUED;
+        fs_prefetch_queued++;
+        work.cb_arg = pf;
+        pf->handle = Com_QueueAsyncWork(&work);
+    }
+    pthread_mutex_unlock(&fs_prefetch_lock);
+}
+
+// returns Q_ERR(EAGAIN) if file was not prefetched
+static int64_t claim_prefetch(const char *path, unsigned flags, void **buffer)
+{
+    char normalized[MAX_OSPATH];
+    prefetch_t *pf;
+    unsigned start;
+    int64_t ret;
+    int i;
+
+    if (FS_NormalizePathBuffer(normalized, path, sizeof(normalized)) >= sizeof(normalized)) {
+        return Q_ERR(EAGAIN);
+    }
+
+    pf = find_prefetch(normalized, default_lookup_flags(flags));
+    if (!pf) {
+        return Q_ERR(EAGAIN);
+    }
+
+    pthread_mutex_lock(&fs_prefetch_lock);
+
+    // no point in waiting for file that wasn't started yet
+    if (pf->state == PF_QUEUED && Com_CancelAsyncWork(pf->handle)) {
+        pf->state = PF_PENDING;
+        fs_prefetch_queued--;
+    }
+
+    if (pf->state == PF_QUEUED || pf->state == PF_RUNNING) {
+        start = Sys_Milliseconds();
+        do {
+            pthread_cond_wait(&fs_prefetch_cond, &fs_prefetch_lock);
+        } while (pf->state != PF_DONE);
+        fs_prefetch_stats.waits++;
+        fs_prefetch_stats.wait_msec += Sys_Milliseconds() - start;
+    }
+
+    ret = Q_ERR(EAGAIN);
+    if (pf->state == PF_DONE) {
+        if (pf->data) {
+            *buffer = pf->data;
+            fs_prefetch_bytes -= pf->ret;
+            pf->data = NULL;
+            ret = pf->ret;
+        } else if (pf->ret == Q_ERR(ENOENT)) {
+            ret = pf->ret;
+        }
+        if (ret != Q_ERR(EAGAIN)) {
+            fs_prefetch_stats.hits++;
+        }
+        fs_prefetch_stats.read_msec += pf->msec;
+    }
+    pf->state = PF_CLAIMED;
+
+    // files queued before this one are not going to be loaded
+    for (i = fs_first_prefetch; i < pf->index; i++) {
+        discard_prefetch(fs_prefetch[i]);
+    }
+    fs_first_prefetch = max(fs_first_prefetch, pf->index + 1);
+
+    pthread_mutex_unlock(&fs_prefetch_lock);
+
+    pump_prefetch();
+
+    return ret;
+}
+
+/*
+============
+FS_BeginPrefetch
+
+Starts new prefetch session, ending previous one.
+============
+*/
+void FS_BeginPrefetch(void)
+{
+    FS_EndPrefetch(NULL);
+
+    if (!fs_searchpaths) {
+        return;
+    }
+
+    fs_prefetching = true;
+}
+
+/*
+============
+FS_PrefetchFile
+
+Queues file for reading by worker thread. Flags must match those the file
+will be loaded with later.
+============
+*/
+void FS_PrefetchFile(const char *path, unsigned flags)
+{
+    char normalized[MAX_OSPATH];
+    prefetch_t *pf;
+    unsigned hash, mode;
+    size_t len;
+
+    if (!fs_prefetching) {
+        return;
+    }
+
+    len = FS_NormalizePathBuffer(normalized, path, sizeof(normalized));
+    if (!len || len >= sizeof(normalized)) {
+        return;
+    }
+
+    mode = default_lookup_flags(flags);
+    if (find_prefetch(normalized, mode)) {
+        return;
+    }
+
+    pf = FS_Mallocz(sizeof(*pf) + len);
+    pf->state = PF_PENDING;
+    pf->mode = mode;
+    pf->index = fs_num_prefetch;
+    memcpy(pf->path, normalized, len + 1);
+
+    hash = FS_HashPath(normalized, PREFETCH_HASH_SIZE);
+    pf->hash_next = fs_prefetch_hash[hash];
+    fs_prefetch_hash[hash] = pf;
+
+    if (!(fs_num_prefetch % MIN_PREFETCH_FILES)) {
+        fs_prefetch = Z_Realloc(fs_prefetch, (fs_num_prefetch + MIN_PREFETCH_FILES) * sizeof(fs_prefetch[0]));
+    }
+    fs_prefetch[fs_num_prefetch++] = pf;
+    fs_prefetch_stats.queued++;
+
+    pump_prefetch();
+}
+
+/*
+============
+FS_EndPrefetch
+
+Waits for worker threads and frees all prefetched data that was not
+claimed. Fills in statistics if `stats' is not NULL.
+============
+*/
+void FS_EndPrefetch(prefetch_stats_t *stats)
+{
+    int i;
+
+    if (stats) {
+        *stats = fs_prefetch_stats;
+    }
+
+    if (!fs_prefetching) {
+        return;
+    }
+
+    pthread_mutex_lock(&fs_prefetch_lock);
+    for (i = 0; i < fs_num_prefetch; i++) {
+        discard_prefetch(fs_prefetch[i]);
+    }
+    while (fs_prefetch_queued) {
+        pthread_cond_wait(&fs_prefetch_cond, &fs_prefetch_lock);
+    }
+    pthread_mutex_unlock(&fs_prefetch_lock);
+
+    for (i = 0; i < fs_num_prefetch; i++) {
+        Z_Free(fs_prefetch[i]);
+    }
+    Z_Freep(&fs_prefetch);
+
+    fs_num_prefetch = fs_next_prefetch = fs_first_prefetch = 0;
+    fs_prefetch_bytes = 0;
+    memset(fs_prefetch_hash, 0, sizeof(fs_prefetch_hash));
+    memset(&fs_prefetch_stats, 0, sizeof(fs_prefetch_stats));
+    fs_prefetching = false;
+}
+#endif // USE_CLIENT
+
 static int write_and_close(const void *data, size_t len, qhandle_t f)
 {
     int ret1 = FS_Write(data, len, f);
@@ -2034,18 +2576,25 @@ static void pack_free(pack_t *pack)
 // references pack_t instance
 static pack_t *pack_get(pack_t *pack)
 {
+    pthread_mutex_lock(&fs_pack_lock);
     pack->refcount++;
+    pthread_mutex_unlock(&fs_pack_lock);
     return pack;
 }
 
 // dereferences pack_t instance
 static void pack_put(pack_t *pack)
 {
+    unsigned refcount;
+
     if (!pack) {
         return;
     }
+    pthread_mutex_lock(&fs_pack_lock);
     Q_assert(pack->refcount > 0);
-    if (!--pack->refcount) {
+    refcount = --pack->refcount;
+    pthread_mutex_unlock(&fs_pack_lock);
+    if (!refcount) {
         FS_DPrintf("Freeing packfile %s\n", pack->filename);
         pack_free(pack);
     }
@@ -3325,6 +3874,9 @@ static void FS_Stats_f(void)
     Com_Printf("Total path comparsions: %u\n", fs_count_strcmp);
     Com_Printf("Total calls to open_from_disk: %u\n", fs_count_open);
     Com_Printf("Total mixed-case reopens: %u\n", fs_count_strlwr);
+#ifdef HAVE_MMAP
+    Com_Printf("Mapped file views: %d\n", fs_num_views);
+#endif
 
     if (!totalHashSize) {
         Com_Printf("No stats to display\n");
@@ -3608,6 +4160,10 @@ void FS_Restart(bool total)
 {
     Com_Printf("----- FS_Restart -----\n");
 
+#if USE_CLIENT
+    FS_EndPrefetch(NULL);
+#endif
+
     if (total) {
         // perform full reset
         free_all_paths();
@@ -3670,6 +4226,10 @@ void FS_Shutdown(void)
         return;
     }
 
+#if USE_CLIENT
+    FS_EndPrefetch(NULL);
+#endif
+
     // close file handles
     for (i = 0, file = fs_files; i < fs_num_files; i++, file++) {
         if (file->type != FS_FREE) {
@@ -3807,6 +4367,10 @@ void FS_Init(void)
 
     fs_autoexec = Cvar_Get("fs_autoexec", "1", 0);
 
+#ifdef HAVE_MMAP
+    fs_mmap = Cvar_Get("fs_mmap", "1", 0);
+#endif
+
 #if USE_DEBUG
     fs_debug = Cvar_Get("fs_debug", "0", 0);
 #endif
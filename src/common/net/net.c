@@ -29,11 +29,16 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #endif
 #include "common/msg.h"
 #include "common/net/net.h"
+#include "common/profile.h"
 #include "common/protocol.h"
 #include "common/zone.h"
 #include "client/client.h"
 #include "server/server.h"
 #include "system/system.h"
+#ifndef _WIN32
+#include "shared/atomic.h"
+#include "system/pthread.h"
+#endif
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -53,7 +58,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include <poll.h>
+#include <fcntl.h>
 #include <errno.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 #if USE_ICMP
 #include <linux/errqueue.h>
 #else
@@ -65,6 +74,99 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents infinite retry loops caused by broken TCP/IP stacks
 #define MAX_ERROR_RETRIES   64
 
+#ifdef HAVE_EPOLL
+#define USE_EPOLL   1
+#else
+#define USE_EPOLL   0
+#endif
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define USE_MMSG    1
+#else
+#define USE_MMSG    0
+#endif
+
+#ifdef _WIN32
+#define USE_RECV_THREAD 0
+#else
+#define USE_RECV_THREAD 1
+#endif
+
+#if USE_MMSG
+
+#define MAX_RECV_BATCH  16
+#define MAX_SEND_BATCH  32
+
+typedef struct {
+    struct mmsghdr          hdrs[MAX_RECV_BATCH];
+    struct iovec            iovs[MAX_RECV_BATCH];
+    struct sockaddr_storage addrs[MAX_RECV_BATCH];
+    byte                    data[MAX_RECV_BATCH][MAX_PACKETLEN];
+} recvbatch_t;
+
+typedef struct {
+    netsrc_t                sock;
+    bool                    active;
+    bool                    failed;     // send error, stop batching
+    int                     count;
+    struct mmsghdr          hdrs[MAX_SEND_BATCH];
+    struct iovec            iovs[MAX_SEND_BATCH];
+    struct sockaddr_storage addrs[MAX_SEND_BATCH];
+    struct pollfd           *socks[MAX_SEND_BATCH];
+    netadr_t                to[MAX_SEND_BATCH];
+    byte                    data[MAX_SEND_BATCH][MAX_PACKETLEN];
+} sendbatch_t;
+
+static recvbatch_t  *net_recv_batch;
+static sendbatch_t  *net_send_batch;
+
+#endif // USE_MMSG
+
+#if USE_RECV_THREAD
+
+#define RECV_RING_SIZE  512     // must be power of two
+
+typedef struct {
+    netadr_t    from;
+    unsigned    time;
+    unsigned    len;
+    int         sock;               // index into recvring_t::fds
+    bool        error;              // ICMP error instead of packet
+    int         ee_errno;
+    int         ee_info;
+    byte        data[MAX_PACKETLEN];
+} recvslot_t;
+
+// single producer (receive thread), single consumer (main thread) queue
+typedef struct {
+    recvslot_t      slots[RECV_RING_SIZE];
+    atomic_uint     head;               // written by receive thread
+    atomic_uint     tail;               // written by main thread
+    atomic_int      full;               // thread waits for main to drain
+    atomic_uint     errors;             // recv errors not yet counted
+    atomic_int      quit;
+    int             fds[2];             // server UDP and UDP6 sockets
+    int             wake[2];            // main -> thread pipe
+    int             notify[2];          // thread -> main pipe
+    struct pollfd   *notify_pfd;
+    pthread_t       thread;
+    bool            running;
+    unsigned        generation;
+    uint64_t        overflows;
+} recvring_t;
+
+static recvring_t   *net_recv_ring;
+
+// main thread must not read from sockets owned by receive thread
+static bool NET_RecvThreadOwnsSocket(qsocket_t sock)
+{
+    const recvring_t *r = net_recv_ring;
+
+    return r && r->running && (sock == r->fds[0] || sock == r->fds[1]);
+}
+
+#endif // USE_RECV_THREAD
+
 #if USE_CLIENT
 
 #define MAX_LOOPBACK    4
@@ -89,6 +191,7 @@ cvar_t          *net_ip6;
 cvar_t          *net_port;
 
 netadr_t        net_from;
+unsigned        net_from_time;
 
 #if USE_CLIENT
 static cvar_t   *net_clientport;
@@ -103,6 +206,14 @@ static cvar_t   *net_log_flush;
 
 static cvar_t   *net_enable_ipv6;
 
+#if USE_MMSG
+static cvar_t   *net_batch;
+#endif
+
+#if USE_RECV_THREAD
+static cvar_t   *net_recv_thread;
+#endif
+
 #if USE_ICMP
 static cvar_t   *net_ignore_icmp;
 #endif
@@ -120,10 +231,30 @@ static struct pollfd    *tcp6_socket;
 static qhandle_t    net_logFile;
 #endif
 
-#define MAX_POLL_FDS    1024
+// poll entries are allocated in blocks to keep pointers stable
+#define IO_BLOCK_SIZE   64
+
+typedef struct {
+    struct pollfd   pfd;        // must be first
+#if USE_EPOLL
+    int             regfd;      // descriptor registered with epoll, -1 if none
+    short           regevents;
+#endif
+} ioentry_t;
+
+static ioentry_t        **io_blocks;
+static int              io_numblocks;
+static int              io_numfds;      // high water mark
 
-static struct pollfd    io_entries[MAX_POLL_FDS];
-static int              io_numfds;
+static struct pollfd    *io_pollfds;    // scratch array for poll()
+
+#if USE_EPOLL
+static struct epoll_event   *io_events;
+static int              io_epfd = -1;
+static bool             io_epoll_failed;
+#endif
+
+#define IO_ENTRY(i) (&io_blocks[(i) / IO_BLOCK_SIZE][(i) % IO_BLOCK_SIZE])
 
 // current rate measurement
 static unsigned     net_rate_time;
@@ -142,6 +273,8 @@ static uint64_t     net_bytes_rcvd;
 static uint64_t     net_bytes_sent;
 static uint64_t     net_packets_rcvd;
 static uint64_t     net_packets_sent;
+static uint64_t     net_calls_rcvd;
+static uint64_t     net_calls_sent;
 
 //=============================================================================
 
@@ -514,12 +647,19 @@ static void NET_Stats_f(void)
                net_packets_sent, net_packets_sent / diff);
     Com_Printf("Packets rcvd: %"PRIu64" (%"PRIu64" packets/sec)\n",
                net_packets_rcvd, net_packets_rcvd / diff);
+    Com_Printf("Packets per syscall: %.2f/%.2f (sent/rcvd)\n",
+               net_calls_sent ? (double)net_packets_sent / net_calls_sent : 0.0,
+               net_calls_rcvd ? (double)net_packets_rcvd / net_calls_rcvd : 0.0);
 #if USE_ICMP
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64"/%"PRIu64" (send/recv/icmp)\n",
                net_send_errors, net_recv_errors, net_icmp_errors);
 #else
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64" (send/recv)\n",
                net_send_errors, net_recv_errors);
+#endif
+#if USE_RECV_THREAD
+    if (net_recv_ring)
+        Com_Printf("Receive queue overflows: %"PRIu64"\n", net_recv_ring->overflows);
 #endif
     Com_Printf("Current upload rate: %zu bytes/sec\n", net_rate_up);
     Com_Printf("Current download rate: %zu bytes/sec\n", net_rate_dn);
@@ -660,25 +800,47 @@ const char *NET_ErrorString(void)
 /*
 =============
 NET_AllocPollFd
+
+Returned entry remains valid until freed. Caller may change `events' at
+any time, changes are picked up by the next NET_Sleep call.
 =============
 */
 struct pollfd *NET_AllocPollFd(void)
 {
-    struct pollfd *e;
+    ioentry_t *e;
     int i;
 
-    for (i = 0, e = io_entries; i < io_numfds; i++, e++)
-        if (e->fd == -1)
+    for (i = 0; i < io_numfds; i++) {
+        e = IO_ENTRY(i);
+        if (e->pfd.fd == -1)
             break;
+    }
 
     if (i == io_numfds) {
-        if (io_numfds == MAX_POLL_FDS)
-            return NULL;
+        if (io_numfds == io_numblocks * IO_BLOCK_SIZE) {
+            ioentry_t *block = Z_Malloc(sizeof(*block) * IO_BLOCK_SIZE);
+
+            for (int j = 0; j < IO_BLOCK_SIZE; j++) {
+                block[j].pfd.fd = -1;
+#if USE_EPOLL
+                block[j].regfd = -1;
+#endif
+            }
+
+            io_blocks = Z_Realloc(io_blocks, sizeof(io_blocks[0]) * (io_numblocks + 1));
+            io_blocks[io_numblocks++] = block;
+
+            io_pollfds = Z_Realloc(io_pollfds, sizeof(io_pollfds[0]) * io_numblocks * IO_BLOCK_SIZE);
+#if USE_EPOLL
+            io_events = Z_Realloc(io_events, sizeof(io_events[0]) * io_numblocks * IO_BLOCK_SIZE);
+#endif
+        }
         io_numfds++;
     }
 
-    e->events = e->revents = 0;
-    return e;
+    e = IO_ENTRY(i);
+    e->pfd.events = e->pfd.revents = 0;
+    return &e->pfd;
 }
 
 /*
@@ -686,22 +848,152 @@ struct pollfd *NET_AllocPollFd(void)
 NET_FreePollFd
 =============
 */
-void NET_FreePollFd(struct pollfd *e)
+void NET_FreePollFd(struct pollfd *p)
 {
+    ioentry_t *e = (ioentry_t *)p;
     int i;
 
-    e->fd = -1;
-    e->events = e->revents = 0;
+#if USE_EPOLL
+    if (e->regfd != -1) {
+        // may fail if descriptor is already closed, this is fine
+        epoll_ctl(io_epfd, EPOLL_CTL_DEL, e->regfd, NULL);
+        e->regfd = -1;
+    }
+#endif
+
+    e->pfd.fd = -1;
+    e->pfd.events = e->pfd.revents = 0;
 
     for (i = io_numfds - 1; i >= 0; i--) {
-        e = &io_entries[i];
-        if (e->fd != -1)
+        e = IO_ENTRY(i);
+        if (e->pfd.fd != -1)
             break;
     }
 
     io_numfds = i + 1;
 }
 
+#if USE_EPOLL
+
+/*
+=============
+NET_SleepEpoll
+
+Registers changed descriptors and waits for events. Only descriptors that
+became ready are touched after the wait, kernel side cost is independent
+of total number of descriptors.
+
+Since callers may change `events' directly at any time, finding changed
+descriptors still takes a pass over all entries. It makes no system calls
+for unchanged ones. Callers also still visit each of their streams, e.g.
+NET_RunStream returns early if nothing is ready.
+=============
+*/
+static int NET_SleepEpoll(int msec)
+{
+    ioentry_t *e;
+    int i, ret;
+
+    for (i = 0; i < io_numfds; i++) {
+        struct epoll_event ev;
+        short want;
+
+        e = IO_ENTRY(i);
+        e->pfd.revents = 0;
+        if (e->pfd.fd == -1)
+            continue;
+
+        want = e->pfd.events & (POLLIN | POLLOUT);
+        if (e->regfd == e->pfd.fd && e->regevents == want)
+            continue;
+
+        ev.events = 0;
+        if (want & POLLIN)
+            ev.events |= EPOLLIN;
+        if (want & POLLOUT)
+            ev.events |= EPOLLOUT;
+        ev.data.ptr = e;
+
+        if (e->regfd == e->pfd.fd) {
+            ret = epoll_ctl(io_epfd, EPOLL_CTL_MOD, e->pfd.fd, &ev);
+        } else {
+            if (e->regfd != -1)
+                epoll_ctl(io_epfd, EPOLL_CTL_DEL, e->regfd, NULL);
+            ret = epoll_ctl(io_epfd, EPOLL_CTL_ADD, e->pfd.fd, &ev);
+        }
+
+        if (ret == -1) {
+            Com_EPrintf("%s: %s\n", __func__, strerror(errno));
+            e->regfd = -1;
+            continue;
+        }
+
+        e->regfd = e->pfd.fd;
+        e->regevents = want;
+    }
+
+    ret = epoll_wait(io_epfd, io_events, io_numblocks * IO_BLOCK_SIZE, msec);
+    if (ret == -1) {
+        net_error = errno;
+        return net_error == EINTR ? 0 : -1;
+    }
+
+    for (i = 0; i < ret; i++) {
+        const struct epoll_event *ev = &io_events[i];
+
+        e = ev->data.ptr;
+        if (ev->events & EPOLLIN)
+            e->pfd.revents |= POLLIN;
+        if (ev->events & EPOLLOUT)
+            e->pfd.revents |= POLLOUT;
+        if (ev->events & EPOLLERR)
+            e->pfd.revents |= POLLERR;
+        if (ev->events & EPOLLHUP)
+            e->pfd.revents |= POLLHUP;
+    }
+
+    return ret;
+}
+
+static bool NET_InitEpoll(void)
+{
+    if (io_epfd != -1)
+        return true;
+    if (io_epoll_failed)
+        return false;
+
+    io_epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (io_epfd == -1) {
+        Com_WPrintf("Couldn't create epoll descriptor: %s\n", strerror(errno));
+        io_epoll_failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+#endif // USE_EPOLL
+
+static int NET_SleepPoll(int msec)
+{
+    ioentry_t *e;
+    int i, ret;
+
+    for (i = 0; i < io_numfds; i++) {
+        e = IO_ENTRY(i);
+        io_pollfds[i].fd = e->pfd.fd;
+        io_pollfds[i].events = e->pfd.events;
+        io_pollfds[i].revents = 0;
+    }
+
+    ret = os_poll(io_pollfds, io_numfds, msec);
+
+    for (i = 0; i < io_numfds; i++)
+        IO_ENTRY(i)->pfd.revents = io_pollfds[i].revents;
+
+    return ret;
+}
+
 /*
 =============
 NET_Sleep
@@ -719,7 +1011,13 @@ int NET_Sleep(int msec)
         return 0;
     }
 
-    ret = os_poll(io_entries, io_numfds, msec);
+#if USE_EPOLL
+    if (NET_InitEpoll())
+        ret = NET_SleepEpoll(msec);
+    else
+#endif
+        ret = NET_SleepPoll(msec);
+
     if (ret == -1)
         Com_EPrintf("%s: %s\n", __func__, NET_ErrorString());
 
@@ -748,6 +1046,211 @@ int NET_Sleep1(int msec, struct pollfd *e)
 
 //=============================================================================
 
+#if USE_MMSG
+
+/*
+=============
+NET_GetUdpBatch
+
+Drains the socket receiving up to MAX_RECV_BATCH packets per syscall.
+Returns false on error, so that normal path can process the error queue.
+=============
+*/
+static bool NET_GetUdpBatch(struct pollfd *sock, void (*packet_cb)(void))
+{
+    recvbatch_t *b;
+    int i, ret;
+
+    if (!net_recv_batch)
+        net_recv_batch = Z_Malloc(sizeof(*net_recv_batch));
+    b = net_recv_batch;
+
+    while (1) {
+        for (i = 0; i < MAX_RECV_BATCH; i++) {
+            b->iovs[i].iov_base = b->data[i];
+            b->iovs[i].iov_len = MAX_PACKETLEN;
+            memset(&b->hdrs[i], 0, sizeof(b->hdrs[i]));
+            b->hdrs[i].msg_hdr.msg_name = &b->addrs[i];
+            b->hdrs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+            b->hdrs[i].msg_hdr.msg_iov = &b->iovs[i];
+            b->hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ret = os_udp_recv_batch(sock->fd, b->hdrs, MAX_RECV_BATCH);
+        if (ret == NET_AGAIN) {
+            sock->revents = 0;
+            return true;
+        }
+
+        if (ret == NET_ERROR)
+            return false;
+
+        net_calls_rcvd++;
+
+        for (i = 0; i < ret; i++) {
+            unsigned len = b->hdrs[i].msg_len;
+
+            NET_SockadrToNetadr(&b->addrs[i], &net_from);
+
+            NET_LogPacket(&net_from, "UDP recv", b->data[i], len);
+
+            net_rate_rcvd += len;
+            net_bytes_rcvd += len;
+            net_packets_rcvd++;
+
+            // parsers may rely on packet being in msg_read_buffer
+            memcpy(msg_read_buffer, b->data[i], len);
+            SZ_InitRead(&msg_read, msg_read_buffer, len);
+
+            (*packet_cb)();
+        }
+    }
+}
+
+static void NET_FlushSendBatch_(sendbatch_t *b)
+{
+    int i, j, n, ret;
+
+    for (i = 0; i < b->count; i = j) {
+        struct pollfd *s = b->socks[i];
+
+        // find a run of packets going to the same socket
+        for (j = i + 1; j < b->count && b->socks[j] == s; j++)
+            ;
+
+        while (i < j) {
+            n = os_udp_send_batch(s->fd, &b->hdrs[i], j - i);
+            if (n > 0) {
+                net_calls_sent++;
+            } else {
+                // send failed packet normally to process any errors
+                n = 1;
+                ret = os_udp_send(s->fd, b->data[i], b->iovs[i].iov_len, &b->to[i]);
+                if (ret == NET_ERROR) {
+                    Com_DPrintf("%s: %s to %s\n", __func__,
+                                NET_ErrorString(), NET_AdrToString(&b->to[i]));
+                    net_send_errors++;
+                }
+                if (ret < 0) {
+                    b->failed = true;
+                    i++;
+                    continue;
+                }
+                net_calls_sent++;
+                b->hdrs[i].msg_len = ret;
+            }
+
+            for (; n > 0; n--, i++) {
+                ret = b->hdrs[i].msg_len;
+                net_rate_sent += ret;
+                net_bytes_sent += ret;
+                net_packets_sent++;
+            }
+        }
+    }
+
+    b->count = 0;
+}
+
+// returns false if packet should be sent normally to report errors
+static bool NET_QueueSendBatch(struct pollfd *s, const void *data,
+                               size_t len, const netadr_t *to)
+{
+    sendbatch_t *b = net_send_batch;
+    socklen_t addrlen;
+    int i;
+
+    if (b->failed) {
+        NET_FlushSendBatch_(b);     // keep packet order
+        return false;
+    }
+
+    if (b->count == MAX_SEND_BATCH) {
+        NET_FlushSendBatch_(b);
+        if (b->failed)
+            return false;
+    }
+
+    i = b->count++;
+    memcpy(b->data[i], data, len);
+    addrlen = NET_NetadrToSockadr(to, &b->addrs[i]);
+    b->iovs[i].iov_base = b->data[i];
+    b->iovs[i].iov_len = len;
+    memset(&b->hdrs[i], 0, sizeof(b->hdrs[i]));
+    b->hdrs[i].msg_hdr.msg_name = &b->addrs[i];
+    b->hdrs[i].msg_hdr.msg_namelen = addrlen;
+    b->hdrs[i].msg_hdr.msg_iov = &b->iovs[i];
+    b->hdrs[i].msg_hdr.msg_iovlen = 1;
+    b->socks[i] = s;
+    b->to[i] = *to;
+
+    NET_LogPacket(to, "UDP send", data, len);
+
+    return true;
+}
+
+#endif // USE_MMSG
+
+/*
+=============
+NET_BeginSendBatch
+
+Starts collecting outgoing UDP packets on the given socket, to be sent
+with a single syscall by NET_FlushSendBatch. Packets are assumed to be
+sent successfully once queued. After a send fails, the rest of packets
+are sent normally so that errors are reported to callers.
+=============
+*/
+void NET_BeginSendBatch(netsrc_t sock)
+{
+#if USE_MMSG
+    if (!net_batch->integer)
+        return;
+    if (!net_send_batch)
+        net_send_batch = Z_Mallocz(sizeof(*net_send_batch));
+    if (net_send_batch->active) {
+        Com_DPrintf("%s: dropping stale batch\n", __func__);
+        NET_AbortSendBatch();
+    }
+    net_send_batch->sock = sock;
+    net_send_batch->active = true;
+    net_send_batch->failed = false;
+#endif
+}
+
+/*
+=============
+NET_AbortSendBatch
+
+Drops queued packets. Called from error handler, as packets may be going
+to clients that no longer exist.
+=============
+*/
+void NET_AbortSendBatch(void)
+{
+#if USE_MMSG
+    if (!net_send_batch)
+        return;
+    net_send_batch->count = 0;
+    net_send_batch->active = false;
+#endif
+}
+
+/*
+=============
+NET_FlushSendBatch
+=============
+*/
+void NET_FlushSendBatch(void)
+{
+#if USE_MMSG
+    if (!net_send_batch || !net_send_batch->active)
+        return;
+    NET_FlushSendBatch_(net_send_batch);
+    net_send_batch->active = false;
+#endif
+}
+
 static void NET_GetUdpPackets(struct pollfd *sock, void (*packet_cb)(void))
 {
     int ret;
@@ -760,6 +1263,11 @@ static void NET_GetUdpPackets(struct pollfd *sock, void (*packet_cb)(void))
     if (!(sock->revents & (POLLIN | POLLERR)))
         return;
 
+#if USE_MMSG
+    if (net_batch->integer && NET_GetUdpBatch(sock, packet_cb))
+        return;
+#endif
+
     while (1) {
         ret = os_udp_recv(sock->fd, msg_read_buffer, MAX_PACKETLEN, &net_from);
         if (ret == NET_AGAIN) {
@@ -779,6 +1287,7 @@ static void NET_GetUdpPackets(struct pollfd *sock, void (*packet_cb)(void))
         net_rate_rcvd += ret;
         net_bytes_rcvd += ret;
         net_packets_rcvd++;
+        net_calls_rcvd++;
 
         SZ_InitRead(&msg_read, msg_read_buffer, ret);
 
@@ -786,16 +1295,338 @@ static void NET_GetUdpPackets(struct pollfd *sock, void (*packet_cb)(void))
     }
 }
 
+#if USE_RECV_THREAD
+
+/*
+=============================================================================
+
+SERVER RECEIVE THREAD
+
+Optionally, server UDP sockets are drained by a dedicated thread as soon as
+packets arrive, so that they aren't lost when main thread is busy (e.g.
+loading a map) and their arrival time is known precisely. Socket error queue
+is also drained by receive thread, ICMP errors are queued along with packets
+and dispatched by main thread.
+
+=============================================================================
+*/
+
+static void drain_pipe(int fd)
+{
+    char buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+}
+
+static void write_pipe(int fd)
+{
+    // may fail if pipe is full, this is fine
+    (void)!write(fd, "", 1);
+}
+
+// returns false if ring is full
+static bool NET_RecvThreadErrors(recvring_t *r, int i, unsigned time)
+{
+#if USE_ICMP
+    recvslot_t *slot;
+    unsigned head;
+    int tries;
+
+    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
+        head = atomic_load(&r->head);
+        if (head - atomic_load(&r->tail) >= RECV_RING_SIZE) {
+            atomic_store(&r->full, 1);
+            return false;
+        }
+
+        slot = &r->slots[head & (RECV_RING_SIZE - 1)];
+        if (os_udp_recv_error(r->fds[i], &slot->from, &slot->ee_errno, &slot->ee_info))
+            break;
+
+        slot->sock = i;
+        slot->time = time;
+        slot->len = 0;
+        slot->error = true;
+        atomic_store(&r->head, head + 1);
+    }
+#endif
+    return true;
+}
+
+// returns false if ring is full
+static bool NET_RecvThreadSocket(recvring_t *r, int i, unsigned time)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    recvslot_t *slot;
+    unsigned head;
+    int ret, tries = 0;
+
+    while (1) {
+        head = atomic_load(&r->head);
+        if (head - atomic_load(&r->tail) >= RECV_RING_SIZE) {
+            atomic_store(&r->full, 1);
+            return false;
+        }
+
+        slot = &r->slots[head & (RECV_RING_SIZE - 1)];
+        memset(&addr, 0, sizeof(addr));
+        addrlen = sizeof(addr);
+        ret = recvfrom(r->fds[i], slot->data, MAX_PACKETLEN, 0,
+                       (struct sockaddr *)&addr, &addrlen);
+        if (ret < 0) {
+            if (errno == EWOULDBLOCK || errno == EAGAIN)
+                return true;
+            if (errno == EINTR)
+                continue;
+            atomic_fetch_add(&r->errors, 1);
+            if (!NET_RecvThreadErrors(r, i, time))
+                return false;
+            if (++tries == MAX_ERROR_RETRIES)
+                return true;
+            continue;
+        }
+
+        NET_SockadrToNetadr(&addr, &slot->from);
+        slot->sock = i;
+        slot->time = time;
+        slot->len = ret;
+        slot->error = false;
+        atomic_store(&r->head, head + 1);
+    }
+}
+
+static void *NET_RecvThread(void *arg)
+{
+    recvring_t *r = arg;
+    struct pollfd fds[3];
+    bool notify;
+    unsigned time;
+    int i;
+
+    while (!atomic_load(&r->quit)) {
+        fds[0].fd = r->wake[0];
+        fds[0].events = POLLIN;
+        for (i = 0; i < 2; i++) {
+            fds[i + 1].fd = -1;
+            fds[i + 1].events = POLLIN;
+            if (r->fds[i] != -1 && !atomic_load(&r->full))
+                fds[i + 1].fd = r->fds[i];
+        }
+
+        if (poll(fds, 3, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        time = Sys_Milliseconds();
+
+        if (fds[0].revents & POLLIN)
+            drain_pipe(r->wake[0]);
+
+        notify = false;
+        for (i = 0; i < 2; i++) {
+            if (fds[i + 1].fd == -1 || !fds[i + 1].revents)
+                continue;
+            notify = true;
+            if (fds[i + 1].revents & POLLERR && !NET_RecvThreadErrors(r, i, time))
+                break;
+            if (!NET_RecvThreadSocket(r, i, time))
+                break;
+        }
+
+        if (notify)
+            write_pipe(r->notify[1]);
+    }
+
+    return NULL;
+}
+
+static bool make_pipe(int fds[2])
+{
+    if (pipe(fds))
+        return false;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+static void close_pipe(int fds[2])
+{
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void NET_StartRecvThread(void)
+{
+    recvring_t *r;
+    struct pollfd *s;
+    int i;
+
+    if (!net_recv_thread->integer)
+        return;
+    if (net_recv_ring && net_recv_ring->running)
+        return;
+    if (!udp_sockets[NS_SERVER] && !udp6_sockets[NS_SERVER])
+        return;
+
+    if (!net_recv_ring)
+        net_recv_ring = Z_Mallocz(sizeof(*net_recv_ring));
+    r = net_recv_ring;
+
+    if (!make_pipe(r->wake)) {
+        Com_EPrintf("%s: %s\n", __func__, strerror(errno));
+        return;
+    }
+    if (!make_pipe(r->notify)) {
+        Com_EPrintf("%s: %s\n", __func__, strerror(errno));
+        close_pipe(r->wake);
+        return;
+    }
+
+    r->fds[0] = udp_sockets[NS_SERVER] ? udp_sockets[NS_SERVER]->fd : -1;
+    r->fds[1] = udp6_sockets[NS_SERVER] ? udp6_sockets[NS_SERVER]->fd : -1;
+    atomic_store(&r->head, 0);
+    atomic_store(&r->tail, 0);
+    atomic_store(&r->full, 0);
+    atomic_store(&r->errors, 0);
+    atomic_store(&r->quit, 0);
+
+    if (pthread_create(&r->thread, NULL, NET_RecvThread, r)) {
+        Com_EPrintf("Couldn't create network receive thread\n");
+        close_pipe(r->wake);
+        close_pipe(r->notify);
+        return;
+    }
+
+    // main thread is now woken up by notifications only
+    r->notify_pfd = NET_AllocPollFd();
+    r->notify_pfd->fd = r->notify[0];
+    r->notify_pfd->events = POLLIN;
+    for (i = 0; i < 2; i++) {
+        s = i ? udp6_sockets[NS_SERVER] : udp_sockets[NS_SERVER];
+        if (s)
+            s->events = 0;
+    }
+
+    r->running = true;
+    r->generation++;
+}
+
+static void NET_StopRecvThread(void)
+{
+    recvring_t *r = net_recv_ring;
+    struct pollfd *s;
+    int i;
+
+    if (!r || !r->running)
+        return;
+
+    atomic_store(&r->quit, 1);
+    write_pipe(r->wake[1]);
+    pthread_join(r->thread, NULL);
+
+    NET_FreePollFd(r->notify_pfd);
+    r->notify_pfd = NULL;
+    close_pipe(r->wake);
+    close_pipe(r->notify);
+
+    for (i = 0; i < 2; i++) {
+        s = i ? udp6_sockets[NS_SERVER] : udp_sockets[NS_SERVER];
+        if (s)
+            s->events = POLLIN;
+    }
+
+    r->running = false;
+}
+
+/*
+=============
+NET_GetQueuedPackets
+
+Processes packets and errors queued by receive thread. Returns false if
+receive thread is not running.
+=============
+*/
+static bool NET_GetQueuedPackets(void (*packet_cb)(void))
+{
+    recvring_t *r = net_recv_ring;
+    const recvslot_t *slot;
+    unsigned generation;
+    unsigned tail;
+
+    if (!r || !r->running)
+        return false;
+
+    drain_pipe(r->notify[0]);
+
+    generation = r->generation;
+    tail = atomic_load(&r->tail);
+    while (tail != atomic_load(&r->head)) {
+        slot = &r->slots[tail & (RECV_RING_SIZE - 1)];
+
+        if (slot->error) {
+#if USE_ICMP
+            NET_ErrorEvent(r->fds[slot->sock], &slot->from, slot->ee_errno, slot->ee_info);
+#endif
+        } else {
+            net_from = slot->from;
+            net_from_time = slot->time;
+
+            NET_LogPacket(&net_from, "UDP recv", slot->data, slot->len);
+
+            net_rate_rcvd += slot->len;
+            net_bytes_rcvd += slot->len;
+            net_packets_rcvd++;
+            net_calls_rcvd++;
+
+            // parsers may rely on packet being in msg_read_buffer
+            memcpy(msg_read_buffer, slot->data, slot->len);
+            SZ_InitRead(&msg_read, msg_read_buffer, slot->len);
+
+            (*packet_cb)();
+        }
+
+        // callback may have restarted networking
+        if (!r->running || r->generation != generation)
+            return true;
+
+        atomic_store(&r->tail, ++tail);
+    }
+
+    net_recv_errors += atomic_exchange(&r->errors, 0);
+
+    if (atomic_load(&r->full)) {
+        r->overflows++;
+        atomic_store(&r->full, 0);
+        write_pipe(r->wake[1]);
+    }
+
+    return true;
+}
+
+#endif // USE_RECV_THREAD
+
 /*
 =============
 NET_GetPackets
 
 Fills msg_read_buffer with packet contents,
-net_from variable receives source address.
+net_from variable receives source address,
+net_from_time receives arrival time.
 =============
 */
 void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
 {
+    PROF_BEGIN("NET_GetPackets");
+
+    net_from_time = com_eventTime;
+
 #if USE_CLIENT
     memset(&net_from, 0, sizeof(net_from));
     net_from.type = NA_LOOPBACK;
@@ -804,11 +1635,21 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
     NET_GetLoopPackets(sock, packet_cb);
 #endif
 
+#if USE_RECV_THREAD
+    // process packets queued by receive thread
+    if (sock == NS_SERVER && NET_GetQueuedPackets(packet_cb)) {
+        PROF_END();
+        return;
+    }
+#endif
+
     // process UDP packets
     NET_GetUdpPackets(udp_sockets[sock], packet_cb);
 
     // process UDP6 packets
     NET_GetUdpPackets(udp6_sockets[sock], packet_cb);
+
+    PROF_END();
 }
 
 /*
@@ -853,6 +1694,12 @@ bool NET_SendPacket(netsrc_t sock, const void *data,
     if (!s)
         return false;
 
+#if USE_MMSG
+    if (net_send_batch && net_send_batch->active && net_send_batch->sock == sock &&
+        NET_QueueSendBatch(s, data, len, to))
+        return true;
+#endif
+
     ret = os_udp_send(s->fd, data, len, to);
     if (ret == NET_AGAIN)
         return false;
@@ -873,6 +1720,7 @@ bool NET_SendPacket(netsrc_t sock, const void *data,
     net_rate_sent += ret;
     net_bytes_sent += ret;
     net_packets_sent++;
+    net_calls_sent++;
 
     return true;
 }
@@ -1227,6 +2075,9 @@ void NET_Config(netflag_t flag)
     }
 
     if (flag == NET_NONE) {
+#if USE_RECV_THREAD
+        NET_StopRecvThread();
+#endif
         // shut down any existing sockets
         for (sock = 0; sock < NS_COUNT; sock++) {
             if (udp_sockets[sock]) {
@@ -1252,6 +2103,9 @@ void NET_Config(netflag_t flag)
     if (flag & NET_SERVER) {
         NET_OpenServer();
         NET_OpenServer6();
+#if USE_RECV_THREAD
+        NET_StartRecvThread();
+#endif
     }
 
     net_active |= flag;
@@ -1855,6 +2709,15 @@ void NET_Init(void)
     net_ignore_icmp = Cvar_Get("net_ignore_icmp", "0", 0);
 #endif
 
+#if USE_MMSG
+    net_batch = Cvar_Get("net_batch", "1", 0);
+#endif
+
+#if USE_RECV_THREAD
+    net_recv_thread = Cvar_Get("net_recv_thread", "0", 0);
+    net_recv_thread->changed = net_udp_param_changed;
+#endif
+
 #if USE_DEBUG
     net_log_enable_changed(net_log_enable);
 #endif
@@ -1889,4 +2752,13 @@ void NET_Shutdown(void)
     Cmd_RemoveCommand("net_stats");
     Cmd_RemoveCommand("showip");
     Cmd_RemoveCommand("dns");
+
+#if USE_MMSG
+    Z_Freep(&net_recv_batch);
+    Z_Freep(&net_send_batch);
+#endif
+
+#if USE_RECV_THREAD
+    Z_Freep(&net_recv_ring);
+#endif
 }
@@ -25,65 +25,90 @@ static const char *os_error_string(int err)
     return strerror(err);
 }
 
-// returns true if failed socket operation should be retried.
-static bool process_error_queue(qsocket_t sock, const netadr_t *to)
-{
 #if USE_ICMP
+
+// reads one ICMP error from socket error queue. returns 0 on success, errno
+// value if queue couldn't be read, or -1 if no ICMP error was found.
+// doesn't touch any global state, may be called from receive thread.
+static int os_udp_recv_error(qsocket_t sock, netadr_t *from,
+                             int *ee_errno, int *ee_info)
+{
     byte buffer[1024];
     struct sockaddr_storage from_addr;
     struct msghdr msg;
     struct cmsghdr *cmsg;
     struct sock_extended_err *ee;
-    netadr_t from;
-    int tries;
-    bool found = false;
 
-    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
-        memset(&from_addr, 0, sizeof(from_addr));
+    memset(&from_addr, 0, sizeof(from_addr));
 
-        memset(&msg, 0, sizeof(msg));
-        msg.msg_name = &from_addr;
-        msg.msg_namelen = sizeof(from_addr);
-        msg.msg_control = buffer;
-        msg.msg_controllen = sizeof(buffer);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from_addr;
+    msg.msg_namelen = sizeof(from_addr);
+    msg.msg_control = buffer;
+    msg.msg_controllen = sizeof(buffer);
 
-        if (recvmsg(sock, &msg, MSG_ERRQUEUE) == -1) {
-            if (errno != EWOULDBLOCK)
-                Com_DPrintf("%s: %s\n", __func__, strerror(errno));
-            break;
-        }
+    if (recvmsg(sock, &msg, MSG_ERRQUEUE) == -1)
+        return errno;
+
+    if (!(msg.msg_flags & MSG_ERRQUEUE))
+        return -1;
 
-        if (!(msg.msg_flags & MSG_ERRQUEUE)) {
-            Com_DPrintf("%s: no extended error received\n", __func__);
+    // find an ICMP error message
+    for (cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != IPPROTO_IP &&
+            cmsg->cmsg_level != IPPROTO_IPV6) {
+            continue;
+        }
+        if (cmsg->cmsg_type != IP_RECVERR &&
+            cmsg->cmsg_type != IPV6_RECVERR) {
+            continue;
+        }
+        ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
+        if (ee->ee_origin == SO_EE_ORIGIN_ICMP ||
+            ee->ee_origin == SO_EE_ORIGIN_ICMP6) {
             break;
         }
+    }
 
-        // find an ICMP error message
-        for (cmsg = CMSG_FIRSTHDR(&msg);
-             cmsg != NULL;
-             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-            if (cmsg->cmsg_level != IPPROTO_IP &&
-                cmsg->cmsg_level != IPPROTO_IPV6) {
-                continue;
-            }
-            if (cmsg->cmsg_type != IP_RECVERR &&
-                cmsg->cmsg_type != IPV6_RECVERR) {
-                continue;
-            }
-            ee = (struct sock_extended_err *)CMSG_DATA(cmsg);
-            if (ee->ee_origin == SO_EE_ORIGIN_ICMP ||
-                ee->ee_origin == SO_EE_ORIGIN_ICMP6) {
-                break;
-            }
-        }
+    if (!cmsg)
+        return -1;
+
+    NET_SockadrToNetadr(&from_addr, from);
+    *ee_errno = ee->ee_errno;
+    *ee_info = ee->ee_info;
+    return 0;
+}
+
+#endif // USE_ICMP
+
+// returns true if failed socket operation should be retried.
+static bool process_error_queue(qsocket_t sock, const netadr_t *to)
+{
+#if USE_RECV_THREAD
+    // error queue is drained by receive thread, just retry
+    if (NET_RecvThreadOwnsSocket(sock))
+        return true;
+#endif
 
-        if (!cmsg) {
+#if USE_ICMP
+    netadr_t from;
+    int tries, ret, ee_errno, ee_info;
+    bool found = false;
+
+    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
+        ret = os_udp_recv_error(sock, &from, &ee_errno, &ee_info);
+        if (ret > 0) {
+            if (ret != EWOULDBLOCK)
+                Com_DPrintf("%s: %s\n", __func__, strerror(ret));
+            break;
+        }
+        if (ret < 0) {
             Com_DPrintf("%s: no ICMP error found\n", __func__);
             break;
         }
 
-        NET_SockadrToNetadr(&from_addr, &from);
-
         // check for offender address being current packet destination
         if (to != NULL && NET_IsEqualBaseAdr(&from, to) &&
             (from.port == 0 || from.port == to->port)) {
@@ -93,7 +118,7 @@ static bool process_error_queue(qsocket_t sock, const netadr_t *to)
         }
 
         // handle ICMP error
-        NET_ErrorEvent(sock, &from, ee->ee_errno, ee->ee_info);
+        NET_ErrorEvent(sock, &from, ee_errno, ee_info);
     }
 
     return tries && !found;
@@ -163,6 +188,34 @@ static int os_udp_send(qsocket_t sock, const void *data,
     return NET_ERROR;
 }
 
+#if USE_MMSG
+
+static int os_udp_recv_batch(qsocket_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret = recvmmsg(sock, msgs, count, 0, NULL);
+
+    if (ret >= 0)
+        return ret;
+
+    net_error = errno;
+
+    // wouldblock is silent
+    if (net_error == EWOULDBLOCK)
+        return NET_AGAIN;
+
+    return NET_ERROR;
+}
+
+// returns number of packets sent, or 0 on error
+static int os_udp_send_batch(qsocket_t sock, struct mmsghdr *msgs, int count)
+{
+    int ret = sendmmsg(sock, msgs, count, 0);
+
+    return max(ret, 0);
+}
+
+#endif // USE_MMSG
+
 static neterr_t os_get_error(void)
 {
     net_error = errno;
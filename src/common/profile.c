@@ -0,0 +1,290 @@
+/*
+Copyright (C) 2026 Q2PRO contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// profile.c -- zone profiler
+//
+// Each thread that records a zone claims its own ring buffer, so recording is
+// lock free. Rings are only ever written by their owning thread and read by
+// the main thread when dumping, with capture paused.
+//
+
+#include "shared/shared.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/cvar.h"
+#include "common/files.h"
+#include "common/profile.h"
+#include "common/zone.h"
+#include "system/pthread.h"
+#include "system/system.h"
+
+#define MAX_PROF_THREADS    32
+#define MAX_PROF_DEPTH      32
+#define PROF_EVENTS         16384   // per thread, must be power of two
+
+// events that may still be written by threads that were inside a zone when
+// capture was paused
+#define PROF_SLACK          16
+
+typedef struct {
+    const char  *name;
+    uint64_t    start;
+    uint32_t    duration;
+} profevent_t;
+
+typedef struct {
+    profevent_t *events;
+    atomic_int  head;       // written by owning thread
+    unsigned    tail;       // written by main thread
+    bool        mainthread;
+} profring_t;
+
+typedef struct {
+    const char  *name;
+    uint64_t    start;
+} profzone_t;
+
+atomic_int              com_profiling;
+q_thread_local int      com_profdepth;
+
+static q_thread_local profzone_t    prof_stack[MAX_PROF_DEPTH];
+static q_thread_local profring_t    *prof_ring;
+static q_thread_local bool          prof_mainthread;
+
+static profring_t       prof_rings[MAX_PROF_THREADS];
+static profring_t       prof_nullring;  // for threads that didn't get one
+static int              prof_numrings;
+static pthread_mutex_t  prof_lock;
+static uint64_t         prof_basetime;
+
+static cvar_t           *com_profile;
+
+static profring_t *claim_ring(void)
+{
+    profring_t *ring = &prof_nullring;
+
+    pthread_mutex_lock(&prof_lock);
+    if (prof_numrings < MAX_PROF_THREADS) {
+        ring = &prof_rings[prof_numrings++];
+        ring->mainthread = prof_mainthread;
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    return ring;
+}
+
+/*
+==================
+Com_ProfileBegin
+
+Enters a new zone. Zones nested too deep are not recorded.
+==================
+*/
+void Com_ProfileBegin(const char *name)
+{
+    if (com_profdepth < MAX_PROF_DEPTH) {
+        profzone_t *zone = &prof_stack[com_profdepth];
+        zone->name = name;
+        zone->start = Sys_Microseconds();
+    }
+    com_profdepth++;
+}
+
+/*
+==================
+Com_ProfileEnd
+
+Leaves current zone and records it into ring buffer of this thread.
+==================
+*/
+void Com_ProfileEnd(void)
+{
+    const profzone_t *zone;
+    profevent_t *ev;
+    profring_t *ring;
+    unsigned head;
+
+    if (--com_profdepth >= MAX_PROF_DEPTH)
+        return;
+
+    if (!atomic_load(&com_profiling))
+        return;
+
+    if (!prof_ring)
+        prof_ring = claim_ring();
+
+    ring = prof_ring;
+    if (!ring->events)
+        return;
+
+    zone = &prof_stack[com_profdepth];
+    head = atomic_load(&ring->head);
+    ev = &ring->events[head & (PROF_EVENTS - 1)];
+    ev->name = zone->name;
+    ev->start = zone->start;
+    ev->duration = Sys_Microseconds() - zone->start;
+    atomic_store(&ring->head, head + 1);
+}
+
+/*
+==================
+Com_ProfileUnwind
+
+Called after longjmp() to discard zones left open by current thread.
+==================
+*/
+void Com_ProfileUnwind(void)
+{
+    com_profdepth = 0;
+}
+
+/*
+==================
+Com_ProfileClear
+
+Discards all recorded events. Called when zone names may become invalid,
+e.g. when game library is unloaded.
+==================
+*/
+void Com_ProfileClear(void)
+{
+    int i, numrings;
+
+    pthread_mutex_lock(&prof_lock);
+    numrings = prof_numrings;
+    pthread_mutex_unlock(&prof_lock);
+
+    for (i = 0; i < numrings; i++)
+        prof_rings[i].tail = atomic_load(&prof_rings[i].head);
+}
+
+static void write_name(qhandle_t f, const char *name)
+{
+    char buffer[MAX_QPATH * 2];
+    size_t len = 0;
+
+    if (!name)
+        name = "?";
+
+    for (; *name && len < sizeof(buffer) - 2; name++) {
+        int c = *name & 255;
+        if (c < 32 || c > 126)
+            continue;
+        if (c == '"' || c == '\\')
+            buffer[len++] = '\\';
+        buffer[len++] = c;
+    }
+
+    FS_Write(buffer, len, f);
+}
+
+static void Com_ProfileDump_f(void)
+{
+    char buffer[MAX_OSPATH];
+    int i, numrings, active, count;
+    qhandle_t f;
+
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    pthread_mutex_lock(&prof_lock);
+    numrings = prof_numrings;
+    pthread_mutex_unlock(&prof_lock);
+
+    if (!numrings) {
+        Com_Printf("No profile data recorded. Set com_profile to 1 first.\n");
+        return;
+    }
+
+    f = FS_EasyOpenFile(buffer, sizeof(buffer), FS_MODE_WRITE | FS_FLAG_TEXT,
+                        "profiles/", Cmd_Argv(1), ".json");
+    if (!f)
+        return;
+
+    // pause capture while reading ring buffers
+    active = atomic_load(&com_profiling);
+    atomic_store(&com_profiling, 0);
+
+    FS_FPrintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+               "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+               "\"args\":{\"name\":\"" APPLICATION "\"}}");
+
+    count = 0;
+    for (i = 0; i < numrings; i++) {
+        profring_t *ring = &prof_rings[i];
+        unsigned head = atomic_load(&ring->head);
+        unsigned tail = ring->tail;
+
+        if (head - tail > PROF_EVENTS - PROF_SLACK)
+            tail = head - (PROF_EVENTS - PROF_SLACK);
+
+        FS_FPrintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":\"%s\"}}", i,
+                   ring->mainthread ? "main" : va("thread %d", i));
+
+        for (; tail != head; tail++) {
+            const profevent_t *ev = &ring->events[tail & (PROF_EVENTS - 1)];
+
+            FS_FPrintf(f, ",\n{\"name\":\"");
+            write_name(f, ev->name);
+            FS_FPrintf(f, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                       "\"ts\":%"PRIu64",\"dur\":%u}", i,
+                       ev->start - prof_basetime, ev->duration);
+            count++;
+        }
+    }
+
+    FS_FPrintf(f, "\n]}\n");
+
+    atomic_store(&com_profiling, active);
+
+    if (FS_CloseFile(f))
+        Com_EPrintf("Error writing %s\n", buffer);
+    else
+        Com_Printf("Dumped %d events to %s.\n", count, buffer);
+}
+
+static void com_profile_changed(cvar_t *self)
+{
+    int i;
+
+    // ring buffers are allocated once and never freed, since other threads
+    // may still be writing into them after capture is disabled
+    if (self->integer && !prof_rings[0].events) {
+        for (i = 0; i < MAX_PROF_THREADS; i++)
+            prof_rings[i].events = Z_Malloc(sizeof(profevent_t) * PROF_EVENTS);
+        prof_basetime = Sys_Microseconds();
+    }
+
+    atomic_store(&com_profiling, !!self->integer);
+}
+
+void Com_InitProfiler(void)
+{
+    prof_mainthread = true;
+    pthread_mutex_init(&prof_lock, NULL);
+
+    com_profile = Cvar_Get("com_profile", "0", 0);
+    com_profile->changed = com_profile_changed;
+    com_profile_changed(com_profile);
+
+    Cmd_AddCommand("profiledump", Com_ProfileDump_f);
+}
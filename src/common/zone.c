@@ -20,14 +20,22 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/list.h"
 #include "common/common.h"
 #include "common/zone.h"
+#include "system/pthread.h"
 
 #define Z_MAGIC     0x1d0d
 
-typedef struct {
+typedef struct zslab_s zslab_t;
+
+typedef struct zhead_s {
     uint16_t        magic;
     uint16_t        tag;        // for group free
+    uint8_t         cls;        // size class + 1, or 0 if allocated with malloc
     size_t          size;
-    list_t          entry;
+    union {
+        list_t          entry;  // in ztag_t blocks list
+        zslab_t         *slab;  // slab this block belongs to
+        struct zhead_s  *next;  // next free block in slab
+    };
 } zhead_t;
 
 typedef struct {
@@ -40,8 +48,44 @@ typedef struct {
     size_t      bytes;
 } zstats_t;
 
-static list_t       z_chain;
-static zstats_t     z_stats[TAG_MAX];
+// small blocks are carved from per-tag slabs of fixed size classes, so that
+// all of them can be released at once by Z_FreeTags
+#define Z_SLAB_SIZE     0x4000
+#define Z_NUM_CLASSES   6
+#define Z_MIN_CLASS     64      // including header
+#define Z_MAX_SLABS     16      // empty slabs kept for reuse
+
+#define Z_CLASS_SIZE(c) (Z_MIN_CLASS << (c))
+
+typedef struct ztag_s ztag_t;
+
+struct zslab_s {
+    list_t          entry;      // in ztag_t slabs list
+    ztag_t          *tag;
+    zhead_t         *free;      // free blocks
+    size_t          carved;     // offset of first never used block
+    int             used;       // number of allocated blocks
+    int             cls;
+};
+
+#define Z_SLAB_DATA     ((sizeof(zslab_t) + 63) & ~63)
+
+struct ztag_s {
+    ztag_t          *next;      // hash chain
+    uint16_t        tag;
+    zstats_t        stats;
+    list_t          blocks;                 // blocks allocated with malloc
+    list_t          partial[Z_NUM_CLASSES]; // slabs with free blocks
+    list_t          full[Z_NUM_CLASSES];    // slabs with no free blocks
+};
+
+#define Z_TAG_HASH      64
+
+static pthread_mutex_t  z_lock = PTHREAD_MUTEX_INITIALIZER;
+static ztag_t           *z_tags[Z_TAG_HASH];
+static zstats_t         z_stats[TAG_MAX];
+static zslab_t          *z_slabs[Z_MAX_SLABS];
+static int              z_numslabs, z_totalslabs;
 
 #define S(d) \
     { .z = { .magic = Z_MAGIC, .tag = TAG_STATIC, .size = sizeof(zstatic_t) }, .data = d }
@@ -69,35 +113,169 @@ static const char *const z_tagnames[TAG_MAX] = {
 
 #define TAG_INDEX(tag)  ((tag) < TAG_MAX ? (tag) : TAG_FREE)
 
-static inline void Z_CountFree(const zhead_t *z)
+// Com_Error may free memory, so drop the lock first
+q_noreturn
+static void Z_AllocFailed(const char *func, size_t size)
+{
+    pthread_mutex_unlock(&z_lock);
+    Com_Error(ERR_FATAL, "%s: couldn't allocate %zu bytes", func, size);
+}
+
+// called with lock held
+static ztag_t *Z_FindTag(unsigned tag, bool create)
+{
+    ztag_t *t;
+    int i;
+
+    for (t = z_tags[tag & (Z_TAG_HASH - 1)]; t; t = t->next)
+        if (t->tag == tag)
+            return t;
+
+    if (!create)
+        return NULL;
+
+    t = malloc(sizeof(*t));
+    if (!t)
+        Z_AllocFailed(__func__, sizeof(*t));
+
+    t->tag = tag;
+    t->stats.count = t->stats.bytes = 0;
+    List_Init(&t->blocks);
+    for (i = 0; i < Z_NUM_CLASSES; i++) {
+        List_Init(&t->partial[i]);
+        List_Init(&t->full[i]);
+    }
+
+    t->next = z_tags[tag & (Z_TAG_HASH - 1)];
+    z_tags[tag & (Z_TAG_HASH - 1)] = t;
+    return t;
+}
+
+static inline void Z_CountFree(ztag_t *t, const zhead_t *z)
 {
     zstats_t *s = &z_stats[TAG_INDEX(z->tag)];
     s->count--;
     s->bytes -= z->size;
+    if (t) {
+        t->stats.count--;
+        t->stats.bytes -= z->size;
+    }
 }
 
-static inline void Z_CountAlloc(const zhead_t *z)
+static inline void Z_CountAlloc(ztag_t *t, const zhead_t *z)
 {
     zstats_t *s = &z_stats[TAG_INDEX(z->tag)];
     s->count++;
     s->bytes += z->size;
+    if (t) {
+        t->stats.count++;
+        t->stats.bytes += z->size;
+    }
 }
 
 #define Z_Validate(z) \
     Q_assert((z)->magic == Z_MAGIC && (z)->tag != TAG_FREE)
 
-void Z_LeakTest(memtag_t tag)
+static zslab_t *Z_AllocSlab(ztag_t *t, int cls)
 {
+    zslab_t *slab;
+
+    if (z_numslabs) {
+        slab = z_slabs[--z_numslabs];
+    } else {
+        slab = malloc(Z_SLAB_SIZE);
+        if (!slab)
+            Z_AllocFailed(__func__, Z_SLAB_SIZE);
+        z_totalslabs++;
+    }
+
+    slab->tag = t;
+    slab->free = NULL;
+    slab->carved = Z_SLAB_DATA;
+    slab->used = 0;
+    slab->cls = cls;
+    List_Insert(&t->partial[cls], &slab->entry);
+    return slab;
+}
+
+static void Z_ReleaseSlab(zslab_t *slab)
+{
+    if (z_numslabs < Z_MAX_SLABS) {
+        z_slabs[z_numslabs++] = slab;
+    } else {
+        free(slab);
+        z_totalslabs--;
+    }
+}
+
+// returns block with header partially filled in
+static zhead_t *Z_SlabAlloc(ztag_t *t, size_t size)
+{
+    zslab_t *slab;
     zhead_t *z;
+    int cls;
+
+    for (cls = 0; Z_CLASS_SIZE(cls) < size; cls++)
+        ;
+
+    if (LIST_EMPTY(&t->partial[cls]))
+        slab = Z_AllocSlab(t, cls);
+    else
+        slab = LIST_FIRST(zslab_t, &t->partial[cls], entry);
+
+    if (slab->free) {
+        z = slab->free;
+        slab->free = z->next;
+    } else {
+        z = (zhead_t *)((byte *)slab + slab->carved);
+        slab->carved += Z_CLASS_SIZE(cls);
+    }
+
+    slab->used++;
+    if (!slab->free && slab->carved + Z_CLASS_SIZE(cls) > Z_SLAB_SIZE) {
+        List_Remove(&slab->entry);
+        List_Insert(&t->full[cls], &slab->entry);
+    }
+
+    z->cls = cls + 1;
+    z->slab = slab;
+    return z;
+}
+
+static void Z_SlabFree(zhead_t *z)
+{
+    zslab_t *slab = z->slab;
+    ztag_t *t = slab->tag;
+    bool full = !slab->free && slab->carved + Z_CLASS_SIZE(slab->cls) > Z_SLAB_SIZE;
+
+    z->next = slab->free;
+    slab->free = z;
+
+    if (--slab->used == 0) {
+        List_Remove(&slab->entry);
+        Z_ReleaseSlab(slab);
+    } else if (full) {
+        List_Remove(&slab->entry);
+        List_Insert(&t->partial[slab->cls], &slab->entry);
+    }
+}
+
+void Z_LeakTest(memtag_t tag)
+{
     size_t numLeaks = 0, numBytes = 0;
+    ztag_t *t;
+    int i;
 
-    LIST_FOR_EACH(zhead_t, z, &z_chain, entry) {
-        Z_Validate(z);
-        if (z->tag == tag || (tag == TAG_FREE && z->tag >= TAG_MAX)) {
-            numLeaks++;
-            numBytes += z->size;
+    pthread_mutex_lock(&z_lock);
+    for (i = 0; i < Z_TAG_HASH; i++) {
+        for (t = z_tags[i]; t; t = t->next) {
+            if (t->tag == tag || (tag == TAG_FREE && t->tag >= TAG_MAX)) {
+                numLeaks += t->stats.count;
+                numBytes += t->stats.bytes;
+            }
         }
     }
+    pthread_mutex_unlock(&z_lock);
 
     if (numLeaks) {
         Com_WPrintf("************* Z_LeakTest *************\n"
@@ -108,6 +286,29 @@ void Z_LeakTest(memtag_t tag)
     }
 }
 
+// called with lock held
+static void Z_FreeBlock(zhead_t *z)
+{
+    if (z->tag == TAG_STATIC) {
+        Z_CountFree(NULL, z);
+        return;
+    }
+
+    if (z->cls) {
+        Z_CountFree(z->slab->tag, z);
+        z->magic = 0xdead;
+        z->tag = TAG_FREE;
+        Z_SlabFree(z);
+        return;
+    }
+
+    Z_CountFree(Z_FindTag(z->tag, false), z);
+    List_Remove(&z->entry);
+    z->magic = 0xdead;
+    z->tag = TAG_FREE;
+    free(z);
+}
+
 /*
 ========================
 Z_Free
@@ -125,14 +326,9 @@ void Z_Free(void *ptr)
 
     Z_Validate(z);
 
-    Z_CountFree(z);
-
-    if (z->tag != TAG_STATIC) {
-        List_Remove(&z->entry);
-        z->magic = 0xdead;
-        z->tag = TAG_FREE;
-        free(z);
-    }
+    pthread_mutex_lock(&z_lock);
+    Z_FreeBlock(z);
+    pthread_mutex_unlock(&z_lock);
 }
 
 /*
@@ -159,6 +355,8 @@ Z_Realloc
 void *Z_Realloc(void *ptr, size_t size)
 {
     zhead_t *z;
+    ztag_t *t;
+    void *data;
 
     if (!ptr) {
         return Z_Malloc(size);
@@ -182,17 +380,41 @@ void *Z_Realloc(void *ptr, size_t size)
 
     Q_assert(z->tag != TAG_STATIC);
 
-    Z_CountFree(z);
+    if (z->cls) {
+        // stays in the same size class?
+        if (size <= Z_CLASS_SIZE(z->cls - 1) && (z->cls == 1 || size > Z_CLASS_SIZE(z->cls - 2))) {
+            pthread_mutex_lock(&z_lock);
+            t = z->slab->tag;
+            Z_CountFree(t, z);
+            z->size = size;
+            Z_CountAlloc(t, z);
+            pthread_mutex_unlock(&z_lock);
+            return z + 1;
+        }
+
+        data = Z_TagMalloc(size - sizeof(*z), z->tag);
+        memcpy(data, z + 1, min(size, z->size) - sizeof(*z));
+        Z_Free(z + 1);
+        return data;
+    }
+
+    pthread_mutex_lock(&z_lock);
+    t = Z_FindTag(z->tag, false);
+    Z_CountFree(t, z);
+    List_Remove(&z->entry);
+    pthread_mutex_unlock(&z_lock);
 
     z = realloc(z, size);
     if (!z) {
         Com_Error(ERR_FATAL, "%s: couldn't realloc %zu bytes", __func__, size);
     }
 
+    pthread_mutex_lock(&z_lock);
     z->size = size;
-    List_Relink(&z->entry);
+    List_Insert(&t->blocks, &z->entry);
 
-    Z_CountAlloc(z);
+    Z_CountAlloc(t, z);
+    pthread_mutex_unlock(&z_lock);
 
     return z + 1;
 }
@@ -231,23 +453,51 @@ void Z_Stats_f(void)
     Com_Printf("--------- ------ -------\n"
                "%9zu %6zu total\n",
                bytes, count);
+
+    Com_Printf("%d slabs of %d bytes, %d unused\n",
+               z_totalslabs, Z_SLAB_SIZE, z_numslabs);
 }
 
 /*
 ========================
 Z_FreeTags
+
+Releases slabs of the tag as a whole and only walks blocks of the tag
+that were too large for a slab.
 ========================
 */
 void Z_FreeTags(memtag_t tag)
 {
+    zslab_t *slab, *next;
     zhead_t *z, *n;
+    ztag_t *t;
+    int i;
 
-    LIST_FOR_EACH_SAFE(zhead_t, z, n, &z_chain, entry) {
-        Z_Validate(z);
-        if (z->tag == tag) {
-            Z_Free(z + 1);
-        }
+    pthread_mutex_lock(&z_lock);
+
+    t = Z_FindTag(tag, false);
+    if (!t || !t->stats.count) {
+        pthread_mutex_unlock(&z_lock);
+        return;
     }
+
+    LIST_FOR_EACH_SAFE(zhead_t, z, n, &t->blocks, entry)
+        Z_FreeBlock(z);
+
+    for (i = 0; i < Z_NUM_CLASSES; i++) {
+        LIST_FOR_EACH_SAFE(zslab_t, slab, next, &t->partial[i], entry)
+            Z_ReleaseSlab(slab);
+        LIST_FOR_EACH_SAFE(zslab_t, slab, next, &t->full[i], entry)
+            Z_ReleaseSlab(slab);
+        List_Init(&t->partial[i]);
+        List_Init(&t->full[i]);
+    }
+
+    z_stats[TAG_INDEX(tag)].count -= t->stats.count;
+    z_stats[TAG_INDEX(tag)].bytes -= t->stats.bytes;
+    t->stats.count = t->stats.bytes = 0;
+
+    pthread_mutex_unlock(&z_lock);
 }
 
 /*
@@ -258,6 +508,7 @@ Z_TagMalloc
 static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
 {
     zhead_t *z;
+    ztag_t *t;
 
     if (!size) {
         return NULL;
@@ -267,15 +518,31 @@ static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
     Q_assert(tag > TAG_FREE && tag <= UINT16_MAX);
 
     size += sizeof(*z);
-    z = init ? calloc(1, size) : malloc(size);
-    if (!z) {
-        Com_Error(ERR_FATAL, "%s: couldn't allocate %zu bytes", __func__, size);
+
+    if (size > Z_CLASS_SIZE(Z_NUM_CLASSES - 1)) {
+        z = init ? calloc(1, size) : malloc(size);
+        if (!z) {
+            Com_Error(ERR_FATAL, "%s: couldn't allocate %zu bytes", __func__, size);
+        }
+        z->cls = 0;
+        pthread_mutex_lock(&z_lock);
+        t = Z_FindTag(tag, true);
+        List_Insert(&t->blocks, &z->entry);
+    } else {
+        pthread_mutex_lock(&z_lock);
+        t = Z_FindTag(tag, true);
+        z = Z_SlabAlloc(t, size);
     }
     z->magic = Z_MAGIC;
     z->tag = tag;
     z->size = size;
 
-    List_Insert(&z_chain, &z->entry);
+    Z_CountAlloc(t, z);
+    pthread_mutex_unlock(&z_lock);
+
+    if (init && z->cls) {
+        memset(z + 1, 0, size - sizeof(*z));
+    }
 
 #if USE_TESTS
     if (!init && z_perturb && z_perturb->integer) {
@@ -283,8 +550,6 @@ static void *Z_TagMallocInternal(size_t size, memtag_t tag, bool init)
     }
 #endif
 
-    Z_CountAlloc(z);
-
     return z + 1;
 }
 
@@ -308,16 +573,6 @@ void *Z_Mallocz(size_t size)
     return Z_TagMallocz(size, TAG_GENERAL);
 }
 
-/*
-========================
-Z_Init
-========================
-*/
-void Z_Init(void)
-{
-    List_Init(&z_chain);
-}
-
 /*
 ================
 Z_TagCopyString
@@ -359,6 +614,8 @@ char *Z_CvarCopyString(const char *in)
 
     // return static storage
     z = &z_static[i];
-    Z_CountAlloc(&z->z);
+    pthread_mutex_lock(&z_lock);
+    Z_CountAlloc(NULL, &z->z);
+    pthread_mutex_unlock(&z_lock);
     return (char *)z->data;
 }
@@ -421,7 +421,7 @@ void Draw_Stats(void)
     int x = 10, y = 10;
 
     R_SetScale(1.0f / get_auto_scale());
-    R_DrawFill8(8, 8, 25*8, 24*10+2, 4);
+    R_DrawFill8(8, 8, 25*8, 28*10+2, 4);
 
     Draw_Stringf(x, y, "Nodes visible  : %i", glr.nodes_visible); y += 10;
     Draw_Stringf(x, y, "Nodes culled   : %i", c.nodesCulled); y += 10;
@@ -437,6 +437,8 @@ void Draw_Stats(void)
     Draw_Stringf(x, y, "Tex switches   : %i", c.texSwitches); y += 10;
     Draw_Stringf(x, y, "Tex uploads    : %i", c.texUploads); y += 10;
     Draw_Stringf(x, y, "LM texels      : %i", c.lightTexels); y += 10;
+    Draw_Stringf(x, y, "LM rebuilt     : %i", c.lightmapsRebuilt); y += 10;
+    Draw_Stringf(x, y, "LM cached      : %i", c.lightmapsCached); y += 10;
     Draw_Stringf(x, y, "Batches drawn  : %i", c.batchesDrawn); y += 10;
     Draw_Stringf(x, y, "Faces / batch  : %.1f", c.batchesDrawn ? (float)c.facesDrawn / c.batchesDrawn : 0.0f); y += 10;
     Draw_Stringf(x, y, "Tris / batch   : %.1f", c.batchesDrawn ? (float)c.facesTris / c.batchesDrawn : 0.0f); y += 10;
@@ -447,6 +449,8 @@ void Draw_Stats(void)
     Draw_Stringf(x, y, "Uniform uploads: %i", c.uniformUploads); y += 10;
     Draw_Stringf(x, y, "Array binds    : %i", c.vertexArrayBinds); y += 10;
     Draw_Stringf(x, y, "Occl. queries  : %i", c.occlusionQueries); y += 10;
+    Draw_Stringf(x, y, "Skel. lerped   : %i", c.skeletonsLerped); y += 10;
+    Draw_Stringf(x, y, "Skel. cached   : %i", c.skeletonsCached); y += 10;
 
     R_SetScale(1.0f);
 }
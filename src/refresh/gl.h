@@ -27,6 +27,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/hash_map.h"
 #include "common/intreadwrite.h"
 #include "common/math.h"
+#include "common/profile.h"
 #include "client/video.h"
 #include "client/client.h"
 #include "refresh/refresh.h"
@@ -87,12 +88,16 @@ typedef struct {
     bool visible;
 } glquery_t;
 
+struct dlightrow_s;
+
 typedef struct {
     bool            registering;
     bool            use_shaders;
     bool            use_cubemaps;
     bool            use_bmodel_skies;
     bool            use_gpu_lerp;
+    const struct meshlerpkernels_s  *lerpkernels;
+    int             (*dlightrow)(float *, int, const struct dlightrow_s *);
     struct {
         bsp_t       *cache;
         vec_t       *vertices;
@@ -228,6 +233,10 @@ typedef struct {
     int uniformUploads;
     int vertexArrayBinds;
     int occlusionQueries;
+    int skeletonsLerped;
+    int skeletonsCached;
+    int lightmapsRebuilt;
+    int lightmapsCached;
 } statCounters_t;
 
 extern statCounters_t c;
@@ -485,9 +494,16 @@ qhandle_t R_RegisterModel(const char *name);
 #define LM_MAX_LIGHTMAPS    128
 #define LM_MAX_BLOCK_WIDTH  (1 << 10)
 
-typedef struct lightmap_s {
+#define LM_MAX_DIRTY_RECTS  8
+
+typedef struct {
     uint16_t    mins[2];
     uint16_t    maxs[2];
+} lmrect_t;
+
+typedef struct lightmap_s {
+    int         numdirty;
+    lmrect_t    dirty[LM_MAX_DIRTY_RECTS];
     byte        *buffer;
 } lightmap_t;
 
@@ -960,6 +976,63 @@ void R_SetSky(const char *name, float rotate, bool autorotate, const vec3_t axis
  */
 void GL_DrawAliasModel(const model_t *model);
 
+#if USE_MD5
+void GL_InitSkinThreads(void);
+void GL_ShutdownSkinThreads(void);
+#endif
+
+#if USE_TESTS
+void GL_LerpBench_f(void);
+#endif
+
+/*
+ * simd.c
+ *
+ */
+typedef struct {
+    vec3_t      oldscale;
+    vec3_t      newscale;
+    vec3_t      translate;
+    vec3_t      shadedir;
+    vec4_t      color;
+    float       backlerp;
+    float       frontlerp;
+    float       shellscale;
+} meshlerp_t;
+
+// Kernels process vertices in groups and return number of vertices
+// processed, the rest is left for scalar code.
+typedef int (*meshlerpfunc_t)(vec_t *dst, const maliasvert_t *oldvert,
+                              const maliasvert_t *newvert, int count, const meshlerp_t *p);
+
+typedef struct meshlerpkernels_s {
+    const char      *name;
+    int             level;
+    bool            (*supported)(void);
+    meshlerpfunc_t  shell;
+    meshlerpfunc_t  shade;
+    meshlerpfunc_t  plain;
+} meshlerpkernels_t;
+
+extern const meshlerpkernels_t gl_lerpkernels[];
+
+// parameters of dynamic light for a single row of blocklights
+typedef struct dlightrow_s {
+    float       local;      // light position along the row
+    float       scale;
+    float       td;         // scaled distance along lightmap t axis
+    float       rad;
+    float       minlight;
+    float       falloff;
+    vec3_t      color;
+} dlightrow_t;
+
+// Accumulates light into row of RGB blocklights and returns number of texels
+// processed, the rest is left for scalar code.
+typedef int (*dlightrowfunc_t)(float *bl, int count, const dlightrow_t *p);
+
+void GL_InitSimd(void);
+
 /*
  * hq2x.c
  *
@@ -1315,6 +1315,7 @@ static void make_screenshot(const char *name, const char *ext,
             .work_cb = screenshot_work_cb,
             .done_cb = screenshot_done_cb,
             .cb_arg = Z_CopyStruct(&s),
+            .priority = ASYNC_PRIO_LOW,
         };
         Com_QueueAsyncWork(&work);
     } else {
@@ -2069,6 +2070,25 @@ image_t *IMG_ForHandle(qhandle_t h)
 R_RegisterImage
 ===============
 */
+static size_t image_path(char *fullname, const char *name, imagetype_t type)
+{
+    size_t len;
+
+    if (type == IT_SKIN || type == IT_SPRITE) {
+        len = FS_NormalizePathBuffer(fullname, name, MAX_QPATH);
+    } else if (*name == '/' || *name == '\\') {
+        len = FS_NormalizePathBuffer(fullname, name + 1, MAX_QPATH);
+    } else {
+        len = Q_concat(fullname, MAX_QPATH, "pics/", name);
+        if (len < MAX_QPATH) {
+            FS_NormalizePath(fullname);
+            len = COM_DefaultExtension(fullname, ".pcx", MAX_QPATH);
+        }
+    }
+
+    return len;
+}
+
 qhandle_t R_RegisterImage(const char *name, imagetype_t type, imageflags_t flags)
 {
     image_t     *image;
@@ -2085,18 +2105,7 @@ qhandle_t R_RegisterImage(const char *name, imagetype_t type, imageflags_t flags
     if (!r_numImages)
         return 0;
 
-    if (type == IT_SKIN || type == IT_SPRITE) {
-        len = FS_NormalizePathBuffer(fullname, name, sizeof(fullname));
-    } else if (*name == '/' || *name == '\\') {
-        len = FS_NormalizePathBuffer(fullname, name + 1, sizeof(fullname));
-    } else {
-        len = Q_concat(fullname, sizeof(fullname), "pics/", name);
-        if (len < sizeof(fullname)) {
-            FS_NormalizePath(fullname);
-            len = COM_DefaultExtension(fullname, ".pcx", sizeof(fullname));
-        }
-    }
-
+    len = image_path(fullname, name, type);
     if (len >= sizeof(fullname)) {
         print_error(fullname, flags, Q_ERR(ENAMETOOLONG));
         return 0;
@@ -2108,6 +2117,63 @@ qhandle_t R_RegisterImage(const char *name, imagetype_t type, imageflags_t flags
     return 0;
 }
 
+/*
+===============
+R_PrefetchImage
+
+Queues files R_RegisterImage is going to try for background reading,
+in the same order load_image_data tries them.
+===============
+*/
+void R_PrefetchImage(const char *name, imagetype_t type)
+{
+    char            fullname[MAX_QPATH];
+    size_t          len, baselen;
+    imageformat_t   fmt;
+
+    if (!*name || !r_numImages)
+        return;
+
+    len = image_path(fullname, name, type);
+    if (len >= sizeof(fullname))
+        return;
+
+    baselen = COM_FileExtension(fullname) - fullname;
+    if (baselen < 1 || fullname[baselen] != '.')
+        return;
+
+    // already loaded?
+    if (lookup_image(fullname, type, FS_HashPathLen(fullname, baselen, RIMAGES_HASH), baselen))
+        return;
+
+    for (fmt = 0; fmt < IM_MAX; fmt++)
+        if (!Q_stricmp(fullname + baselen + 1, img_loaders[fmt].ext))
+            break;
+
+#if USE_PNG || USE_JPG || USE_TGA
+    if (fmt < IM_MAX && need_override_image(type, fmt))
+        fmt = IM_MAX;
+#endif
+
+    if (fmt < IM_MAX)
+        FS_PrefetchFile(fullname, 0);
+
+#if USE_PNG || USE_JPG || USE_TGA
+    for (int i = 0; i < img_total; i++) {
+        if (img_search[i] == fmt)
+            continue;
+        memcpy(fullname + baselen + 1, img_loaders[img_search[i]].ext, 4);
+        FS_PrefetchFile(fullname, 0);
+    }
+
+    imageformat_t fallback = (type == IT_WALL) ? IM_WAL : IM_PCX;
+    if (fallback != fmt) {
+        memcpy(fullname + baselen + 1, img_loaders[fallback].ext, 4);
+        FS_PrefetchFile(fullname, 0);
+    }
+#endif
+}
+
 /*
 =============
 R_GetPicSize
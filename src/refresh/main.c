@@ -795,6 +795,8 @@ static pp_flags_t GL_BindFramebuffer(void)
 
 void R_RenderFrame(const refdef_t *fd)
 {
+    PROF_BEGIN("R_RenderFrame");
+
     GL_Flush2D();
 
     Q_assert(gl_static.world.cache || (fd->rdflags & RDF_NOWORLDMODEL));
@@ -878,6 +880,8 @@ void R_RenderFrame(const refdef_t *fd)
 
     if (gl_showerrors->integer > 1)
         GL_ShowErrors(__func__);
+
+    PROF_END();
 }
 
 void R_BeginFrame(void)
@@ -1154,6 +1158,9 @@ static void GL_Register(void)
     gl_clearcolor_changed(gl_clearcolor);
 
     Cmd_AddCommand("strings", GL_Strings_f);
+#if USE_TESTS
+    Cmd_AddCommand("lerpbench", GL_LerpBench_f);
+#endif
 
 #if USE_DEBUG
     Cmd_AddMacro("gl_viewcluster", GL_ViewCluster_m);
@@ -1164,6 +1171,9 @@ static void GL_Register(void)
 static void GL_Unregister(void)
 {
     Cmd_RemoveCommand("strings");
+#if USE_TESTS
+    Cmd_RemoveCommand("lerpbench");
+#endif
 }
 
 static void APIENTRY myDebugProc(GLenum source, GLenum type, GLuint id, GLenum severity,
@@ -1354,6 +1364,12 @@ bool R_Init(bool total)
 
     GL_InitTables();
 
+    GL_InitSimd();
+
+#if USE_MD5
+    GL_InitSkinThreads();
+#endif
+
     GL_InitDebugDraw();
 
     GL_PostInit();
@@ -1396,6 +1412,10 @@ void R_Shutdown(bool total)
 
     GL_ShutdownDebugDraw();
 
+#if USE_MD5
+    GL_ShutdownSkinThreads();
+#endif
+
     GL_ShutdownState();
 
     GL_ShutdownArrays();
@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "system/pthread.h"
 
 typedef enum {
     SHADOW_NO,
@@ -36,6 +37,7 @@ static vec_t            shellscale;
 static vec4_t           color;
 static glStateBits_t    meshbits;
 static GLuint           buffer;
+static meshlerp_t       lerp;
 
 static vec3_t   shadedir;
 static bool     dotshading;
@@ -48,7 +50,45 @@ static mat4_t       m_shadow_view;
 static mat4_t       m_shadow_model;     // fog hack
 
 #if USE_MD5
-static md5_joint_t  temp_skeleton[MD5_MAX_JOINTS];
+
+#define SKEL_CACHE_SIZE     8
+#define MAX_SKIN_THREADS    8
+#define MIN_SKIN_VERTS      256     // don't split meshes into smaller jobs
+
+typedef void (*tessskel_t)(const md5_mesh_t *, const md5_joint_t *, int, int);
+
+// lerped skeletons are only valid for the scene they were built in
+typedef struct {
+    const md5_model_t   *model;
+    unsigned            drawframe;
+    unsigned            oldframe;
+    unsigned            newframe;
+    float               backlerp;
+    md5_joint_t         joints[MD5_MAX_JOINTS];
+} skelcache_t;
+
+static skelcache_t  skel_cache[SKEL_CACHE_SIZE];
+static unsigned     skel_cache_next;
+
+static struct {
+    int                 num_threads;
+    pthread_t           threads[MAX_SKIN_THREADS];
+    pthread_mutex_t     lock;
+    pthread_cond_t      work_cond;
+    pthread_cond_t      done_cond;
+    bool                started;
+    bool                terminate;
+    tessskel_t          func;
+    const md5_mesh_t    *mesh;
+    const md5_joint_t   *skel;
+    int                 job_verts;
+    int                 num_jobs;
+    int                 next_job;
+    int                 jobs_done;
+} skin_pool;
+
+static cvar_t   *gl_md5_threads;
+
 #endif
 
 static void setup_dotshading(void)
@@ -191,6 +231,14 @@ static void tess_lerped_shell(const maliasmesh_t *mesh)
     int count = mesh->numverts;
     vec3_t normal;
 
+    if (gl_static.lerpkernels) {
+        int n = gl_static.lerpkernels->shell(dst_vert, src_oldvert, src_newvert, count, &lerp);
+        src_oldvert += n;
+        src_newvert += n;
+        dst_vert += n * 4;
+        count -= n;
+    }
+
     while (count--) {
         get_lerped_normal(normal, src_oldvert, src_newvert);
 
@@ -218,6 +266,14 @@ static void tess_lerped_shade(const maliasmesh_t *mesh)
     int count = mesh->numverts;
     vec3_t normal;
 
+    if (gl_static.lerpkernels && gl_static.lerpkernels->shade) {
+        int n = gl_static.lerpkernels->shade(dst_vert, src_oldvert, src_newvert, count, &lerp);
+        src_oldvert += n;
+        src_newvert += n;
+        dst_vert += n * VERTEX_SIZE;
+        count -= n;
+    }
+
     while (count--) {
         vec_t oldd = shadedot(get_static_normal(normal, src_oldvert));
         vec_t newd = shadedot(get_static_normal(normal, src_newvert));
@@ -250,6 +306,14 @@ static void tess_lerped_plain(const maliasmesh_t *mesh)
     vec_t *dst_vert = tess.vertices;
     int count = mesh->numverts;
 
+    if (gl_static.lerpkernels) {
+        int n = gl_static.lerpkernels->plain(dst_vert, src_oldvert, src_newvert, count, &lerp);
+        src_oldvert += n;
+        src_newvert += n;
+        dst_vert += n * 4;
+        count -= n;
+    }
+
     while (count--) {
         dst_vert[0] =
             src_oldvert->pos[0] * oldscale[0] +
@@ -267,6 +331,18 @@ static void tess_lerped_plain(const maliasmesh_t *mesh)
     }
 }
 
+static void setup_lerp(void)
+{
+    VectorCopy(oldscale, lerp.oldscale);
+    VectorCopy(newscale, lerp.newscale);
+    VectorCopy(translate, lerp.translate);
+    VectorCopy(shadedir, lerp.shadedir);
+    Vector4Copy(color, lerp.color);
+    lerp.backlerp = backlerp;
+    lerp.frontlerp = frontlerp;
+    lerp.shellscale = shellscale;
+}
+
 static glCullResult_t cull_static_model(const model_t *model)
 {
     const maliasframe_t *newframe = &model->frames[newframenum];
@@ -769,17 +845,17 @@ static q_forceinline void calc_skel_vert(const md5_vertex_t *vert,
     }
 }
 
-static void tess_plain_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton)
+static void tess_plain_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton, int first, int last)
 {
-    for (int i = 0; i < mesh->num_verts; i++)
+    for (int i = first; i < last; i++)
         calc_skel_vert(&mesh->vertices[i], mesh, skeleton, &tess.vertices[i * 4], NULL);
 }
 
-static void tess_shade_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton)
+static void tess_shade_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton, int first, int last)
 {
-    vec_t *dst_vert = tess.vertices;
+    vec_t *dst_vert = &tess.vertices[first * VERTEX_SIZE];
 
-    for (int i = 0; i < mesh->num_verts; i++) {
+    for (int i = first; i < last; i++) {
         vec3_t normal;
         calc_skel_vert(&mesh->vertices[i], mesh, skeleton, dst_vert, normal);
 
@@ -793,9 +869,9 @@ static void tess_shade_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton)
     }
 }
 
-static void tess_shell_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton)
+static void tess_shell_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton, int first, int last)
 {
-    for (int i = 0; i < mesh->num_verts; i++) {
+    for (int i = first; i < last; i++) {
         vec3_t position, normal;
         calc_skel_vert(&mesh->vertices[i], mesh, skeleton, position, normal);
 
@@ -803,26 +879,196 @@ static void tess_shell_skel(const md5_mesh_t *mesh, const md5_joint_t *skeleton)
     }
 }
 
-static void lerp_alias_skeleton(const md5_model_t *model)
+// entities sharing model and frames within a scene reuse lerped skeleton
+static const md5_joint_t *lerp_alias_skeleton(const md5_model_t *model)
 {
     unsigned frame_a = oldframenum % model->num_frames;
     unsigned frame_b = newframenum % model->num_frames;
     const md5_joint_t *skel_a = &model->skeleton_frames[frame_a * model->num_joints];
     const md5_joint_t *skel_b = &model->skeleton_frames[frame_b * model->num_joints];
-    md5_joint_t *out = temp_skeleton;
+    skelcache_t *cache;
+    md5_joint_t *out;
+
+    for (int i = 0; i < SKEL_CACHE_SIZE; i++) {
+        cache = &skel_cache[i];
+        if (cache->model == model && cache->drawframe == glr.drawframe &&
+            cache->oldframe == frame_a && cache->newframe == frame_b &&
+            cache->backlerp == backlerp) {
+            c.skeletonsCached++;
+            return cache->joints;
+        }
+    }
+
+    cache = &skel_cache[skel_cache_next++ % SKEL_CACHE_SIZE];
+    cache->model = model;
+    cache->drawframe = glr.drawframe;
+    cache->oldframe = frame_a;
+    cache->newframe = frame_b;
+    cache->backlerp = backlerp;
 
+    out = cache->joints;
     for (int i = 0; i < model->num_joints; i++, skel_a++, skel_b++, out++) {
         out->scale = skel_b->scale;
         LerpVector2(skel_a->pos, skel_b->pos, backlerp, frontlerp, out->pos);
         Quat_SLerp(skel_a->orient, skel_b->orient, backlerp, frontlerp, out->orient);
         Quat_ToAxis(out->orient, out->axis);
     }
+
+    c.skeletonsLerped++;
+    return cache->joints;
 }
 
 #if (defined __OPTIMIZE__) && (defined __GNUC__) && !(defined __clang__)
 #pragma GCC reset_options
 #endif
 
+/*
+===============================================================================
+
+SKINNING THREADS
+
+Large meshes are split into vertex ranges that are skinned into tess arrays
+concurrently by a pool of worker threads. Main thread skins one range too,
+and waits for all ranges to finish before drawing the mesh.
+
+===============================================================================
+*/
+
+// called with lock held
+static void run_skin_jobs(void)
+{
+    while (skin_pool.next_job < skin_pool.num_jobs) {
+        tessskel_t func = skin_pool.func;
+        const md5_mesh_t *mesh = skin_pool.mesh;
+        const md5_joint_t *skel = skin_pool.skel;
+        int first = skin_pool.next_job++ * skin_pool.job_verts;
+        int last = min(first + skin_pool.job_verts, mesh->num_verts);
+
+        pthread_mutex_unlock(&skin_pool.lock);
+        PROF_BEGIN("tess_skel");
+        func(mesh, skel, first, last);
+        PROF_END();
+        pthread_mutex_lock(&skin_pool.lock);
+
+        if (++skin_pool.jobs_done == skin_pool.num_jobs)
+            pthread_cond_signal(&skin_pool.done_cond);
+    }
+}
+
+static void *skin_thread_func(void *arg)
+{
+    pthread_mutex_lock(&skin_pool.lock);
+    while (1) {
+        while (skin_pool.next_job >= skin_pool.num_jobs && !skin_pool.terminate)
+            pthread_cond_wait(&skin_pool.work_cond, &skin_pool.lock);
+
+        if (skin_pool.terminate)
+            break;
+
+        run_skin_jobs();
+    }
+    pthread_mutex_unlock(&skin_pool.lock);
+
+    return NULL;
+}
+
+// pool is started on first use, since GPU skinning doesn't need it
+static void start_skin_threads(void)
+{
+    int i, count = Cvar_ClampInteger(gl_md5_threads, 0, MAX_SKIN_THREADS);
+
+    skin_pool.started = true;
+    if (!count)
+        return;
+
+    pthread_mutex_init(&skin_pool.lock, NULL);
+    pthread_cond_init(&skin_pool.work_cond, NULL);
+    pthread_cond_init(&skin_pool.done_cond, NULL);
+    skin_pool.terminate = false;
+    skin_pool.num_jobs = skin_pool.next_job = skin_pool.jobs_done = 0;
+
+    for (i = 0; i < count; i++) {
+        if (pthread_create(&skin_pool.threads[i], NULL, skin_thread_func, NULL)) {
+            Com_EPrintf("Couldn't create skinning thread %d\n", i);
+            break;
+        }
+    }
+
+    skin_pool.num_threads = i;
+    Com_DPrintf("Started %d skinning threads\n", i);
+}
+
+static void tess_skel_mesh(tessskel_t func, const md5_mesh_t *mesh, const md5_joint_t *skel)
+{
+    int num_jobs;
+
+    if (!skin_pool.started)
+        start_skin_threads();
+
+    num_jobs = min(skin_pool.num_threads + 1, mesh->num_verts / MIN_SKIN_VERTS);
+    if (num_jobs < 2) {
+        func(mesh, skel, 0, mesh->num_verts);
+        return;
+    }
+
+    pthread_mutex_lock(&skin_pool.lock);
+    skin_pool.func = func;
+    skin_pool.mesh = mesh;
+    skin_pool.skel = skel;
+    skin_pool.job_verts = (mesh->num_verts + num_jobs - 1) / num_jobs;
+    skin_pool.num_jobs = num_jobs;
+    skin_pool.next_job = 0;
+    skin_pool.jobs_done = 0;
+    pthread_cond_broadcast(&skin_pool.work_cond);
+
+    run_skin_jobs();
+
+    while (skin_pool.jobs_done < skin_pool.num_jobs)
+        pthread_cond_wait(&skin_pool.done_cond, &skin_pool.lock);
+
+    skin_pool.num_jobs = 0;
+    pthread_mutex_unlock(&skin_pool.lock);
+}
+
+static void shutdown_skin_threads(void)
+{
+    int i;
+
+    if (skin_pool.num_threads) {
+        pthread_mutex_lock(&skin_pool.lock);
+        skin_pool.terminate = true;
+        pthread_cond_broadcast(&skin_pool.work_cond);
+        pthread_mutex_unlock(&skin_pool.lock);
+
+        for (i = 0; i < skin_pool.num_threads; i++)
+            Q_assert(!pthread_join(skin_pool.threads[i], NULL));
+
+        pthread_mutex_destroy(&skin_pool.lock);
+        pthread_cond_destroy(&skin_pool.work_cond);
+        pthread_cond_destroy(&skin_pool.done_cond);
+        skin_pool.num_threads = 0;
+    }
+
+    skin_pool.started = false;
+}
+
+static void gl_md5_threads_changed(cvar_t *self)
+{
+    shutdown_skin_threads();
+}
+
+void GL_InitSkinThreads(void)
+{
+    gl_md5_threads = Cvar_Get("gl_md5_threads", "2", 0);
+    gl_md5_threads->changed = gl_md5_threads_changed;
+}
+
+void GL_ShutdownSkinThreads(void)
+{
+    shutdown_skin_threads();
+    memset(skel_cache, 0, sizeof(skel_cache));
+}
+
 static void bind_skel_arrays(const md5_mesh_t *mesh)
 {
     if (gl_config.caps & QGL_CAP_SHADER_STORAGE) {
@@ -858,11 +1104,11 @@ static void draw_skeleton_mesh(const md5_model_t *model, const md5_mesh_t *mesh,
     if (buffer)
         bind_skel_arrays(mesh);
     else if (glr.ent->flags & RF_SHELL_MASK)
-        tess_shell_skel(mesh, skel);
+        tess_skel_mesh(tess_shell_skel, mesh, skel);
     else if (dotshading)
-        tess_shade_skel(mesh, skel);
+        tess_skel_mesh(tess_shade_skel, mesh, skel);
     else
-        tess_plain_skel(mesh, skel);
+        tess_skel_mesh(tess_plain_skel, mesh, skel);
 
     draw_alias_mesh(mesh->indices, mesh->num_indices,
                     mesh->tcoords, mesh->num_verts,
@@ -871,12 +1117,12 @@ static void draw_skeleton_mesh(const md5_model_t *model, const md5_mesh_t *mesh,
 
 static void draw_alias_skeleton(const md5_model_t *model)
 {
-    const md5_joint_t *skel = temp_skeleton;
+    const md5_joint_t *skel;
 
     if (newframenum == oldframenum)
         skel = &model->skeleton_frames[newframenum % model->num_frames * model->num_joints];
     else
-        lerp_alias_skeleton(model);
+        skel = lerp_alias_skeleton(model);
 
     if (buffer) {
         glJoint_t joints[MD5_MAX_JOINTS];
@@ -1028,6 +1274,10 @@ void GL_DrawAliasModel(const model_t *model)
         GL_BindArrays(dotshading ? VA_MESH_SHADE : VA_MESH_FLAT);
         meshbits = 0;
 
+        // parameters for vectorized lerp
+        if (newframenum != oldframenum && gl_static.lerpkernels)
+            setup_lerp();
+
         // select proper tessfunc
         if (ent->flags & RF_SHELL_MASK) {
             tessfunc = newframenum == oldframenum ?
@@ -1073,3 +1323,115 @@ void GL_DrawAliasModel(const model_t *model)
         qglFrontFace(GL_CW);
     }
 }
+
+#if USE_TESTS
+
+/*
+=================
+GL_LerpBench_f
+
+Runs scalar and vectorized MD2 interpolation over random vertices,
+checking that results match and printing time per vertex.
+=================
+*/
+void GL_LerpBench_f(void)
+{
+    static const struct {
+        const char *name;
+        void (*tess)(const maliasmesh_t *);
+        int stride;
+        size_t kernel;
+    } funcs[] = {
+        { "shell", tess_lerped_shell, 4, offsetof(meshlerpkernels_t, shell) },
+        { "shade", tess_lerped_shade, VERTEX_SIZE, offsetof(meshlerpkernels_t, shade) },
+        { "plain", tess_lerped_plain, 4, offsetof(meshlerpkernels_t, plain) },
+    };
+    const meshlerpkernels_t *saved = gl_static.lerpkernels;
+    const meshlerpkernels_t *k;
+    maliasmesh_t mesh = { 0 };
+    int i, j, n, loops, errors;
+    uint64_t time, scalar;
+    size_t size;
+    vec_t *ref;
+
+    mesh.numverts = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : 999;
+    loops = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 1000;
+    if (mesh.numverts < 1 || mesh.numverts > TESS_MAX_VERTICES || loops < 1) {
+        Com_Printf("Usage: %s [verts] [loops]\n", Cmd_Argv(0));
+        return;
+    }
+
+    mesh.verts = Z_Malloc(sizeof(mesh.verts[0]) * mesh.numverts * 2);
+    for (i = 0; i < mesh.numverts * 2; i++) {
+        uint32_t r = Q_rand();
+        mesh.verts[i].pos[0] = r;
+        mesh.verts[i].pos[1] = r >> 16;
+        mesh.verts[i].pos[2] = Q_rand();
+        mesh.verts[i].norm[0] = r >> 8;
+        mesh.verts[i].norm[1] = r >> 24;
+    }
+
+    oldframenum = 0;
+    newframenum = 1;
+    backlerp = 0.3f;
+    frontlerp = 1.0f - backlerp;
+    VectorSet(oldscale, 0.011f * backlerp, 0.012f * backlerp, 0.013f * backlerp);
+    VectorSet(newscale, 0.014f * frontlerp, 0.015f * frontlerp, 0.016f * frontlerp);
+    VectorSet(translate, 1.5f, -2.5f, 24.0f);
+    VectorSet(shadedir, 0.6f, 0.0f, 0.8f);
+    Vector4Set(color, 1.0f, 0.5f, 0.25f, 1.0f);
+    shellscale = POWERSUIT_SCALE;
+    setup_lerp();
+
+    size = sizeof(tess.vertices[0]) * VERTEX_SIZE * mesh.numverts;
+    ref = Z_Malloc(size);
+
+    for (i = 0; i < q_countof(funcs); i++) {
+        gl_static.lerpkernels = NULL;
+        funcs[i].tess(&mesh);
+        memcpy(ref, tess.vertices, size);
+
+        time = Sys_Microseconds();
+        for (j = 0; j < loops; j++)
+            funcs[i].tess(&mesh);
+        scalar = max(Sys_Microseconds() - time, 1);
+
+        Com_Printf("%s %-6s %6.2f ns/vert\n", funcs[i].name, "scalar",
+                   scalar * 1e3 / loops / mesh.numverts);
+
+        for (k = gl_lerpkernels; k->name; k++) {
+            if (!k->supported())
+                continue;
+            if (!*(const meshlerpfunc_t *)((const byte *)k + funcs[i].kernel))
+                continue;
+
+            gl_static.lerpkernels = k;
+            memset(tess.vertices, 0, size);
+            funcs[i].tess(&mesh);
+
+            // 4th component of position is unused
+            errors = 0;
+            for (j = 0; j < mesh.numverts; j++) {
+                const vec_t *a = &ref[j * funcs[i].stride];
+                const vec_t *b = &tess.vertices[j * funcs[i].stride];
+                for (n = 0; n < funcs[i].stride; n++)
+                    if (n != 3 && a[n] != b[n])
+                        errors++;
+            }
+
+            time = Sys_Microseconds();
+            for (j = 0; j < loops; j++)
+                funcs[i].tess(&mesh);
+            time = max(Sys_Microseconds() - time, 1);
+
+            Com_Printf("%s %-6s %6.2f ns/vert, %.2fx, %d mismatches\n", funcs[i].name, k->name,
+                       time * 1e3 / loops / mesh.numverts, (double)scalar / time, errors);
+        }
+    }
+
+    gl_static.lerpkernels = saved;
+    Z_Free(ref);
+    Z_Free(mesh.verts);
+}
+
+#endif
@@ -1587,7 +1587,7 @@ qhandle_t R_RegisterModel(const char *name)
         goto done;
     }
 
-    ret = FS_LoadFile(normalized, (void **)&rawdata);
+    ret = FS_LoadFileEx(normalized, (void **)&rawdata, FS_FLAG_MMAP, TAG_FILESYSTEM);
     if (!rawdata)
         goto fail1;
 
@@ -1667,6 +1667,22 @@ fail1:
     return 0;
 }
 
+void R_PrefetchModel(const char *name)
+{
+    char normalized[MAX_QPATH];
+    size_t namelen;
+
+    if (!*name || *name == '*')
+        return;
+
+    namelen = FS_NormalizePathBuffer(normalized, name, MAX_QPATH);
+    if (!namelen || namelen >= MAX_QPATH)
+        return;
+
+    if (!MOD_Find(normalized))
+        FS_PrefetchFile(normalized, FS_FLAG_MMAP);
+}
+
 model_t *MOD_ForHandle(qhandle_t h)
 {
     model_t *model;
@@ -0,0 +1,514 @@
+/*
+Copyright (C) 2026 Q2PRO contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// simd.c -- vectorized MD2 vertex interpolation for CPU tessellation and
+// dynamic lightmap accumulation
+//
+// Kernels load groups of packed vertices, transpose them into one register
+// per component (x, y, z and normal) and interpolate several vertices at
+// once, then transpose results back into tesselator layout. Arithmetic is
+// done in the same order as scalar code in mesh.c, so results are identical.
+// The same holds for dynamic lights accumulated in surf.c.
+//
+
+#include "gl.h"
+
+#if (defined __GNUC__) && ((defined __i386__) || (defined __x86_64__))
+#define USE_SSE2    1
+#define USE_AVX2    1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif (defined _MSC_VER) && ((defined _M_IX86) || (defined _M_X64))
+#define USE_SSE2    1
+#define USE_AVX2    1
+#define TARGET_SSE2
+#define TARGET_AVX2
+#include <intrin.h>
+#endif
+
+#if USE_SSE2 || USE_AVX2
+#include <immintrin.h>
+#endif
+
+static cvar_t   *gl_simd;
+
+#if USE_SSE2
+
+static inline TARGET_SSE2
+void sse2_load_verts(const maliasvert_t *vert, __m128 *x, __m128 *y, __m128 *z, __m128i *n)
+{
+    __m128i v0 = _mm_loadu_si128((const __m128i *)vert);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(vert + 2));
+    __m128i a  = _mm_unpacklo_epi16(v0, v1);    // x0 x2 y0 y2 z0 z2 n0 n2
+    __m128i b  = _mm_unpackhi_epi16(v0, v1);    // x1 x3 y1 y3 z1 z3 n1 n3
+    __m128i xy = _mm_unpacklo_epi16(a, b);      // x0 x1 x2 x3 y0 y1 y2 y3
+    __m128i zn = _mm_unpackhi_epi16(a, b);      // z0 z1 z2 z3 n0 n1 n2 n3
+
+    // sign extend positions, zero extend normals
+    *x = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(xy, xy), 16));
+    *y = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(xy, xy), 16));
+    *z = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(zn, zn), 16));
+    *n = _mm_unpackhi_epi16(zn, _mm_setzero_si128());
+}
+
+static inline TARGET_SSE2
+void sse2_get_normals(__m128i n, __m128 *x, __m128 *y, __m128 *z)
+{
+    int32_t k[4];
+    __m128 sinlat, coslat, sinlng, coslng;
+
+    _mm_storeu_si128((__m128i *)k, n);
+
+    sinlat = _mm_setr_ps(TAB_SIN(k[0]), TAB_SIN(k[1]), TAB_SIN(k[2]), TAB_SIN(k[3]));
+    coslat = _mm_setr_ps(TAB_COS(k[0]), TAB_COS(k[1]), TAB_COS(k[2]), TAB_COS(k[3]));
+    sinlng = _mm_setr_ps(TAB_SIN(k[0] >> 8), TAB_SIN(k[1] >> 8), TAB_SIN(k[2] >> 8), TAB_SIN(k[3] >> 8));
+    coslng = _mm_setr_ps(TAB_COS(k[0] >> 8), TAB_COS(k[1] >> 8), TAB_COS(k[2] >> 8), TAB_COS(k[3] >> 8));
+
+    *x = _mm_mul_ps(sinlat, coslng);
+    *y = _mm_mul_ps(sinlat, sinlng);
+    *z = coslat;
+}
+
+static inline TARGET_SSE2
+__m128 sse2_lerp_pos(__m128 o, __m128 n, const meshlerp_t *p, int i)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(o, _mm_set1_ps(p->oldscale[i])),
+                                 _mm_mul_ps(n, _mm_set1_ps(p->newscale[i]))),
+                                 _mm_set1_ps(p->translate[i]));
+}
+
+static inline TARGET_SSE2
+void sse2_store(vec_t *dst, int stride, __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    __m128 t0 = _mm_unpacklo_ps(x, y);
+    __m128 t1 = _mm_unpackhi_ps(x, y);
+    __m128 t2 = _mm_unpacklo_ps(z, w);
+    __m128 t3 = _mm_unpackhi_ps(z, w);
+
+    _mm_storeu_ps(dst + stride * 0, _mm_movelh_ps(t0, t2));
+    _mm_storeu_ps(dst + stride * 1, _mm_movehl_ps(t2, t0));
+    _mm_storeu_ps(dst + stride * 2, _mm_movelh_ps(t1, t3));
+    _mm_storeu_ps(dst + stride * 3, _mm_movehl_ps(t3, t1));
+}
+
+static TARGET_SSE2
+int sse2_lerp_plain(vec_t *dst, const maliasvert_t *oldvert,
+                    const maliasvert_t *newvert, int count, const meshlerp_t *p)
+{
+    __m128 ox, oy, oz, nx, ny, nz;
+    __m128i on, nn;
+    int i;
+
+    for (i = 0; i < (count & ~3); i += 4) {
+        sse2_load_verts(oldvert + i, &ox, &oy, &oz, &on);
+        sse2_load_verts(newvert + i, &nx, &ny, &nz, &nn);
+
+        sse2_store(dst, 4,
+                   sse2_lerp_pos(ox, nx, p, 0),
+                   sse2_lerp_pos(oy, ny, p, 1),
+                   sse2_lerp_pos(oz, nz, p, 2),
+                   _mm_setzero_ps());
+        dst += 4 * 4;
+    }
+
+    return i;
+}
+
+static TARGET_SSE2
+int sse2_lerp_shell(vec_t *dst, const maliasvert_t *oldvert,
+                    const maliasvert_t *newvert, int count, const meshlerp_t *p)
+{
+    __m128 ox, oy, oz, nx, ny, nz;
+    __m128 x, y, z, x2, y2, z2, scale;
+    __m128 backlerp = _mm_set1_ps(p->backlerp);
+    __m128 frontlerp = _mm_set1_ps(p->frontlerp);
+    __m128 shellscale = _mm_set1_ps(p->shellscale);
+    __m128i on, nn;
+    int i;
+
+    for (i = 0; i < (count & ~3); i += 4) {
+        sse2_load_verts(oldvert + i, &ox, &oy, &oz, &on);
+        sse2_load_verts(newvert + i, &nx, &ny, &nz, &nn);
+
+        // lerp and normalize normals
+        sse2_get_normals(on, &x, &y, &z);
+        sse2_get_normals(nn, &x2, &y2, &z2);
+        x = _mm_add_ps(_mm_mul_ps(x, backlerp), _mm_mul_ps(x2, frontlerp));
+        y = _mm_add_ps(_mm_mul_ps(y, backlerp), _mm_mul_ps(y2, frontlerp));
+        z = _mm_add_ps(_mm_mul_ps(z, backlerp), _mm_mul_ps(z2, frontlerp));
+
+        scale = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(scale));
+
+        // push vertices out along normals
+#define SHELL(n, o, v, i) \
+    _mm_add_ps(_mm_add_ps(_mm_add_ps( \
+        _mm_mul_ps(_mm_mul_ps(n, scale), shellscale), \
+        _mm_mul_ps(o, _mm_set1_ps(p->oldscale[i]))), \
+        _mm_mul_ps(v, _mm_set1_ps(p->newscale[i]))), \
+        _mm_set1_ps(p->translate[i]))
+
+        sse2_store(dst, 4,
+                   SHELL(x, ox, nx, 0),
+                   SHELL(y, oy, ny, 1),
+                   SHELL(z, oz, nz, 2),
+                   _mm_setzero_ps());
+#undef SHELL
+        dst += 4 * 4;
+    }
+
+    return i;
+}
+
+static TARGET_SSE2
+int sse2_add_dlight_row(float *bl, int count, const dlightrow_t *p)
+{
+    __m128 sign     = _mm_set1_ps(-0.0f);
+    __m128 half     = _mm_set1_ps(0.5f);
+    __m128 local    = _mm_set1_ps(p->local);
+    __m128 scale    = _mm_set1_ps(p->scale);
+    __m128 td       = _mm_set1_ps(p->td);
+    __m128 rad      = _mm_set1_ps(p->rad);
+    __m128 minlight = _mm_set1_ps(p->minlight);
+    __m128 falloff  = _mm_set1_ps(p->falloff);
+    __m128 c0 = _mm_setr_ps(p->color[0], p->color[1], p->color[2], p->color[0]);
+    __m128 c1 = _mm_setr_ps(p->color[1], p->color[2], p->color[0], p->color[1]);
+    __m128 c2 = _mm_setr_ps(p->color[2], p->color[0], p->color[1], p->color[2]);
+    __m128 s = _mm_setr_ps(0, 1, 2, 3);
+    __m128 sd, gt, hi, lo, dist, mask, frac;
+    int i;
+
+    for (i = 0; i < (count & ~3); i += 4, bl += 12, s = _mm_add_ps(s, _mm_set1_ps(4))) {
+        sd = _mm_mul_ps(_mm_andnot_ps(sign, _mm_sub_ps(local, s)), scale);
+
+        // larger distance plus half of smaller one
+        gt = _mm_cmpgt_ps(sd, td);
+        hi = _mm_or_ps(_mm_and_ps(gt, sd), _mm_andnot_ps(gt, td));
+        lo = _mm_or_ps(_mm_and_ps(gt, td), _mm_andnot_ps(gt, sd));
+        dist = _mm_add_ps(hi, _mm_mul_ps(lo, half));
+
+        mask = _mm_cmplt_ps(dist, minlight);
+        if (!_mm_movemask_ps(mask))
+            continue;
+
+        // texels out of range get zero light
+        frac = _mm_and_ps(mask, _mm_sub_ps(rad, _mm_mul_ps(dist, falloff)));
+
+        // 4 RGB texels span 3 registers
+        _mm_storeu_ps(bl + 0, _mm_add_ps(_mm_loadu_ps(bl + 0),
+                      _mm_mul_ps(_mm_shuffle_ps(frac, frac, _MM_SHUFFLE(1, 0, 0, 0)), c0)));
+        _mm_storeu_ps(bl + 4, _mm_add_ps(_mm_loadu_ps(bl + 4),
+                      _mm_mul_ps(_mm_shuffle_ps(frac, frac, _MM_SHUFFLE(2, 2, 1, 1)), c1)));
+        _mm_storeu_ps(bl + 8, _mm_add_ps(_mm_loadu_ps(bl + 8),
+                      _mm_mul_ps(_mm_shuffle_ps(frac, frac, _MM_SHUFFLE(3, 3, 3, 2)), c2)));
+    }
+
+    return i;
+}
+
+#ifdef _MSC_VER
+static bool sse2_supported(void)
+{
+#ifdef _M_X64
+    return true;
+#else
+    int regs[4];
+
+    __cpuid(regs, 1);
+    return regs[3] & BIT(26);
+#endif
+}
+#else
+static bool sse2_supported(void)
+{
+    return __builtin_cpu_supports("sse2");
+}
+#endif
+
+#endif // USE_SSE2
+
+#if USE_AVX2
+
+// 8 vertices are loaded so that lanes end up in natural order after
+// in-lane unpacking: low 128-bit lane gets vertices 0-3, high gets 4-7
+static inline TARGET_AVX2
+void avx2_load_verts(const maliasvert_t *vert, __m256 *x, __m256 *y, __m256 *z, __m256i *n)
+{
+    __m256i q0 = _mm256_loadu_si256((const __m256i *)vert);
+    __m256i q1 = _mm256_loadu_si256((const __m256i *)(vert + 4));
+    __m256i v0 = _mm256_permute2x128_si256(q0, q1, 0x20);  // 0 1 4 5
+    __m256i v1 = _mm256_permute2x128_si256(q0, q1, 0x31);  // 2 3 6 7
+    __m256i a  = _mm256_unpacklo_epi16(v0, v1);
+    __m256i b  = _mm256_unpackhi_epi16(v0, v1);
+    __m256i xy = _mm256_unpacklo_epi16(a, b);
+    __m256i zn = _mm256_unpackhi_epi16(a, b);
+
+    *x = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_unpacklo_epi16(xy, xy), 16));
+    *y = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_unpackhi_epi16(xy, xy), 16));
+    *z = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_unpacklo_epi16(zn, zn), 16));
+    *n = _mm256_unpackhi_epi16(zn, _mm256_setzero_si256());
+}
+
+static inline TARGET_AVX2
+void avx2_get_normals(__m256i n, __m256 *x, __m256 *y, __m256 *z)
+{
+    __m256i mask = _mm256_set1_epi32(255);
+    __m256i quarter = _mm256_set1_epi32(64);
+    __m256i lat = _mm256_and_si256(n, mask);
+    __m256i lng = _mm256_srli_epi32(n, 8);
+    const float *tab = gl_static.sintab;
+
+    __m256 sinlat = _mm256_i32gather_ps(tab, lat, 4);
+    __m256 coslat = _mm256_i32gather_ps(tab, _mm256_and_si256(_mm256_add_epi32(lat, quarter), mask), 4);
+    __m256 sinlng = _mm256_i32gather_ps(tab, lng, 4);
+    __m256 coslng = _mm256_i32gather_ps(tab, _mm256_and_si256(_mm256_add_epi32(lng, quarter), mask), 4);
+
+    *x = _mm256_mul_ps(sinlat, coslng);
+    *y = _mm256_mul_ps(sinlat, sinlng);
+    *z = coslat;
+}
+
+static inline TARGET_AVX2
+__m256 avx2_shadedot(__m256i n, const meshlerp_t *p)
+{
+    __m256 x, y, z, d, zero = _mm256_setzero_ps();
+
+    avx2_get_normals(n, &x, &y, &z);
+
+    d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(p->shadedir[0])),
+                                    _mm256_mul_ps(y, _mm256_set1_ps(p->shadedir[1]))),
+                                    _mm256_mul_ps(z, _mm256_set1_ps(p->shadedir[2])));
+
+    // scale negative values by 0.3
+    d = _mm256_add_ps(_mm256_max_ps(d, zero), _mm256_mul_ps(_mm256_min_ps(d, zero), _mm256_set1_ps(0.3f)));
+
+    return _mm256_add_ps(d, _mm256_set1_ps(1.0f));
+}
+
+static inline TARGET_AVX2
+__m256 avx2_lerp_pos(__m256 o, __m256 n, const meshlerp_t *p, int i)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(o, _mm256_set1_ps(p->oldscale[i])),
+                                       _mm256_mul_ps(n, _mm256_set1_ps(p->newscale[i]))),
+                                       _mm256_set1_ps(p->translate[i]));
+}
+
+// transposes 4x4 blocks within each 128-bit lane, so that r[i] holds
+// vertex i in low lane and vertex i + 4 in high lane
+static inline TARGET_AVX2
+void avx2_transpose(__m256 r[4], __m256 x, __m256 y, __m256 z, __m256 w)
+{
+    __m256 t0 = _mm256_unpacklo_ps(x, y);
+    __m256 t1 = _mm256_unpackhi_ps(x, y);
+    __m256 t2 = _mm256_unpacklo_ps(z, w);
+    __m256 t3 = _mm256_unpackhi_ps(z, w);
+
+    r[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    r[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    r[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    r[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// stores 8 vec4 positions contiguously
+static inline TARGET_AVX2
+void avx2_store(vec_t *dst, __m256 x, __m256 y, __m256 z)
+{
+    __m256 r[4];
+
+    avx2_transpose(r, x, y, z, _mm256_setzero_ps());
+
+    _mm256_storeu_ps(dst +  0, _mm256_permute2f128_ps(r[0], r[1], 0x20));
+    _mm256_storeu_ps(dst +  8, _mm256_permute2f128_ps(r[2], r[3], 0x20));
+    _mm256_storeu_ps(dst + 16, _mm256_permute2f128_ps(r[0], r[1], 0x31));
+    _mm256_storeu_ps(dst + 24, _mm256_permute2f128_ps(r[2], r[3], 0x31));
+}
+
+static TARGET_AVX2
+int avx2_lerp_plain(vec_t *dst, const maliasvert_t *oldvert,
+                    const maliasvert_t *newvert, int count, const meshlerp_t *p)
+{
+    __m256 ox, oy, oz, nx, ny, nz;
+    __m256i on, nn;
+    int i;
+
+    for (i = 0; i < (count & ~7); i += 8) {
+        avx2_load_verts(oldvert + i, &ox, &oy, &oz, &on);
+        avx2_load_verts(newvert + i, &nx, &ny, &nz, &nn);
+
+        avx2_store(dst,
+                   avx2_lerp_pos(ox, nx, p, 0),
+                   avx2_lerp_pos(oy, ny, p, 1),
+                   avx2_lerp_pos(oz, nz, p, 2));
+        dst += 4 * 8;
+    }
+
+    return i;
+}
+
+static TARGET_AVX2
+int avx2_lerp_shade(vec_t *dst, const maliasvert_t *oldvert,
+                    const maliasvert_t *newvert, int count, const meshlerp_t *p)
+{
+    __m256 ox, oy, oz, nx, ny, nz, d, pos[4], col[4];
+    __m256i on, nn;
+    int i, j;
+
+    for (i = 0; i < (count & ~7); i += 8) {
+        avx2_load_verts(oldvert + i, &ox, &oy, &oz, &on);
+        avx2_load_verts(newvert + i, &nx, &ny, &nz, &nn);
+
+        d = _mm256_add_ps(_mm256_mul_ps(avx2_shadedot(on, p), _mm256_set1_ps(p->backlerp)),
+                          _mm256_mul_ps(avx2_shadedot(nn, p), _mm256_set1_ps(p->frontlerp)));
+
+        avx2_transpose(pos,
+                       avx2_lerp_pos(ox, nx, p, 0),
+                       avx2_lerp_pos(oy, ny, p, 1),
+                       avx2_lerp_pos(oz, nz, p, 2),
+                       _mm256_setzero_ps());
+        avx2_transpose(col,
+                       _mm256_mul_ps(_mm256_set1_ps(p->color[0]), d),
+                       _mm256_mul_ps(_mm256_set1_ps(p->color[1]), d),
+                       _mm256_mul_ps(_mm256_set1_ps(p->color[2]), d),
+                       _mm256_set1_ps(p->color[3]));
+
+        // each vertex is position followed by color
+        for (j = 0; j < 4; j++) {
+            _mm256_storeu_ps(dst + VERTEX_SIZE * j, _mm256_permute2f128_ps(pos[j], col[j], 0x20));
+            _mm256_storeu_ps(dst + VERTEX_SIZE * (j + 4), _mm256_permute2f128_ps(pos[j], col[j], 0x31));
+        }
+        dst += VERTEX_SIZE * 8;
+    }
+
+    return i;
+}
+
+static TARGET_AVX2
+int avx2_lerp_shell(vec_t *dst, const maliasvert_t *oldvert,
+                    const maliasvert_t *newvert, int count, const meshlerp_t *p)
+{
+    __m256 ox, oy, oz, nx, ny, nz;
+    __m256 x, y, z, x2, y2, z2, scale;
+    __m256 backlerp = _mm256_set1_ps(p->backlerp);
+    __m256 frontlerp = _mm256_set1_ps(p->frontlerp);
+    __m256 shellscale = _mm256_set1_ps(p->shellscale);
+    __m256i on, nn;
+    int i;
+
+    for (i = 0; i < (count & ~7); i += 8) {
+        avx2_load_verts(oldvert + i, &ox, &oy, &oz, &on);
+        avx2_load_verts(newvert + i, &nx, &ny, &nz, &nn);
+
+        // lerp and normalize normals
+        avx2_get_normals(on, &x, &y, &z);
+        avx2_get_normals(nn, &x2, &y2, &z2);
+        x = _mm256_add_ps(_mm256_mul_ps(x, backlerp), _mm256_mul_ps(x2, frontlerp));
+        y = _mm256_add_ps(_mm256_mul_ps(y, backlerp), _mm256_mul_ps(y2, frontlerp));
+        z = _mm256_add_ps(_mm256_mul_ps(z, backlerp), _mm256_mul_ps(z2, frontlerp));
+
+        scale = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+        scale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(scale));
+
+        // push vertices out along normals
+#define SHELL(n, o, v, i) \
+    _mm256_add_ps(_mm256_add_ps(_mm256_add_ps( \
+        _mm256_mul_ps(_mm256_mul_ps(n, scale), shellscale), \
+        _mm256_mul_ps(o, _mm256_set1_ps(p->oldscale[i]))), \
+        _mm256_mul_ps(v, _mm256_set1_ps(p->newscale[i]))), \
+        _mm256_set1_ps(p->translate[i]))
+
+        avx2_store(dst,
+                   SHELL(x, ox, nx, 0),
+                   SHELL(y, oy, ny, 1),
+                   SHELL(z, oz, nz, 2));
+#undef SHELL
+        dst += 4 * 8;
+    }
+
+    return i;
+}
+
+#ifdef _MSC_VER
+static bool avx2_supported(void)
+{
+    int regs[4];
+
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+
+    // check that OS saves YMM registers
+    __cpuid(regs, 1);
+    if ((regs[2] & (BIT(27) | BIT(28))) != (BIT(27) | BIT(28)))
+        return false;
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(regs, 7, 0);
+    return regs[1] & BIT(5);
+}
+#else
+static bool avx2_supported(void)
+{
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#endif // USE_AVX2
+
+// sorted from best to worst
+const meshlerpkernels_t gl_lerpkernels[] = {
+#if USE_AVX2
+    { "AVX2", 2, avx2_supported, avx2_lerp_shell, avx2_lerp_shade, avx2_lerp_plain },
+#endif
+#if USE_SSE2
+    // without gathers, shading isn't faster than scalar code
+    { "SSE2", 1, sse2_supported, sse2_lerp_shell, NULL, sse2_lerp_plain },
+#endif
+    { NULL }
+};
+
+static void gl_simd_changed(cvar_t *self)
+{
+    const meshlerpkernels_t *k;
+
+    gl_static.lerpkernels = NULL;
+
+    for (k = gl_lerpkernels; k->name; k++) {
+        if (k->level <= self->integer && k->supported()) {
+            gl_static.lerpkernels = k;
+            break;
+        }
+    }
+
+    Com_DPrintf("Using %s MD2 interpolation\n",
+                gl_static.lerpkernels ? gl_static.lerpkernels->name : "scalar");
+
+    gl_static.dlightrow = NULL;
+#if USE_SSE2
+    if (self->integer >= 1 && sse2_supported())
+        gl_static.dlightrow = sse2_add_dlight_row;
+#endif
+}
+
+void GL_InitSimd(void)
+{
+    gl_simd = Cvar_Get("gl_simd", "2", 0);
+    gl_simd->changed = gl_simd_changed;
+    gl_simd_changed(gl_simd);
+}
@@ -96,6 +96,9 @@ DYNAMIC BLOCKLIGHTS
 #define MAX_LIGHTMAP_EXTENTS    513
 #define MAX_BLOCKLIGHTS         (MAX_LIGHTMAP_EXTENTS * MAX_LIGHTMAP_EXTENTS)
 
+// max extra texels uploaded when merging dirty rectangles
+#define LM_MERGE_WASTE          256
+
 #define LM_PIXELS(map, s, t)    ((map)->buffer + ((t) << lm.block_shift) + ((s) << 2))
 
 static float blocklights[MAX_BLOCKLIGHTS * 3];
@@ -136,6 +139,7 @@ static void put_blocklights(const mface_t *surf)
 static void add_dynamic_lights(const mface_t *surf)
 {
     const dlight_t  *light;
+    dlightrow_t     row;
     vec3_t          point;
     vec2_t          local;
     vec_t           s_scale, t_scale, sd, td;
@@ -171,10 +175,23 @@ static void add_dynamic_lights(const mface_t *surf)
         local[0] = DotProduct(point, surf->lm_axis[0]) + surf->lm_offset[0];
         local[1] = DotProduct(point, surf->lm_axis[1]) + surf->lm_offset[1];
 
+        row.local = local[0];
+        row.scale = s_scale;
+        row.rad = rad;
+        row.minlight = minlight;
+        row.falloff = scale;
+        VectorCopy(light->color, row.color);
+
         bl = blocklights;
         for (t = 0; t < tmax; t++) {
             td = fabsf(local[1] - t) * t_scale;
-            for (s = 0; s < smax; s++) {
+            s = 0;
+            if (gl_static.dlightrow) {
+                row.td = td;
+                s = gl_static.dlightrow(bl, smax, &row);
+                bl += s * 3;
+            }
+            for (; s < smax; s++) {
                 sd = fabsf(local[0] - s) * s_scale;
                 if (sd > td)
                     dist = sd + td * 0.5f;
@@ -230,50 +247,103 @@ static void add_light_styles(mface_t *surf)
     }
 }
 
-static void update_dynamic_lightmap(mface_t *surf)
+// adds rectangle to dirty region of lightmap, merging it with existing one
+// if that doesn't upload too many extra texels or there are no free slots
+static void add_dirty_rect(lightmap_t *m, int s0, int t0, int s1, int t1)
 {
-    int s0, t0, s1, t1;
+    lmrect_t *r, *best = NULL;
+    int i, w, h, waste, best_waste = INT_MAX;
+
+    // whole rows are uploaded without sub-image unpacking
+    if (!(gl_config.caps & QGL_CAP_UNPACK_SUBIMAGE)) {
+        s0 = 0;
+        s1 = lm.block_size;
+    }
+
+    for (i = 0, r = m->dirty; i < m->numdirty; i++, r++) {
+        w = max(r->maxs[0], s1) - min(r->mins[0], s0);
+        h = max(r->maxs[1], t1) - min(r->mins[1], t0);
+        waste = w * h - (r->maxs[0] - r->mins[0]) * (r->maxs[1] - r->mins[1]) - (s1 - s0) * (t1 - t0);
+        if (waste < best_waste) {
+            best_waste = waste;
+            best = r;
+        }
+    }
 
+    if (!best || (best_waste > LM_MERGE_WASTE && m->numdirty < LM_MAX_DIRTY_RECTS)) {
+        r = &m->dirty[m->numdirty++];
+        r->mins[0] = s0;
+        r->mins[1] = t0;
+        r->maxs[0] = s1;
+        r->maxs[1] = t1;
+        return;
+    }
+
+    best->mins[0] = min(best->mins[0], s0);
+    best->mins[1] = min(best->mins[1], t0);
+    best->maxs[0] = max(best->maxs[0], s1);
+    best->maxs[1] = max(best->maxs[1], t1);
+}
+
+static void update_dynamic_lightmap(mface_t *surf, uint32_t key)
+{
     // add all the lightmaps
     add_light_styles(surf);
 
     // add all the dynamic lights
-    if (surf->dlightframe == glr.dlightframe)
+    if (key)
         add_dynamic_lights(surf);
     else
         surf->dlightframe = 0;
+    surf->dlightkey = key;
 
     // put into texture format
     put_blocklights(surf);
 
     // add to dirty region
-    s0 = surf->light_s;
-    t0 = surf->light_t;
+    add_dirty_rect(surf->light_m, surf->light_s, surf->light_t,
+                   surf->light_s + surf->lm_width, surf->light_t + surf->lm_height);
 
-    s1 = s0 + surf->lm_width;
-    t1 = t0 + surf->lm_height;
+    c.lightmapsRebuilt++;
+}
 
-    lightmap_t *m = surf->light_m;
+// hashes parameters of dynamic lights affecting the surface, never zero
+static uint32_t dlight_key(const mface_t *surf)
+{
+    uint32_t hash = 2166136261U ^ gl_dlight_falloff->integer;
+    const dlight_t *light;
+    const byte *p;
+    int i, j;
 
-    m->mins[0] = min(m->mins[0], s0);
-    m->mins[1] = min(m->mins[1], t0);
+    for (i = 0, light = glr.fd.dlights; i < glr.fd.num_dlights; i++, light++) {
+        if (!(surf->dlightbits & BIT_ULL(i)))
+            continue;
+        p = (const byte *)light->transformed;
+        for (j = 0; j < sizeof(*light) - offsetof(dlight_t, transformed); j++)
+            hash = (hash ^ p[j]) * 16777619U;
+    }
 
-    m->maxs[0] = max(m->maxs[0], s1);
-    m->maxs[1] = max(m->maxs[1], t1);
+    return hash ? hash : 1;
 }
 
 // updates lightmaps in RAM
 void GL_PushLights(mface_t *surf)
 {
     const lightstyle_t *style;
+    uint32_t key = 0;
     int i;
 
     if (!surf->light_m)
         return;
 
+    // surfaces lit by the same set of lights as before need no update,
+    // unless light styles have changed too
+    if (surf->dlightframe == glr.dlightframe)
+        key = dlight_key(surf);
+
     // dynamic this frame or dynamic previously
-    if (surf->dlightframe) {
-        update_dynamic_lightmap(surf);
+    if (key != surf->dlightkey) {
+        update_dynamic_lightmap(surf, key);
         return;
     }
 
@@ -281,18 +351,18 @@ void GL_PushLights(mface_t *surf)
     for (i = 0; i < surf->numstyles; i++) {
         style = LIGHT_STYLE(surf->styles[i]);
         if (style->white != surf->stylecache[i]) {
-            update_dynamic_lightmap(surf);
+            update_dynamic_lightmap(surf, key);
             return;
         }
     }
+
+    if (key)
+        c.lightmapsCached++;
 }
 
 static void clear_dirty_region(lightmap_t *m)
 {
-    m->mins[0] = lm.block_size;
-    m->mins[1] = lm.block_size;
-    m->maxs[0] = 0;
-    m->maxs[1] = 0;
+    m->numdirty = 0;
 }
 
 // uploads dirty lightmap regions to GL
@@ -300,34 +370,34 @@ void GL_UploadLightmaps(void)
 {
     lightmap_t *m;
     bool set = false;
-    int i;
+    int i, j;
 
     for (i = 0, m = lm.lightmaps; i < lm.nummaps; i++, m++) {
-        int x, y, w, h;
-
-        if (m->mins[0] >= m->maxs[0] || m->mins[1] >= m->maxs[1])
+        if (!m->numdirty)
             continue;
 
-        x = m->mins[0];
-        y = m->mins[1];
-        w = m->maxs[0] - x;
-        h = m->maxs[1] - y;
-
-        if (!(gl_config.caps & QGL_CAP_UNPACK_SUBIMAGE)) {
-            x = 0;
-            w = lm.block_size;
-        } else if (!set) {
+        if ((gl_config.caps & QGL_CAP_UNPACK_SUBIMAGE) && !set) {
             qglPixelStorei(GL_UNPACK_ROW_LENGTH, lm.block_size);
             set = true;
         }
 
-        // upload lightmap subimage
         GL_ForceTexture(TMU_LIGHTMAP, lm.texnums[i]);
-        qglTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h,
-                         GL_RGBA, GL_UNSIGNED_BYTE, LM_PIXELS(m, x, y));
+
+        // upload lightmap subimages
+        for (j = 0; j < m->numdirty; j++) {
+            const lmrect_t *r = &m->dirty[j];
+            int x = r->mins[0];
+            int y = r->mins[1];
+            int w = r->maxs[0] - x;
+            int h = r->maxs[1] - y;
+
+            qglTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h,
+                             GL_RGBA, GL_UNSIGNED_BYTE, LM_PIXELS(m, x, y));
+            c.texUploads++;
+            c.lightTexels += w * h;
+        }
+
         clear_dirty_region(m);
-        c.texUploads++;
-        c.lightTexels += w * h;
     }
 
     if (set)
@@ -458,6 +528,7 @@ static void build_primary_lightmap(mface_t *surf)
     add_light_styles(surf);
 
     surf->dlightframe = 0;
+    surf->dlightkey = 0;
 
     // put into texture format
     put_blocklights(surf);
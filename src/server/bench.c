@@ -0,0 +1,241 @@
+/*
+Copyright (C) 2026 Q2PRO contributors
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+// bench.c -- headless server frame benchmark
+
+#include "server.h"
+
+static struct {
+    bool        active;
+    uint64_t    usec[BENCH_NUM_PHASES];
+} bench;
+
+static const char *const bench_phases[BENCH_NUM_PHASES] = {
+    "game", "build", "encode", "transmit", "mvd"
+};
+
+uint64_t SV_BenchTime(void)
+{
+    return bench.active ? Sys_Microseconds() : 0;
+}
+
+// main thread only
+void SV_BenchAdd(bench_phase_t phase, uint64_t usec)
+{
+    bench.usec[phase] += usec;
+}
+
+// adds time elapsed since `time' to the given phase and restarts timer
+void SV_BenchAccum(bench_phase_t phase, uint64_t *time)
+{
+    uint64_t now;
+
+    if (!bench.active)
+        return;
+
+    now = Sys_Microseconds();
+    bench.usec[phase] += now - *time;
+    *time = now;
+}
+
+// scripted input: run around, strafe, look up and down, jump and fire
+static void bench_usercmd(usercmd_t *cmd, int clientnum, int framenum)
+{
+    int t = framenum + clientnum * 17;
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->msec = SV_FRAMETIME;
+    cmd->angles[YAW] = ANGLE2SHORT(clientnum * 45 + t * 7);
+    cmd->angles[PITCH] = ANGLE2SHORT(t % 40 - 20);
+    cmd->forwardmove = (t / 50) & 1 ? -400 : 400;
+    cmd->sidemove = (t / 20) & 1 ? -200 : 200;
+    if (t % 30 == 0)
+        cmd->upmove = 200;
+    if (t % 10 < 3)
+        cmd->buttons = BUTTON_ATTACK;
+}
+
+// pretend client has received everything sent so far
+static void bench_ack(client_t *client)
+{
+    netchan_t *chan = &client->netchan;
+
+    chan->incoming_acknowledged = chan->outgoing_sequence - 1;
+    chan->incoming_reliable_acknowledged = chan->reliable_sequence;
+    chan->reliable_length = 0;
+
+    client->lastframe = client->framenum - 1;
+    client->lastmessage = svs.realtime;
+}
+
+static client_t *bench_connect(int clientnum)
+{
+    char userinfo[MAX_INFO_STRING];
+    client_t *client;
+
+    Q_snprintf(userinfo, sizeof(userinfo),
+               "\\name\\bench%d\\skin\\male/grunt\\rate\\100000\\hand\\2", clientnum);
+
+    client = SV_AddFakeClient(userinfo, clientnum + 1);
+    if (!client)
+        return NULL;
+
+    client->version_string = SV_CopyString("q2pro benchmark");
+
+    sv_client = client;
+    sv_player = client->edict;
+    SV_New_f();
+    SV_Begin_f();
+    sv_client = NULL;
+    sv_player = NULL;
+
+    if (client->state != cs_spawned) {
+        SV_DropClient(client, NULL);
+        SV_RemoveClient(client);
+        return NULL;
+    }
+
+    return client;
+}
+
+/*
+==================
+SV_BenchFrames_f
+
+Loads a map, connects a number of fake clients feeding scripted input and runs
+server frames as fast as possible, collecting time spent in each phase. Build
+and encode phases are summed over all frame threads.
+==================
+*/
+void SV_BenchFrames_f(void)
+{
+    client_t *clients[MAX_CLIENTS];
+    int i, j, numclients, numframes, connected;
+    uint64_t start, time, total, think, frame, minframe, maxframe;
+    usercmd_t cmd;
+    char *s;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [clients] [frames]\n", Cmd_Argv(0));
+        return;
+    }
+
+    numclients = Cmd_Argc() > 2 ? Q_atoi(Cmd_Argv(2)) : 8;
+    numframes = Cmd_Argc() > 3 ? Q_atoi(Cmd_Argv(3)) : 1000;
+    if (numclients < 1 || numclients > MAX_CLIENTS || numframes < 1) {
+        Com_Printf("Bad number of clients or frames.\n");
+        return;
+    }
+
+    if (!LIST_EMPTY(&sv_clientlist)) {
+        Com_Printf("Can't benchmark while clients are connected.\n");
+        return;
+    }
+
+    // this will drop on error
+    s = va("map \"%s\" force\n", Cmd_Argv(1));
+    Cmd_ExecuteString(&cmd_buffer, s);
+
+    if (sv.state != ss_game) {
+        Com_Printf("Map not loaded.\n");
+        return;
+    }
+
+    if (numclients > svs.maxclients) {
+        Com_Printf("Only %d client slots available, see 'maxclients'.\n", svs.maxclients);
+        numclients = svs.maxclients;
+    }
+
+    for (i = 0; i < numclients; i++) {
+        clients[i] = bench_connect(i);
+        if (!clients[i]) {
+            Com_Printf("Couldn't connect fake client %d.\n", i);
+            numclients = i;
+            goto drop;
+        }
+    }
+
+    Com_Printf("Running %d frames with %d clients on %s...\n", numframes, numclients, sv.name);
+
+    memset(bench.usec, 0, sizeof(bench.usec));
+    bench.active = true;
+
+    minframe = UINT64_MAX;
+    maxframe = 0;
+    start = Sys_Microseconds();
+
+    for (i = 0; i < numframes; i++) {
+        frame = Sys_Microseconds();
+
+        think = SV_BenchTime();
+        for (j = 0; j < numclients; j++) {
+            client_t *client = clients[j];
+
+            if (client->state != cs_spawned)
+                continue;
+
+            bench_ack(client);
+            bench_usercmd(&cmd, j, i);
+
+            sv_client = client;
+            sv_player = client->edict;
+            ge->ClientThink(sv_player, &cmd);
+            client->lastcmd = cmd;
+        }
+        sv_client = NULL;
+        sv_player = NULL;
+        SV_BenchAccum(BENCH_GAME, &think);
+
+        svs.realtime += SV_FRAMETIME;
+        SV_RunWorldFrame();
+
+        frame = Sys_Microseconds() - frame;
+        minframe = min(minframe, frame);
+        maxframe = max(maxframe, frame);
+    }
+
+    total = Sys_Microseconds() - start;
+    bench.active = false;
+
+    connected = 0;
+    for (j = 0; j < numclients; j++)
+        if (clients[j]->state == cs_spawned)
+            connected++;
+
+    Com_Printf("%d frames in %.1f ms, %d clients still connected\n",
+               numframes, total * 1e-3, connected);
+    Com_Printf("frame     avg %6"PRIu64" us, min %"PRIu64" us, max %"PRIu64" us\n",
+               total / numframes, minframe, maxframe);
+
+    time = 0;
+    for (j = 0; j < BENCH_NUM_PHASES; j++) {
+        Com_Printf("%-9s avg %6"PRIu64" us, %5.1f%%\n", bench_phases[j],
+                   bench.usec[j] / numframes, bench.usec[j] * 100.0 / total);
+        time += bench.usec[j];
+    }
+    if (total > time)
+        Com_Printf("%-9s avg %6"PRIu64" us, %5.1f%%\n", "other",
+                   (total - time) / numframes, (total - time) * 100.0 / total);
+
+drop:
+    for (j = 0; j < numclients; j++) {
+        if (clients[j]->state > cs_zombie)
+            SV_DropClient(clients[j], NULL);
+        if (clients[j]->state == cs_zombie)
+            SV_RemoveClient(clients[j]);
+    }
+}
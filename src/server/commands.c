@@ -477,6 +477,8 @@ static int addr_bits(netadrtype_t type)
 }
 
 static void make_mask(netadr_t *mask, netadrtype_t type, int bits);
+static void add_match(addrlist_t *list, const netadr_t *addr,
+                      const netadr_t *mask, int bits, const char *comment);
 
 /*
 ==================
@@ -506,14 +508,12 @@ static void SV_Kick_f(void)
     // optionally ban their IP address
     if (!strcmp(Cmd_Argv(0), "kickban")) {
         netadr_t *addr = &sv_client->netchan.remote_address;
-        if (addr->type == NA_IP || addr->type == NA_IP6) {
-            addrmatch_t *match = Z_Malloc(sizeof(*match));
-            match->addr = *addr;
-            make_mask(&match->mask, addr->type, addr->type == NA_IP6 ? 64 : 32);
-            match->hits = 0;
-            match->time = 0;
-            match->comment[0] = 0;
-            List_Append(&sv_banlist, &match->entry);
+        int bits = addr->type == NA_IP6 ? 64 : 32;
+        if ((addr->type == NA_IP || addr->type == NA_IP6) &&
+            !SV_FindMatch(&sv_banlist, addr, bits)) {
+            netadr_t mask;
+            make_mask(&mask, addr->type, bits);
+            add_match(&sv_banlist, addr, &mask, bits, "");
         }
     }
 
@@ -662,6 +662,21 @@ static void dump_protocols(void)
     }
 }
 
+static void dump_entities(void)
+{
+    client_t    *cl;
+
+    Com_Printf(
+        "num name              rate  deferred throttled supp\n"
+        "--- --------------- ------ --------- --------- ----\n");
+
+    FOR_EACH_CLIENT(cl) {
+        Com_Printf("%3i %-15.15s %6u %9u %9u %4d\n",
+                   cl->number, cl->name, cl->rate, cl->ents_deferred,
+                   cl->ents_throttled, cl->suppress_count);
+    }
+}
+
 static void dump_settings(void)
 {
     client_t    *cl;
@@ -709,13 +724,14 @@ static void SV_Status_f(void)
             char *w = Cmd_Argv(1);
             switch (*w) {
             case 'd': dump_downloads(); break;
+            case 'e': dump_entities();  break;
             case 'l': dump_lag();       break;
             case 'p': dump_protocols(); break;
             case 's': dump_settings();  break;
             case 't': dump_time();      break;
             case 'v': dump_versions();  break;
             default:
-                Com_Printf("Usage: %s [d|l|p|s|t|v]\n", Cmd_Argv(0));
+                Com_Printf("Usage: %s [d|e|l|p|s|t|v]\n", Cmd_Argv(0));
                 dump_clients();
                 break;
             }
@@ -1057,7 +1073,7 @@ static void make_mask(netadr_t *mask, netadrtype_t type, int bits)
     }
 }
 
-static bool parse_mask(char *s, netadr_t *addr, netadr_t *mask)
+static bool parse_mask(char *s, netadr_t *addr, netadr_t *mask, int *bits_p)
 {
     int bits, size;
     char *p;
@@ -1091,23 +1107,37 @@ static bool parse_mask(char *s, netadr_t *addr, netadr_t *mask)
     }
 
     make_mask(mask, addr->type, bits);
+    *bits_p = bits;
     return true;
 }
 
 static size_t format_mask(addrmatch_t *match, char *buf, size_t buf_size)
 {
-    int i;
-    for (i = 0; i < addr_bits(match->mask.type) && match->mask.ip.u8[i >> 3] & (1 << (7 - (i & 7))); i++)
-        ;
-    return Q_snprintf(buf, buf_size, "%s/%d", NET_BaseAdrToString(&match->addr), i);
+    return Q_snprintf(buf, buf_size, "%s/%d", NET_BaseAdrToString(&match->addr), match->bits);
 }
 
-void SV_AddMatch_f(list_t *list)
+static void add_match(addrlist_t *list, const netadr_t *addr,
+                      const netadr_t *mask, int bits, const char *comment)
+{
+    addrmatch_t *match;
+    size_t len = strlen(comment);
+
+    match = Z_Malloc(sizeof(*match) + len);
+    match->addr = *addr;
+    match->mask = *mask;
+    match->bits = bits;
+    match->hits = 0;
+    match->time = 0;
+    memcpy(match->comment, comment, len + 1);
+    SV_AddMatch(list, match);
+}
+
+void SV_AddMatch_f(addrlist_t *list)
 {
     char *s, buf[MAX_QPATH];
     addrmatch_t *match;
     netadr_t addr, mask;
-    size_t len;
+    int bits;
 
     if (Cmd_Argc() < 2) {
         Com_Printf("Usage: %s <address[/mask]> [comment]\n", Cmd_Argv(0));
@@ -1115,98 +1145,143 @@ void SV_AddMatch_f(list_t *list)
     }
 
     s = Cmd_Argv(1);
-    if (!parse_mask(s, &addr, &mask)) {
+    if (!parse_mask(s, &addr, &mask, &bits)) {
         return;
     }
 
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if (NET_IsEqualBaseAdr(&match->addr, &addr) &&
-            NET_IsEqualBaseAdr(&match->mask, &mask)) {
-            format_mask(match, buf, sizeof(buf));
-            Com_Printf("Entry %s already exists.\n", buf);
-            return;
-        }
+    match = SV_FindMatch(list, &addr, bits);
+    if (match) {
+        format_mask(match, buf, sizeof(buf));
+        Com_Printf("Entry %s already exists.\n", buf);
+        return;
     }
 
-    s = Cmd_ArgsFrom(2);
-    len = strlen(s);
-    match = Z_Malloc(sizeof(*match) + len);
-    match->addr = addr;
-    match->mask = mask;
-    match->hits = 0;
-    match->time = 0;
-    memcpy(match->comment, s, len + 1);
-    List_Append(list, &match->entry);
+    add_match(list, &addr, &mask, bits, Cmd_ArgsFrom(2));
 }
 
-void SV_DelMatch_f(list_t *list)
+void SV_DelMatch_f(addrlist_t *list)
 {
     char *s;
-    addrmatch_t *match, *next;
+    addrmatch_t *match;
     netadr_t addr, mask;
-    int i;
+    int i, bits;
 
     if (Cmd_Argc() < 2) {
         Com_Printf("Usage: %s <address[/mask]|id|all>\n", Cmd_Argv(0));
         return;
     }
 
-    if (LIST_EMPTY(list)) {
+    if (LIST_EMPTY(&list->list)) {
         Com_Printf("Address list is empty.\n");
         return;
     }
 
     s = Cmd_Argv(1);
     if (!strcmp(s, "all")) {
-        LIST_FOR_EACH_SAFE(addrmatch_t, match, next, list, entry) {
-            Z_Free(match);
-        }
-        List_Init(list);
+        SV_ClearMatches(list);
         return;
     }
 
     // numeric values are just slot numbers
     if (COM_IsUint(s)) {
         i = Q_atoi(s);
-        match = LIST_INDEX(addrmatch_t, i - 1, list, entry);
+        match = LIST_INDEX(addrmatch_t, i - 1, &list->list, entry);
         if (match) {
-            goto remove;
+            SV_RemoveMatch(list, match);
+            return;
         }
         Com_Printf("No such index: %d\n", i);
         return;
     }
 
-    if (!parse_mask(s, &addr, &mask)) {
+    if (!parse_mask(s, &addr, &mask, &bits)) {
         return;
     }
 
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if (NET_IsEqualBaseAdr(&match->addr, &addr) &&
-            NET_IsEqualBaseAdr(&match->mask, &mask)) {
-remove:
-            List_Remove(&match->entry);
-            Z_Free(match);
-            return;
-        }
+    match = SV_FindMatch(list, &addr, bits);
+    if (match) {
+        SV_RemoveMatch(list, match);
+        return;
     }
     Com_Printf("No such entry: %s\n", s);
 }
 
-void SV_ListMatches_f(list_t *list)
+/*
+==================
+SV_LoadMatches_f
+
+Adds entries from a text file, one address[/mask] per line, optionally
+followed by a comment. Lines starting with '#' or '/' are ignored.
+==================
+*/
+void SV_LoadMatches_f(addrlist_t *list)
+{
+    char *raw, *data, *p, *comment;
+    netadr_t addr, mask;
+    int ret, bits, added = 0, skipped = 0;
+
+    if (Cmd_Argc() != 2) {
+        Com_Printf("Usage: %s <filename>\n", Cmd_Argv(0));
+        return;
+    }
+
+    ret = FS_LoadFile(Cmd_Argv(1), (void **)&raw);
+    if (!raw) {
+        Com_Printf("Couldn't load %s: %s\n", Cmd_Argv(1), Q_ErrorString(ret));
+        return;
+    }
+
+    for (data = raw; *data; data = p + 1) {
+        p = strchr(data, '\n');
+        if (p) {
+            *p = 0;
+        }
+
+        while (*data == ' ' || *data == '\t' || *data == '\r') {
+            data++;
+        }
+
+        if (*data && *data != '#' && *data != '/') {
+            comment = data + strcspn(data, " \t\r");
+            if (*comment) {
+                *comment++ = 0;
+                comment += strspn(comment, " \t");
+                comment[strcspn(comment, "\r")] = 0;
+            }
+            if (parse_mask(data, &addr, &mask, &bits) &&
+                !SV_FindMatch(list, &addr, bits)) {
+                add_match(list, &addr, &mask, bits, comment);
+                added++;
+            } else {
+                skipped++;
+            }
+        }
+
+        if (!p) {
+            break;
+        }
+    }
+
+    FS_FreeFile(raw);
+
+    Com_Printf("Added %d entries, skipped %d duplicate or invalid.\n", added, skipped);
+}
+
+void SV_ListMatches_f(addrlist_t *list)
 {
     addrmatch_t *match;
     char last[MAX_QPATH];
     char addr[MAX_QPATH];
     int id = 0;
 
-    if (LIST_EMPTY(list)) {
+    if (LIST_EMPTY(&list->list)) {
         Com_Printf("Address list is empty.\n");
         return;
     }
 
     Com_Printf("id address/mask       hits last hit     comment\n"
                "-- ------------------ ---- ------------ -------\n");
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
+    LIST_FOR_EACH(addrmatch_t, match, &list->list, entry) {
         format_mask(match, addr, sizeof(addr));
         if (!match->time) {
             strcpy(last, "never");
@@ -1232,6 +1307,10 @@ static void SV_ListBans_f(void)
 {
     SV_ListMatches_f(&sv_banlist);
 }
+static void SV_LoadBans_f(void)
+{
+    SV_LoadMatches_f(&sv_banlist);
+}
 
 static void SV_AddBlackHole_f(void)
 {
@@ -1245,6 +1324,10 @@ static void SV_ListBlackHoles_f(void)
 {
     SV_ListMatches_f(&sv_blacklist);
 }
+static void SV_LoadBlackHoles_f(void)
+{
+    SV_LoadMatches_f(&sv_blacklist);
+}
 
 static void SV_AddStuffCmd(list_t *list, int arg, const char *what)
 {
@@ -1769,6 +1852,8 @@ static const cmdreg_t c_server[] = {
     { "demomap", SV_DemoMap_f, SV_DemoMap_c },
     { "gamemap", SV_GameMap_f, SV_Map_c },
     { "dumpents", SV_DumpEnts_f },
+    { "areastats", SV_AreaStats_f },
+    { "deltastats", SV_DeltaStats_f },
     { "setmaster", SV_SetMaster_f },
     { "listmasters", SV_ListMasters_f },
     { "killserver", SV_KillServer_f },
@@ -1777,9 +1862,11 @@ static const cmdreg_t c_server[] = {
     { "addban", SV_AddBan_f },
     { "delban", SV_DelBan_f },
     { "listbans", SV_ListBans_f },
+    { "loadbans", SV_LoadBans_f },
     { "addblackhole", SV_AddBlackHole_f },
     { "delblackhole", SV_DelBlackHole_f },
     { "listblackholes", SV_ListBlackHoles_f },
+    { "loadblackholes", SV_LoadBlackHoles_f },
     { "addstuffcmd", SV_AddStuffCmd_f, SV_StuffCmd_c },
     { "delstuffcmd", SV_DelStuffCmd_f, SV_StuffCmd_c },
     { "liststuffcmds", SV_ListStuffCmds_f, SV_StuffCmd_c },
@@ -1814,6 +1901,10 @@ void SV_InitOperatorCommands(void)
 {
     Cmd_Register(c_server);
 
-    if (COM_DEDICATED)
+    if (COM_DEDICATED) {
         Cmd_AddCommand("say", SV_ConSay_f);
+#if USE_TESTS
+        Cmd_AddCommand("benchframes", SV_BenchFrames_f);
+#endif
+    }
 }
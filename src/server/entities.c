@@ -17,6 +17,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "server.h"
+#include "system/pthread.h"
 
 /*
 =============================================================================
@@ -125,6 +126,209 @@ static bool SV_TruncPacketEntities(client_t *client, const client_frame_t *from,
     return ret;
 }
 
+/*
+=============================================================================
+
+Delta entity cache
+
+Clients that acknowledged the same frame receive identical delta updates for
+the same entity. Encoded updates are kept for the duration of server frame
+and spliced into messages of other clients. Frames may be built by multiple
+threads, so hash buckets are protected by striped locks.
+
+=============================================================================
+*/
+
+#define DELTA_HASH_SIZE     4096
+#define DELTA_STRIPES       16
+#define DELTA_ENTRIES       8192    // per frame, split between stripes
+
+// compare only meaningful bytes of entity_packed_t, ignoring padding
+#define DELTA_STATE_SIZE    (offsetof(entity_packed_t, loop_attenuation) + 1)
+
+typedef struct deltaentry_s {
+    struct deltaentry_s *next;
+    uint32_t        hash;
+    msgEsFlags_t    flags;
+    entity_packed_t from, to;
+    unsigned        len;
+    byte            data[MAX_PACKETENTITY_BYTES];
+} deltaentry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int             numentries;
+    uint64_t        hits, misses, overflows, bytes;
+} deltastripe_t;
+
+static struct {
+    deltaentry_t    *buckets[DELTA_HASH_SIZE];
+    deltaentry_t    *entries;   // [DELTA_ENTRIES]
+    deltastripe_t   stripes[DELTA_STRIPES];
+    bool            active;
+} delta_cache;
+
+static uint32_t SV_HashDeltaState(uint32_t hash, const entity_packed_t *s)
+{
+    const byte *p = (const byte *)s;
+    uint32_t w;
+    int i;
+
+    for (i = 0; i + 4 <= DELTA_STATE_SIZE; i += 4) {
+        memcpy(&w, p + i, 4);
+        hash = (hash ^ w) * 0x9e3779b1;
+        hash ^= hash >> 15;
+    }
+    for (; i < DELTA_STATE_SIZE; i++)
+        hash = (hash ^ p[i]) * 0x9e3779b1;
+
+    return hash;
+}
+
+/*
+=============
+SV_ClearDeltaCache
+
+Called once per server frame before client frames are built.
+=============
+*/
+void SV_ClearDeltaCache(void)
+{
+    int i;
+
+    delta_cache.active = sv_delta_cache->integer && sv.state == ss_game;
+    if (!delta_cache.active)
+        return;
+
+    if (!delta_cache.entries) {
+        delta_cache.entries = SV_Malloc(sizeof(delta_cache.entries[0]) * DELTA_ENTRIES);
+        for (i = 0; i < DELTA_STRIPES; i++)
+            pthread_mutex_init(&delta_cache.stripes[i].lock, NULL);
+    }
+
+    memset(delta_cache.buckets, 0, sizeof(delta_cache.buckets));
+    for (i = 0; i < DELTA_STRIPES; i++)
+        delta_cache.stripes[i].numentries = 0;
+}
+
+void SV_ShutdownDeltaCache(void)
+{
+    int i;
+
+    if (!delta_cache.entries)
+        return;
+
+    for (i = 0; i < DELTA_STRIPES; i++)
+        pthread_mutex_destroy(&delta_cache.stripes[i].lock);
+
+    Z_Free(delta_cache.entries);
+    memset(&delta_cache, 0, sizeof(delta_cache));
+}
+
+/*
+=============
+SV_WriteDeltaEntity
+
+Same as MSG_WriteDeltaEntity, but reuses output already encoded for other
+clients during this server frame.
+=============
+*/
+static void SV_WriteDeltaEntity(const entity_packed_t *from,
+                                const entity_packed_t *to,
+                                msgEsFlags_t flags)
+{
+    deltastripe_t *stripe;
+    deltaentry_t *entry;
+    uint32_t hash;
+    unsigned start, len;
+    int index;
+
+    if (!delta_cache.active) {
+        MSG_WriteDeltaEntity(from, to, flags);
+        return;
+    }
+
+    hash = SV_HashDeltaState(flags, from);
+    hash = SV_HashDeltaState(hash, to);
+    index = hash & (DELTA_HASH_SIZE - 1);
+    stripe = &delta_cache.stripes[index & (DELTA_STRIPES - 1)];
+
+    pthread_mutex_lock(&stripe->lock);
+    for (entry = delta_cache.buckets[index]; entry; entry = entry->next) {
+        if (entry->hash == hash && entry->flags == flags &&
+            !memcmp(&entry->from, from, DELTA_STATE_SIZE) &&
+            !memcmp(&entry->to, to, DELTA_STATE_SIZE)) {
+            SZ_Write(&msg_write, entry->data, entry->len);
+            stripe->hits++;
+            stripe->bytes += entry->len;
+            pthread_mutex_unlock(&stripe->lock);
+            return;
+        }
+    }
+    stripe->misses++;
+    pthread_mutex_unlock(&stripe->lock);
+
+    start = msg_write.cursize;
+    MSG_WriteDeltaEntity(from, to, flags);
+    len = msg_write.cursize - start;
+    if (msg_write.overflowed || len > MAX_PACKETENTITY_BYTES)
+        return;
+
+    pthread_mutex_lock(&stripe->lock);
+    if (stripe->numentries == DELTA_ENTRIES / DELTA_STRIPES) {
+        stripe->overflows++;
+    } else {
+        index = (stripe - delta_cache.stripes) * (DELTA_ENTRIES / DELTA_STRIPES) + stripe->numentries++;
+        entry = &delta_cache.entries[index];
+        entry->hash = hash;
+        entry->flags = flags;
+        entry->from = *from;
+        entry->to = *to;
+        entry->len = len;
+        memcpy(entry->data, msg_write.data + start, len);
+        index = hash & (DELTA_HASH_SIZE - 1);
+        entry->next = delta_cache.buckets[index];
+        delta_cache.buckets[index] = entry;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+/*
+=============
+SV_DeltaStats_f
+=============
+*/
+void SV_DeltaStats_f(void)
+{
+    uint64_t hits = 0, misses = 0, overflows = 0, bytes = 0;
+    deltastripe_t *stripe;
+    int i;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        for (i = 0, stripe = delta_cache.stripes; i < DELTA_STRIPES; i++, stripe++)
+            stripe->hits = stripe->misses = stripe->overflows = stripe->bytes = 0;
+        return;
+    }
+
+    for (i = 0, stripe = delta_cache.stripes; i < DELTA_STRIPES; i++, stripe++) {
+        hits += stripe->hits;
+        misses += stripe->misses;
+        overflows += stripe->overflows;
+        bytes += stripe->bytes;
+    }
+
+    if (!sv_delta_cache->integer)
+        Com_Printf("Delta cache is disabled.\n");
+
+    Com_Printf("%"PRIu64" hits, %"PRIu64" misses, %"PRIu64" overflows\n",
+               hits, misses, overflows);
+    if (!hits && !misses)
+        return;
+
+    Com_Printf("%.1f%% hit rate, %"PRIu64" bytes reused\n",
+               hits * 100.0 / (hits + misses), bytes);
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -189,7 +393,7 @@ static bool SV_EmitPacketEntities(client_t *client, const client_frame_t *from,
                 VectorCopy(oldent->origin, newent->origin);
                 VectorCopy(oldent->angles, newent->angles);
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             oldindex++;
             newindex++;
             continue;
@@ -209,7 +413,7 @@ static bool SV_EmitPacketEntities(client_t *client, const client_frame_t *from,
                 VectorCopy(oldent->origin, newent->origin);
                 VectorCopy(oldent->angles, newent->angles);
             }
-            MSG_WriteDeltaEntity(oldent, newent, flags);
+            SV_WriteDeltaEntity(oldent, newent, flags);
             newindex++;
             continue;
         }
@@ -484,19 +688,223 @@ static bool SV_EntityAttenuatedAway(const vec3_t org, const edict_t *ent)
     return dist * mult > 1.0f;
 }
 
+/*
+=============
+SV_UpdateCullEntity
+
+Copies link data of the entity into the culling mirror.
+Called by PF_LinkEdict after the entity has been linked.
+=============
+*/
+void SV_UpdateCullEntity(const edict_t *ent, int e)
+{
+    cull_entities_t *c = &sv.cull;
+
+    c->areas[0][e] = ent->areanum;
+    c->areas[1][e] = ent->areanum2;
+    c->num_clusters[e] = ent->num_clusters;
+    c->headnode[e] = ent->headnode;
+    c->linkcount[e] = ent->linkcount;
+    if (ent->num_clusters > 0)
+        memcpy(c->clusters[e], ent->clusternums, sizeof(c->clusters[0][0]) * ent->num_clusters);
+}
+
+/*
+=============
+SV_PrepareCullEntities
+
+Gathers per-frame entity state into the culling mirror. Called once per
+server frame before client frames are built, possibly in parallel.
+=============
+*/
+void SV_PrepareCullEntities(void)
+{
+    cull_entities_t *c = &sv.cull;
+    edict_t *ent;
+    int e, flags;
+
+    c->num_edicts = 0;
+
+    if (!ge || sv.state != ss_game)
+        return;
+
+    for (e = 1; e < ge->num_edicts; e++) {
+        ent = EDICT_NUM(e);
+
+        // edict may have been freed and reused without linking
+        if (ent->linkcount != c->linkcount[e])
+            SV_UpdateCullEntity(ent, e);
+
+        flags = 0;
+        if (!ent->inuse)
+            flags |= CULL_FREE;
+        if (ent->svflags & SVF_NOCLIENT)
+            flags |= CULL_NOCLIENT;
+        if (!HAS_EFFECTS(ent))
+            flags |= CULL_NOEFFECTS;
+        if (ent->s.effects & (EF_GIB | EF_GREENGIB))
+            flags |= CULL_GIB;
+        if ((ent->s.effects & EF_GIB && !(ent->s.effects & EF_ROCKET)) || ent->s.effects & EF_GREENGIB)
+            flags |= CULL_GIB_EXT;
+        if (ent->s.renderfx & RF_FLARE)
+            flags |= CULL_FLARE;
+        if (ent->svflags & SVF_NOCULL)
+            flags |= CULL_NOCULL;
+        if (ent->s.renderfx & RF_BEAM)
+            flags |= CULL_BEAM;
+        if (ent->s.sound)
+            flags |= CULL_SOUND;
+        if (ent->s.modelindex)
+            flags |= CULL_MODEL;
+
+        c->flags[e] = flags;
+        c->origin[0][e] = ent->s.origin[0];
+        c->origin[1][e] = ent->s.origin[1];
+        c->origin[2][e] = ent->s.origin[2];
+    }
+
+    c->num_edicts = ge->num_edicts;
+}
+
+static bool SV_CullVisible(const client_t *client, int e, const visrow_t *mask)
+{
+    const cull_entities_t *c = &sv.cull;
+
+    if (c->num_clusters[e] == -1)
+        return CM_HeadnodeVisible(CM_NodeNum(client->cm, c->headnode[e]), mask->b);
+
+    for (int i = 0; i < c->num_clusters[e]; i++)
+        if (Q_IsBitSet(mask->b, c->clusters[e][i]))
+            return true;
+
+    return false;
+}
+
+static float SV_CullDistanceSquared(const vec3_t org, int e)
+{
+    const cull_entities_t *c = &sv.cull;
+    float x = c->origin[0][e] - org[0];
+    float y = c->origin[1][e] - org[1];
+    float z = c->origin[2][e] - org[2];
+
+    return x * x + y * y + z * z;
+}
+
+/*
+=============
+SV_CullEntities
+
+Equivalent of the per-edict loop in SV_BuildClientFrame that works on the
+culling mirror. Flag and area checks are done first in a branch free pass
+over dense arrays the compiler can vectorize, only entities that survive it
+are tested against PVS/PHS.
+=============
+*/
+static int SV_CullEntities(client_t *client, const vec3_t org, int clientarea,
+                           const visrow_t *clientpvs, const visrow_t *clientphs,
+                           qboolean (*visible)(edict_t *, edict_t *),
+                           edict_t **edicts, int max_packet_entities)
+{
+    const cull_entities_t *c = &sv.cull;
+    byte        areas[MAX_MAP_AREAS];
+    byte        pass[MAX_EDICTS];
+    int         e, num_edicts, reject, nocull;
+    bool        novis = sv_novis->integer;
+    bool        extended = client->csr->extended;
+    edict_t     *ent, *clent = client->edict;
+
+    reject = CULL_NOCLIENT | CULL_NOEFFECTS;
+    if (g_features->integer & GMF_PROPERINUSE)
+        reject |= CULL_FREE;
+    if (client->settings[CLS_NOGIBS])
+        reject |= extended ? CULL_GIB_EXT : CULL_GIB;
+    if (extended && client->settings[CLS_NOFLARES])
+        reject |= CULL_FLARE;
+
+    if (novis) {
+        nocull = 0;
+        memset(areas, 1, sizeof(areas));
+    } else {
+        nocull = extended ? CULL_NOCULL : 0;
+        CM_ConnectedAreas(client->cm, areas, clientarea);
+    }
+
+    // 0 - rejected, 1 - needs vis check, 2 - accepted
+    for (e = 1; e < c->num_edicts; e++) {
+        int flags = c->flags[e];
+        int skip = novis | ((flags & nocull) != 0);
+        int ok = ((flags & reject) == 0) & (areas[c->areas[0][e]] | areas[c->areas[1][e]] | skip);
+        pass[e] = ok << skip;
+    }
+
+    // own entity is never culled
+    e = NUM_FOR_EDICT(clent);
+    if (e < c->num_edicts)
+        pass[e] = ((c->flags[e] & reject) == 0) << 1;
+
+    num_edicts = 0;
+    for (e = 1; e < c->num_edicts; e++) {
+        if (!pass[e])
+            continue;
+
+        ent = EDICT_NUM(e);
+
+        if (pass[e] == 1) {
+            int flags = c->flags[e];
+
+            // beams just check one point for PHS
+            bool beam_cull = flags & CULL_BEAM;
+
+            // remaster uses different sound culling rules
+            bool sound_cull = extended && flags & CULL_SOUND;
+
+            if (!SV_CullVisible(client, e, (beam_cull || sound_cull) ? clientphs : clientpvs))
+                continue;
+
+            // don't send sounds if they will be attenuated away
+            if (sound_cull) {
+                if (SV_EntityAttenuatedAway(org, ent)) {
+                    if (!(flags & CULL_MODEL))
+                        continue;
+                    if (!beam_cull && !SV_CullVisible(client, e, clientpvs))
+                        continue;
+                }
+            } else if (!(flags & CULL_MODEL)) {
+                if (SV_CullDistanceSquared(org, e) > 400 * 400)
+                    continue;
+            }
+        }
+
+        SV_CheckEntityNumber(ent, e);
+
+        // optionally skip it
+        if (visible && !visible(clent, ent))
+            continue;
+
+        edicts[num_edicts++] = ent;
+
+        if (num_edicts == max_packet_entities && !sv_prioritize_entities->integer)
+            break;
+    }
+
+    return num_edicts;
+}
+
 #define IS_MONSTER(ent) \
     ((ent->svflags & (SVF_MONSTER | SVF_DEADMONSTER)) == SVF_MONSTER || (ent->s.renderfx & RF_FRAMELERP))
 
 #define IS_HI_PRIO(ent) \
-    (ent->s.number <= sv_client->maxclients || IS_MONSTER(ent) || ent->solid == SOLID_BSP)
+    (ent->s.number <= sort_client->maxclients || IS_MONSTER(ent) || ent->solid == SOLID_BSP)
 
 #define IS_GIB(ent) \
-    (sv_client->csr->extended ? (ent->s.renderfx & RF_LOW_PRIORITY) : (ent->s.effects & (EF_GIB | EF_GREENGIB)))
+    (sort_client->csr->extended ? (ent->s.renderfx & RF_LOW_PRIORITY) : (ent->s.effects & (EF_GIB | EF_GREENGIB)))
 
 #define IS_LO_PRIO(ent) \
     (IS_GIB(ent) || (!ent->s.modelindex && !ent->s.effects))
 
-static vec3_t clientorg;
+// frames may be built by multiple threads at once
+static q_thread_local const client_t *sort_client;
+static q_thread_local vec3_t clientorg;
 
 static int entpriocmp(const void *p1, const void *p2)
 {
@@ -527,6 +935,220 @@ static int entnumcmp(const void *p1, const void *p2)
     return a->s.number - b->s.number;
 }
 
+/*
+=============================================================================
+
+Entity update scheduling
+
+Updates of far away entities that are only moving are sent at a lower rate,
+interleaved across frames by entity number. When a bandwidth budget is
+enforced, more of them are deferred, farthest first, to keep the frame under
+the limit checked by SV_RateDrop. Deferred entities keep the state stored in
+previous frame, so delta compression from any acknowledged frame stays
+consistent.
+
+=============================================================================
+*/
+
+#define SCHED_MAX_TIERS     3
+
+typedef struct {
+    entity_packed_t         *state;
+    const entity_packed_t   *prev;
+    float                   dist;
+    int                     cost;
+} schedent_t;
+
+// true if only origin, angles and animation frame changed
+static bool motion_only(const entity_packed_t *from, const entity_packed_t *to)
+{
+    entity_packed_t temp = *to;
+
+    VectorCopy(from->origin, temp.origin);
+    VectorCopy(from->angles, temp.angles);
+    VectorCopy(from->old_origin, temp.old_origin);
+    temp.frame = from->frame;
+
+    return !memcmp(&temp, from, DELTA_STATE_SIZE);
+}
+
+// rough size of delta update, 0 if nothing changed
+static int estimate_delta(const entity_packed_t *from, const entity_packed_t *to)
+{
+    int i, bytes = 0;
+
+    for (i = 0; i < 3; i++) {
+        if (to->origin[i] != from->origin[i])
+            bytes += 2;
+        if (to->angles[i] != from->angles[i])
+            bytes += 1;
+    }
+    if (to->frame != from->frame)
+        bytes += 1;
+
+    if (!motion_only(from, to))
+        bytes += 8;
+
+    return bytes ? bytes + 3 : 0;
+}
+
+// bytes this frame may take without going over client rate
+static int frame_budget(const client_t *client)
+{
+    int64_t limit;
+    int i;
+
+    // never drop over the loopback
+    if (!client->rate)
+        return INT_MAX;
+
+    limit = client->rate;
+#if USE_FPS
+    limit = limit * client->framediv / sv.frametime.div;
+#endif
+
+    for (i = 0; i < RATE_MESSAGES; i++)
+        if (i != client->framenum % RATE_MESSAGES)
+            limit -= client->message_size[i];
+
+    // leave space for pending reliable data and player state
+    limit -= client->netchan.message.cursize + 64;
+
+    return max(limit, 0);
+}
+
+static const client_frame_t *sched_prev_frame(const client_t *client)
+{
+    const client_frame_t *frame;
+    int i, n;
+
+    for (i = 1; i < UPDATE_BACKUP; i++) {
+        n = client->framenum - i;
+        if (n <= 0)
+            break;
+        frame = &client->frames[n & UPDATE_MASK];
+        if (frame->number != n)
+            continue;   // not built, try older one
+        if (client->next_entity - frame->first_entity > client->num_entities)
+            break;      // entities are too old
+        return frame;
+    }
+
+    return NULL;
+}
+
+static int schedcmp(const void *p1, const void *p2)
+{
+    const schedent_t *a = p1;
+    const schedent_t *b = p2;
+
+    if (a->dist < b->dist)
+        return 1;
+    if (a->dist > b->dist)
+        return -1;
+    return a->state->number - b->state->number;
+}
+
+/*
+=============
+SV_ScheduleEntities
+
+Replaces states of entities that don't need update this frame with states
+from previous frame. Players, inline BSP models, entities that just appeared
+and entities with events or other than motion changes are always updated.
+=============
+*/
+static void SV_ScheduleEntities(client_t *client, const client_frame_t *frame, const vec3_t org)
+{
+    const client_frame_t *prevframe;
+    const entity_packed_t *prev, *base;
+    entity_packed_t *state;
+    const edict_t *ent;
+    schedent_t sched[MAX_PACKET_ENTITIES];
+    int i, j, e, cost, tier, maxtier, mask, budget, total, numsched;
+    float dist, tierdist;
+
+    maxtier = Q_clip(sv_entity_tiers->integer, 0, SCHED_MAX_TIERS);
+    budget = sv_entity_budget->integer ? frame_budget(client) : INT_MAX;
+    if (!maxtier && budget == INT_MAX)
+        return;
+
+    prevframe = sched_prev_frame(client);
+    if (!prevframe)
+        return;
+
+    tierdist = max(sv_entity_tier_dist->value, 64.0f);
+    mask = client->num_entities - 1;
+    total = numsched = 0;
+
+    for (i = j = 0; i < frame->num_entities; i++) {
+        state = &client->entities[(frame->first_entity + i) & mask];
+        e = state->number;
+
+        // find entity in previous frame
+        prev = NULL;
+        for (; j < prevframe->num_entities; j++) {
+            const entity_packed_t *p = &client->entities[(prevframe->first_entity + j) & mask];
+            if (p->number >= e) {
+                if (p->number == e)
+                    prev = p;
+                break;
+            }
+        }
+
+        if (!prev) {
+            base = client->baselines[e >> SV_BASELINES_SHIFT];
+            if (base)
+                base += e & SV_BASELINES_MASK;
+            else
+                base = &nullEntityState;
+            total += estimate_delta(base, state);
+            continue;
+        }
+
+        cost = estimate_delta(prev, state);
+        if (!cost)
+            continue;
+
+        ent = EDICT_NUM2(client->ge, e);
+        if (e <= client->maxclients || ent->solid == SOLID_BSP ||
+            state->event || !motion_only(prev, state)) {
+            total += cost;
+            continue;
+        }
+
+        dist = Distance(org, ent->s.origin);
+        tier = min(dist / tierdist, maxtier);
+        if ((client->framenum + e) & ((1 << tier) - 1)) {
+            *state = *prev;
+            state->event = 0;
+            client->ents_deferred++;
+            continue;
+        }
+
+        total += cost;
+        if (numsched < q_countof(sched)) {
+            sched[numsched].state = state;
+            sched[numsched].prev = prev;
+            sched[numsched].dist = dist;
+            sched[numsched].cost = cost;
+            numsched++;
+        }
+    }
+
+    if (total <= budget)
+        return;
+
+    // over budget, defer more updates starting from farthest entities
+    qsort(sched, numsched, sizeof(sched[0]), schedcmp);
+    for (i = 0; i < numsched && total > budget; i++) {
+        *sched[i].state = *sched[i].prev;
+        sched[i].state->event = 0;
+        total -= sched[i].cost;
+        client->ents_throttled++;
+    }
+}
+
 /*
 =============
 SV_BuildClientFrame
@@ -545,7 +1167,8 @@ void SV_BuildClientFrame(client_t *client)
     entity_packed_t *state;
     const mleaf_t   *leaf;
     int         clientarea, clientcluster;
-    visrow_t    clientphs;
+    visrow_t    phsrow;
+    const visrow_t  *clientphs;
     visrow_t    clientpvs;
     bool        need_clientnum_fix;
     int         max_packet_entities;
@@ -617,94 +1240,96 @@ void SV_BuildClientFrame(client_t *client)
     }
 
     CM_FatPVS(client->cm, &clientpvs, org);
-    BSP_ClusterVis(client->cm->cache, &clientphs, clientcluster, DVIS_PHS);
+    clientphs = BSP_GetClusterVis(client->cm->cache, &phsrow, clientcluster, DVIS_PHS);
 
     // build up the list of visible entities
     frame->num_entities = 0;
     frame->first_entity = client->next_entity;
 
-    num_edicts = 0;
-    for (e = 1; e < client->ge->num_edicts; e++) {
-        ent = EDICT_NUM2(client->ge, e);
-
-        // ignore entities not in use
-        if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
-            continue;
-
-        // ignore ents without visible models
-        if (ent->svflags & SVF_NOCLIENT)
-            continue;
+    if (client->ge == ge && sv.cull.num_edicts) {
+        num_edicts = SV_CullEntities(client, org, clientarea, &clientpvs, clientphs,
+                                     visible, edicts, max_packet_entities);
+    } else {
+        num_edicts = 0;
+        for (e = 1; e < client->ge->num_edicts; e++) {
+            ent = EDICT_NUM2(client->ge, e);
 
-        // ignore ents without visible models unless they have an effect
-        if (!HAS_EFFECTS(ent))
-            continue;
+            // ignore entities not in use
+            if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
+                continue;
 
-        // ignore gibs if client says so
-        if (client->settings[CLS_NOGIBS]) {
-            if (ent->s.effects & EF_GIB && !(client->csr->extended && ent->s.effects & EF_ROCKET))
+            // ignore ents without visible models
+            if (ent->svflags & SVF_NOCLIENT)
                 continue;
-            if (ent->s.effects & EF_GREENGIB)
+
+            // ignore ents without visible models unless they have an effect
+            if (!HAS_EFFECTS(ent))
                 continue;
-        }
 
-        // ignore flares if client says so
-        if (client->csr->extended && ent->s.renderfx & RF_FLARE && client->settings[CLS_NOFLARES])
-            continue;
+            // ignore gibs if client says so
+            if (client->settings[CLS_NOGIBS]) {
+                if (ent->s.effects & EF_GIB && !(client->csr->extended && ent->s.effects & EF_ROCKET))
+                    continue;
+                if (ent->s.effects & EF_GREENGIB)
+                    continue;
+            }
+
+            // ignore flares if client says so
+            if (client->csr->extended && ent->s.renderfx & RF_FLARE && client->settings[CLS_NOFLARES])
+                continue;
 
-        // ignore if not touching a PV leaf
-        if (ent != clent && !sv_novis->integer && !(client->csr->extended && ent->svflags & SVF_NOCULL)) {
-            // check area
-            if (!CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
-                // doors can legally straddle two areas, so
-                // we may need to check another one
-                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
-                    continue;        // blocked by a door
+            // ignore if not touching a PV leaf
+            if (ent != clent && !sv_novis->integer && !(client->csr->extended && ent->svflags & SVF_NOCULL)) {
+                // check area
+                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
+                    // doors can legally straddle two areas, so
+                    // we may need to check another one
+                    if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
+                        continue;        // blocked by a door
+                    }
                 }
-            }
 
-            // beams just check one point for PHS
-            bool beam_cull = ent->s.renderfx & RF_BEAM;
+                // beams just check one point for PHS
+                bool beam_cull = ent->s.renderfx & RF_BEAM;
 
-            // remaster uses different sound culling rules
-            bool sound_cull = client->csr->extended && ent->s.sound;
+                // remaster uses different sound culling rules
+                bool sound_cull = client->csr->extended && ent->s.sound;
 
-            if (!SV_EntityVisible(client, ent, (beam_cull || sound_cull) ? &clientphs : &clientpvs))
-                continue;
+                if (!SV_EntityVisible(client, ent, (beam_cull || sound_cull) ? clientphs : &clientpvs))
+                    continue;
 
-            // don't send sounds if they will be attenuated away
-            if (sound_cull) {
-                if (SV_EntityAttenuatedAway(org, ent)) {
-                    if (!ent->s.modelindex)
-                        continue;
-                    if (!beam_cull && !SV_EntityVisible(client, ent, &clientpvs))
+                // don't send sounds if they will be attenuated away
+                if (sound_cull) {
+                    if (SV_EntityAttenuatedAway(org, ent)) {
+                        if (!ent->s.modelindex)
+                            continue;
+                        if (!beam_cull && !SV_EntityVisible(client, ent, &clientpvs))
+                            continue;
+                    }
+                } else if (!ent->s.modelindex) {
+                    if (DistanceSquared(org, ent->s.origin) > 400 * 400)
                         continue;
                 }
-            } else if (!ent->s.modelindex) {
-                if (DistanceSquared(org, ent->s.origin) > 400 * 400)
-                    continue;
             }
-        }
 
-        SV_CheckEntityNumber(ent, e);
+            SV_CheckEntityNumber(ent, e);
 
-        // optionally skip it
-        if (visible && !visible(clent, ent))
-            continue;
+            // optionally skip it
+            if (visible && !visible(clent, ent))
+                continue;
 
-        edicts[num_edicts++] = ent;
+            edicts[num_edicts++] = ent;
 
-        if (num_edicts == max_packet_entities && !sv_prioritize_entities->integer)
-            break;
+            if (num_edicts == max_packet_entities && !sv_prioritize_entities->integer)
+                break;
+        }
     }
 
     // prioritize entities on overflow
     if (num_edicts > max_packet_entities) {
         VectorCopy(org, clientorg);
-        sv_client = client;
-        sv_player = client->edict;
+        sort_client = client;
         qsort(edicts, num_edicts, sizeof(edicts[0]), entpriocmp);
-        sv_client = NULL;
-        sv_player = NULL;
         num_edicts = max_packet_entities;
         qsort(edicts, num_edicts, sizeof(edicts[0]), entnumcmp);
     }
@@ -762,6 +1387,8 @@ void SV_BuildClientFrame(client_t *client)
         client->next_entity++;
     }
 
+    SV_ScheduleEntities(client, frame, org);
+
     if (need_clientnum_fix)
         frame->clientNum = client->infonum;
 }
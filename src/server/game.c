@@ -409,6 +409,8 @@ static void PF_configstring(int index, const char *val)
     memcpy(dst, val, len);
     dst[len] = 0;
 
+    SV_ConfigstringChanged(index, len);
+
     if (sv.state == ss_loading) {
         return;
     }
@@ -452,15 +454,16 @@ static void PF_WritePos(const vec3_t pos)
 static qboolean PF_inVIS(const vec3_t p1, const vec3_t p2, vis_t vis)
 {
     const mleaf_t *leaf1, *leaf2;
-    visrow_t mask;
+    const visrow_t *mask;
+    visrow_t temp;
 
     leaf1 = CM_PointLeaf(&sv.cm, p1);
-    BSP_ClusterVis(sv.cm.cache, &mask, leaf1->cluster, vis & VIS_PHS);
+    mask = BSP_GetClusterVis(sv.cm.cache, &temp, leaf1->cluster, vis & VIS_PHS);
 
     leaf2 = CM_PointLeaf(&sv.cm, p2);
     if (leaf2->cluster == -1)
         return false;
-    if (!Q_IsBitSet(mask.b, leaf2->cluster))
+    if (!Q_IsBitSet(mask->b, leaf2->cluster))
         return false;
     if (vis & VIS_NOAREAS)
         return true;
@@ -523,11 +526,12 @@ static void SV_StartSound(const vec3_t origin, edict_t *edict,
                           int channel, int soundindex, float volume,
                           float attenuation, float timeofs)
 {
-    int         i, ent, vol, att, ofs, flags, sendchan;
+    int         i, j, ent, vol, att, ofs, flags, sendchan, count;
     vec3_t      origin_v;
-    client_t    *client;
-    visrow_t    mask;
-    const mleaf_t       *leaf1, *leaf2;
+    client_t    *client, *clients[MAX_CLIENTS];
+    visrow_t    temp;
+    const visrow_t      *mask;
+    const mleaf_t       *leaf;
     message_packet_t    *msg;
     bool        force_pos;
 
@@ -613,30 +617,26 @@ static void SV_StartSound(const vec3_t origin, edict_t *edict,
         return;
     }
 
-    leaf1 = NULL;
+    // PHS cull this sound
     if (!(channel & CHAN_NO_PHS_ADD)) {
-        leaf1 = CM_PointLeaf(&sv.cm, origin);
-        BSP_ClusterVis(sv.cm.cache, &mask, leaf1->cluster, DVIS_PHS);
+        leaf = CM_PointLeaf(&sv.cm, origin);
+        mask = BSP_GetClusterVis(sv.cm.cache, &temp, leaf->cluster, DVIS_PHS);
+        count = SV_ClientsInVis(clients, mask, leaf->area);
+    } else {
+        count = 0;
+        FOR_EACH_CLIENT(client)
+            clients[count++] = client;
     }
 
     // decide per client if origin needs to be sent
-    FOR_EACH_CLIENT(client) {
+    for (j = 0; j < count; j++) {
+        client = clients[j];
+
         // do not send sounds to connecting clients
         if (!CLIENT_ACTIVE(client)) {
             continue;
         }
 
-        // PHS cull this sound
-        if (!(channel & CHAN_NO_PHS_ADD)) {
-            leaf2 = CM_PointLeaf(&sv.cm, client->edict->s.origin);
-            if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
-                continue;
-            if (leaf2->cluster == -1)
-                continue;
-            if (!Q_IsBitSet(mask.b, leaf2->cluster))
-                continue;
-        }
-
         // reliable sounds will always have position explicitly set,
         // as no one guarantees reliables to be delivered in time
         if (channel & CHAN_RELIABLE) {
@@ -773,7 +773,8 @@ static int PF_LoadFile(const char *path, void **buffer, unsigned flags, unsigned
     if (tag > UINT16_MAX - TAG_MAX) {
         Com_Error(ERR_DROP, "%s: bad tag", __func__);
     }
-    return FS_LoadFileEx(path, buffer, flags, tag + TAG_MAX);
+    // game frees loaded files with TagFree, don't hand out views
+    return FS_LoadFileEx(path, buffer, flags & ~FS_FLAG_MMAP, tag + TAG_MAX);
 }
 
 static void *PF_TagRealloc(void *ptr, size_t size)
@@ -875,6 +876,21 @@ static const debug_draw_api_v1_t debug_draw_api_v1 = {
 };
 #endif
 
+static void PF_BeginZone(const char *name)
+{
+    PROF_BEGIN(name);
+}
+
+static void PF_EndZone(void)
+{
+    PROF_END();
+}
+
+static const profile_api_v1_t profile_api_v1 = {
+    .BeginZone = PF_BeginZone,
+    .EndZone = PF_EndZone,
+};
+
 static void *PF_GetExtension(const char *name)
 {
     if (!name)
@@ -883,6 +899,9 @@ static void *PF_GetExtension(const char *name)
     if (!strcmp(name, FILESYSTEM_API_V1))
         return (void *)&filesystem_api_v1;
 
+    if (!strcmp(name, PROFILE_API_V1))
+        return (void *)&profile_api_v1;
+
 #if USE_REF && USE_DEBUG
     if (!strcmp(name, DEBUG_DRAW_API_V1) && !dedicated->integer)
         return (void *)&debug_draw_api_v1;
@@ -924,6 +943,8 @@ void SV_ShutdownGameProgs(void)
     if (game_library) {
         Sys_FreeLibrary(game_library);
         game_library = NULL;
+        // zone names recorded by game are gone
+        Com_ProfileClear();
     }
     Cvar_Set("g_features", "0");
 
@@ -36,6 +36,10 @@ void SV_ClientReset(client_t *client)
     client->suppress_count = 0;
     client->next_entity = 0;
     memset(&client->lastcmd, 0, sizeof(client->lastcmd));
+
+    // frames of previous level can't be referenced
+    for (int i = 0; i < UPDATE_BACKUP; i++)
+        client->frames[i].number = -1;
 }
 
 static void set_frame_time(void)
@@ -499,4 +503,6 @@ void SV_InitGame(unsigned mvd_spawn)
     AC_Connect(mvd_spawn);
 
     svs.initialized = true;
+
+    SV_InitFrameThreads();
 }
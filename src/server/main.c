@@ -21,8 +21,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 master_t    sv_masters[MAX_MASTERS];   // address of group servers
 
-LIST_DECL(sv_banlist);
-LIST_DECL(sv_blacklist);
+ADDRLIST_DECL(sv_banlist);
+ADDRLIST_DECL(sv_blacklist);
 LIST_DECL(sv_cmdlist_connect);
 LIST_DECL(sv_cmdlist_begin);
 LIST_DECL(sv_lrconlist);
@@ -80,6 +80,13 @@ cvar_t  *sv_max_download_size;
 cvar_t  *sv_max_packet_entities;
 cvar_t  *sv_trunc_packet_entities;
 cvar_t  *sv_prioritize_entities;
+cvar_t  *sv_threads;
+cvar_t  *sv_broadphase;
+cvar_t  *sv_delta_cache;
+cvar_t  *sv_gamestate_cache;
+cvar_t  *sv_entity_tiers;
+cvar_t  *sv_entity_tier_dist;
+cvar_t  *sv_entity_budget;
 
 cvar_t  *sv_strafejump_hack;
 cvar_t  *sv_waterjump_hack;
@@ -373,21 +380,220 @@ void SV_RateInit(ratelimit_t *r, const char *s)
     r->cost = rate2credits(rate);
 }
 
-addrmatch_t *SV_MatchAddress(const list_t *list, const netadr_t *addr)
+/*
+==============================================================================
+
+ADDRESS LISTS
+
+Entries are kept in a path compressed binary trie per address family, so
+that lookup cost depends on address length rather than number of entries.
+The list itself preserves order of addition for listing and removal by id.
+
+==============================================================================
+*/
+
+struct addrnode_s {
+    addrnode_t  *child[2];
+    addrmatch_t *match;     // entry for this exact prefix, if any
+    byte        key[16];    // prefix bits, rest are zero
+    int         bits;       // prefix length
+};
+
+static inline int addr_bit(const byte *ip, int i)
 {
-    addrmatch_t *match;
+    return (ip[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+// returns length of common prefix of a and b, up to maxbits
+static int common_bits(const byte *a, const byte *b, int maxbits)
+{
+    int i, x;
+
+    for (i = 0; i < maxbits; i += 8) {
+        x = a[i >> 3] ^ b[i >> 3];
+        if (x) {
+            i += 7 - Q_log2(x);
+            break;
+        }
+    }
+
+    return min(i, maxbits);
+}
+
+static addrnode_t *alloc_node(const byte *key, int bits, addrmatch_t *match)
+{
+    addrnode_t *node = Z_Mallocz(sizeof(*node));
+
+    memcpy(node->key, key, (bits + 7) >> 3);
+    if (bits & 7)
+        node->key[bits >> 3] &= 0xff << (-bits & 7);
+    node->bits = bits;
+    node->match = match;
+    return node;
+}
+
+static void free_trie(addrnode_t *node)
+{
+    if (node) {
+        free_trie(node->child[0]);
+        free_trie(node->child[1]);
+        Z_Free(node);
+    }
+}
 
-    LIST_FOR_EACH(addrmatch_t, match, list, entry) {
-        if (NET_IsEqualBaseAdrMask(addr, &match->addr, &match->mask)) {
-            match->hits++;
-            match->time = time(NULL);
-            return match;
+static int addr_family(netadrtype_t type)
+{
+    switch (type) {
+    case NA_IP:
+        return 0;
+    case NA_IP6:
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+static void insert_match(addrlist_t *list, addrmatch_t *match)
+{
+    addrnode_t **pp, *node, *split;
+    const byte *key = match->addr.ip.u8;
+    int bits = match->bits;
+    int family, common;
+
+    family = addr_family(match->addr.type);
+    if (family == -1)
+        return;
+
+    pp = &list->trie[family];
+    while (1) {
+        node = *pp;
+        if (!node) {
+            *pp = alloc_node(key, bits, match);
+            return;
+        }
+
+        common = common_bits(node->key, key, min(node->bits, bits));
+        if (common < node->bits) {
+            // node prefix diverges, split it
+            if (common == bits) {
+                split = alloc_node(key, bits, match);
+            } else {
+                split = alloc_node(key, common, NULL);
+                split->child[addr_bit(key, common)] = alloc_node(key, bits, match);
+            }
+            split->child[addr_bit(node->key, common)] = node;
+            *pp = split;
+            return;
         }
+
+        if (node->bits == bits) {
+            // keep the earlier duplicate
+            if (!node->match)
+                node->match = match;
+            return;
+        }
+
+        pp = &node->child[addr_bit(key, node->bits)];
+    }
+}
+
+static void rebuild_trie(addrlist_t *list)
+{
+    addrmatch_t *match;
+
+    free_trie(list->trie[0]);
+    free_trie(list->trie[1]);
+    list->trie[0] = list->trie[1] = NULL;
+    list->nextseq = 0;
+
+    LIST_FOR_EACH(addrmatch_t, match, &list->list, entry) {
+        match->seq = list->nextseq++;
+        insert_match(list, match);
+    }
+}
+
+/*
+==================
+SV_MatchAddress
+
+Returns the first added entry matching the address.
+==================
+*/
+addrmatch_t *SV_MatchAddress(const addrlist_t *list, const netadr_t *addr)
+{
+    int family = addr_family(addr->type);
+    const addrnode_t *node = family == -1 ? NULL : list->trie[family];
+    addrmatch_t *match = NULL;
+    int maxbits = family == 1 ? 128 : 32;
+
+    while (node) {
+        if (common_bits(node->key, addr->ip.u8, node->bits) < node->bits)
+            break;
+        if (node->match && (!match || node->match->seq < match->seq))
+            match = node->match;
+        if (node->bits == maxbits)
+            break;
+        node = node->child[addr_bit(addr->ip.u8, node->bits)];
+    }
+
+    if (match) {
+        match->hits++;
+        match->time = time(NULL);
+    }
+
+    return match;
+}
+
+/*
+==================
+SV_FindMatch
+
+Returns entry with exactly the given address and prefix length.
+==================
+*/
+addrmatch_t *SV_FindMatch(const addrlist_t *list, const netadr_t *addr, int bits)
+{
+    int family = addr_family(addr->type);
+    const addrnode_t *node = family == -1 ? NULL : list->trie[family];
+
+    while (node && node->bits <= bits) {
+        if (common_bits(node->key, addr->ip.u8, node->bits) < node->bits)
+            break;
+        if (node->bits == bits)
+            return node->match;
+        node = node->child[addr_bit(addr->ip.u8, node->bits)];
     }
 
     return NULL;
 }
 
+void SV_AddMatch(addrlist_t *list, addrmatch_t *match)
+{
+    match->seq = list->nextseq++;
+    List_Append(&list->list, &match->entry);
+    insert_match(list, match);
+}
+
+void SV_RemoveMatch(addrlist_t *list, addrmatch_t *match)
+{
+    List_Remove(&match->entry);
+    Z_Free(match);
+
+    // removal is rare, just rebuild
+    rebuild_trie(list);
+}
+
+void SV_ClearMatches(addrlist_t *list)
+{
+    addrmatch_t *match, *next;
+
+    LIST_FOR_EACH_SAFE(addrmatch_t, match, next, &list->list, entry) {
+        Z_Free(match);
+    }
+    List_Init(&list->list);
+    rebuild_trie(list);
+}
+
 /*
 ==============================================================================
 
@@ -1077,12 +1283,74 @@ static void append_extra_userinfo(conn_params_t *params, char *userinfo)
                params->maxlength, params->qport, params->has_zlib);
 }
 
+// this is the only place a client_t is ever initialized
+static void init_client(client_t *newcl, const conn_params_t *params)
+{
+    int number = newcl - svs.client_pool;
+
+    memset(newcl, 0, sizeof(*newcl));
+    newcl->number = newcl->infonum = number;
+    newcl->challenge = params->challenge; // save challenge for checksumming
+    newcl->protocol = params->protocol;
+    newcl->version = params->version;
+    newcl->has_zlib = params->has_zlib;
+    newcl->edict = EDICT_NUM(number + 1);
+    newcl->gamedir = fs_game->string;
+    newcl->mapname = sv.name;
+    newcl->configstrings = sv.configstrings;
+    newcl->csr = &svs.csr;
+    newcl->ge = ge;
+    newcl->cm = &sv.cm;
+    newcl->spawncount = sv.spawncount;
+    newcl->maxclients = svs.maxclients;
+    Q_strlcpy(newcl->reconnect_var, params->reconnect_var, sizeof(newcl->reconnect_var));
+    Q_strlcpy(newcl->reconnect_val, params->reconnect_val, sizeof(newcl->reconnect_val));
+#if USE_FPS
+    newcl->framediv = sv.frametime.div;
+    newcl->settings[CLS_FPS] = BASE_FRAMERATE;
+#endif
+
+    init_pmove_and_es_flags(newcl);
+}
+
+static void add_client(client_t *newcl, const conn_params_t *params,
+                       const netadr_t *adr, const char *userinfo)
+{
+    // setup netchan
+    Netchan_Setup(&newcl->netchan, NS_SERVER, params->nctype, adr,
+                  params->qport, params->maxlength, params->protocol);
+    newcl->numpackets = 1;
+
+    // parse some info from the info strings
+    Q_strlcpy(newcl->userinfo, userinfo, sizeof(newcl->userinfo));
+    SV_UserinfoChanged(newcl);
+
+    SV_RateInit(&newcl->ratelimit_namechange, sv_namechange_limit->string);
+
+    SV_InitClientSend(newcl);
+
+    // loopback client doesn't need to reconnect
+    if (NET_IsLocalAddress(adr)) {
+        newcl->reconnected = true;
+    }
+
+    // add them to the linked list of connected clients
+    List_SeqAdd(&sv_clientlist, &newcl->entry);
+
+    Com_DPrintf("Going from cs_free to cs_assigned for %s\n", newcl->name);
+    newcl->state = cs_assigned;
+    newcl->framenum = 1; // frame 0 can't be used
+    newcl->lastframe = -1;
+    newcl->lastmessage = svs.realtime;    // don't timeout
+    newcl->lastactivity = svs.realtime;
+    newcl->min_ping = 9999;
+}
+
 static void SVC_DirectConnect(void)
 {
     char            userinfo[MAX_INFO_STRING * 2];
     conn_params_t   params;
     client_t        *newcl;
-    int             number;
     qboolean        allow;
     char            *reason;
 
@@ -1105,34 +1373,9 @@ static void SVC_DirectConnect(void)
     if (!newcl)
         return;
 
-    number = newcl - svs.client_pool;
-
     // build a new connection
     // accept the new client
-    // this is the only place a client_t is ever initialized
-    memset(newcl, 0, sizeof(*newcl));
-    newcl->number = newcl->infonum = number;
-    newcl->challenge = params.challenge; // save challenge for checksumming
-    newcl->protocol = params.protocol;
-    newcl->version = params.version;
-    newcl->has_zlib = params.has_zlib;
-    newcl->edict = EDICT_NUM(number + 1);
-    newcl->gamedir = fs_game->string;
-    newcl->mapname = sv.name;
-    newcl->configstrings = sv.configstrings;
-    newcl->csr = &svs.csr;
-    newcl->ge = ge;
-    newcl->cm = &sv.cm;
-    newcl->spawncount = sv.spawncount;
-    newcl->maxclients = svs.maxclients;
-    Q_strlcpy(newcl->reconnect_var, params.reconnect_var, sizeof(newcl->reconnect_var));
-    Q_strlcpy(newcl->reconnect_val, params.reconnect_val, sizeof(newcl->reconnect_val));
-#if USE_FPS
-    newcl->framediv = sv.frametime.div;
-    newcl->settings[CLS_FPS] = BASE_FRAMERATE;
-#endif
-
-    init_pmove_and_es_flags(newcl);
+    init_client(newcl, &params);
 
     append_extra_userinfo(&params, userinfo);
 
@@ -1152,38 +1395,65 @@ static void SVC_DirectConnect(void)
         return;
     }
 
-    // setup netchan
-    Netchan_Setup(&newcl->netchan, NS_SERVER, params.nctype, &net_from,
-                  params.qport, params.maxlength, params.protocol);
-    newcl->numpackets = 1;
-
-    // parse some info from the info strings
-    Q_strlcpy(newcl->userinfo, userinfo, sizeof(newcl->userinfo));
-    SV_UserinfoChanged(newcl);
+    add_client(newcl, &params, &net_from, userinfo);
 
     // send the connect packet to the client
     send_connect_packet(newcl, params.nctype);
+}
 
-    SV_RateInit(&newcl->ratelimit_namechange, sv_namechange_limit->string);
+#if USE_TESTS
+/*
+==================
+SV_AddFakeClient
 
-    SV_InitClientSend(newcl);
+Connects a client with unspecified address without any handshake. Packets
+sent to it are discarded. Client is left in cs_assigned state, caller is
+responsible for bringing it into the game. Used by benchmark code.
+==================
+*/
+client_t *SV_AddFakeClient(const char *userinfo, int qport)
+{
+    char            info[MAX_INFO_STRING * 2];
+    conn_params_t   params;
+    client_t        *newcl;
+    int             i;
 
-    // loopback client doesn't need to reconnect
-    if (NET_IsLocalAddress(&net_from)) {
-        newcl->reconnected = true;
-    }
+    memset(&params, 0, sizeof(params));
+    params.protocol = PROTOCOL_VERSION_Q2PRO;
+    params.version = PROTOCOL_VERSION_Q2PRO_CURRENT;
+    params.nctype = NETCHAN_NEW;
+    params.qport = qport;
+    params.maxlength = MAX_PACKETLEN_WRITABLE_DEFAULT;
+    params.has_zlib = true;
+
+    for (i = 0; i < svs.maxclients; i++)
+        if (svs.client_pool[i].state == cs_free)
+            break;
+    if (i == svs.maxclients)
+        return NULL;
 
-    // add them to the linked list of connected clients
-    List_SeqAdd(&sv_clientlist, &newcl->entry);
+    newcl = &svs.client_pool[i];
+    memset(&net_from, 0, sizeof(net_from));
 
-    Com_DPrintf("Going from cs_free to cs_assigned for %s\n", newcl->name);
-    newcl->state = cs_assigned;
-    newcl->framenum = 1; // frame 0 can't be used
-    newcl->lastframe = -1;
-    newcl->lastmessage = svs.realtime;    // don't timeout
-    newcl->lastactivity = svs.realtime;
-    newcl->min_ping = 9999;
+    init_client(newcl, &params);
+
+    Q_strlcpy(info, userinfo, MAX_INFO_STRING);
+    if (!Info_SetValueForKey(info, "ip", userinfo_ip_string()))
+        return NULL;
+    append_extra_userinfo(&params, info);
+
+    sv_client = newcl;
+    sv_player = newcl->edict;
+    if (!ge->ClientConnect(newcl->edict, info))
+        newcl = NULL;
+    sv_client = NULL;
+    sv_player = NULL;
+
+    if (newcl)
+        add_client(newcl, &params, &net_from, info);
+    return newcl;
 }
+#endif
 
 typedef enum {
     RCON_BAD,
@@ -1791,15 +2061,21 @@ SV_RunGameFrame
 */
 static void SV_RunGameFrame(void)
 {
+    uint64_t time = SV_BenchTime();
+
     // save the entire world state if recording a serverdemo
     SV_MvdBeginFrame();
+    SV_BenchAccum(BENCH_MVD, &time);
 
 #if USE_CLIENT
     if (host_speeds->integer)
         time_before_game = Sys_Milliseconds();
 #endif
 
+    PROF_BEGIN("RunFrame");
     ge->RunFrame();
+    PROF_END();
+    SV_BenchAccum(BENCH_GAME, &time);
 
 #if USE_CLIENT
     if (host_speeds->integer)
@@ -1817,7 +2093,9 @@ static void SV_RunGameFrame(void)
     }
 
     // save the entire world state if recording a serverdemo
+    time = SV_BenchTime();
     SV_MvdEndFrame();
+    SV_BenchAccum(BENCH_MVD, &time);
 }
 
 /*
@@ -1904,6 +2182,44 @@ static void SV_MasterShutdown(void)
     }
 }
 
+/*
+==================
+SV_RunWorldFrame
+
+Runs a single server frame and sends updates to clients.
+==================
+*/
+void SV_RunWorldFrame(void)
+{
+    // check timeouts
+    SV_CheckTimeouts();
+
+    // update ping based on the last known frame from all clients
+    SV_CalcPings();
+
+    // give the clients some timeslices
+    SV_GiveMsec();
+
+    // let everything in the world think and move
+    PROF_BEGIN("SV_RunGameFrame");
+    SV_RunGameFrame();
+    PROF_END();
+
+    // send messages back to the UDP clients
+    PROF_BEGIN("SV_SendClientMessages");
+    SV_SendClientMessages();
+    PROF_END();
+
+    // send a heartbeat to the master if needed
+    SV_MasterHeartbeat();
+
+    // clear teleport flags, etc for next frame
+    SV_PrepWorldFrame();
+
+    // advance for next frame
+    sv.framenum++;
+}
+
 /*
 ==================
 SV_Frame
@@ -1930,7 +2246,9 @@ unsigned SV_Frame(unsigned msec)
 
 #if USE_MVD_CLIENT
     // run connections to MVD/GTV servers
+    PROF_BEGIN("MVD_Frame");
     MVD_Frame();
+    PROF_END();
 #endif
 
     // read packets from UDP clients
@@ -1941,10 +2259,14 @@ unsigned SV_Frame(unsigned msec)
         AC_Run();
 
         // run connections from MVD/GTV clients
+        PROF_BEGIN("SV_MvdRunClients");
         SV_MvdRunClients();
+        PROF_END();
 
         // deliver fragments and reliable messages for connecting clients
+        PROF_BEGIN("SV_SendAsyncPackets");
         SV_SendAsyncPackets();
+        PROF_END();
     }
 
     // move autonomous things around if enough time has passed
@@ -1954,29 +2276,7 @@ unsigned SV_Frame(unsigned msec)
     }
 
     if (svs.initialized && !check_paused()) {
-        // check timeouts
-        SV_CheckTimeouts();
-
-        // update ping based on the last known frame from all clients
-        SV_CalcPings();
-
-        // give the clients some timeslices
-        SV_GiveMsec();
-
-        // let everything in the world think and move
-        SV_RunGameFrame();
-
-        // send messages back to the UDP clients
-        SV_SendClientMessages();
-
-        // send a heartbeat to the master if needed
-        SV_MasterHeartbeat();
-
-        // clear teleport flags, etc for next frame
-        SV_PrepWorldFrame();
-
-        // advance for next frame
-        sv.framenum++;
+        SV_RunWorldFrame();
     }
 
     if (COM_DEDICATED) {
@@ -2136,6 +2436,13 @@ static void sv_namechange_limit_changed(cvar_t *self)
     }
 }
 
+static void sv_threads_changed(cvar_t *self)
+{
+    SV_ShutdownFrameThreads();
+    if (svs.initialized)
+        SV_InitFrameThreads();
+}
+
 #if USE_SYSCON
 static void sv_hostname_changed(cvar_t *self)
 {
@@ -2242,6 +2549,14 @@ void SV_Init(void)
     sv_max_packet_entities = Cvar_Get("sv_max_packet_entities", "0", 0);
     sv_trunc_packet_entities = Cvar_Get("sv_trunc_packet_entities", "1", 0);
     sv_prioritize_entities = Cvar_Get("sv_prioritize_entities", "0", 0);
+    sv_threads = Cvar_Get("sv_threads", "0", 0);
+    sv_threads->changed = sv_threads_changed;
+    sv_broadphase = Cvar_Get("sv_broadphase", "0", CVAR_LATCH);
+    sv_delta_cache = Cvar_Get("sv_delta_cache", "1", 0);
+    sv_gamestate_cache = Cvar_Get("sv_gamestate_cache", "1", 0);
+    sv_entity_tiers = Cvar_Get("sv_entity_tiers", "0", 0);
+    sv_entity_tier_dist = Cvar_Get("sv_entity_tier_dist", "1024", 0);
+    sv_entity_budget = Cvar_Get("sv_entity_budget", "0", 0);
 
     sv_strafejump_hack = Cvar_Get("sv_strafejump_hack", "1", CVAR_LATCH);
     sv_waterjump_hack = Cvar_Get("sv_waterjump_hack", "1", CVAR_LATCH);
@@ -2388,6 +2703,9 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
     SV_MvdShutdown(type);
 
     SV_FinalMessage(finalmsg, type);
+    SV_ShutdownFrameThreads();
+    SV_ShutdownDeltaCache();
+    SV_ShutdownGamestateCache();
     SV_MasterShutdown();
     SV_ShutdownGameProgs();
 
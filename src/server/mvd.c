@@ -35,14 +35,15 @@ typedef struct {
     clstate_t   state;
     netstream_t stream;
 #if USE_ZLIB
-    z_stream    z;
+    bool        deflate;
+    bool        deflating;  // zlib header has been sent
+    uLong       adler;      // checksum of uncompressed data sent so far
 #endif
     unsigned    msglen;
     unsigned    lastmessage;
 
     unsigned    flags;
     unsigned    maxbuf;
-    unsigned    bufcount;
 
     byte        buffer[MAX_GTC_MSGLEN + 4]; // recv buffer
     byte        *data; // send buffer
@@ -80,6 +81,19 @@ typedef struct {
     // TCP client pool
     int             maxclients;
     gtv_client_t    *clients; // [sv_mvd_maxclients]
+
+#if USE_ZLIB
+    // stream data common to all deflating clients is compressed once
+    // into this raw deflate stream and copied to each of them
+    z_stream        z;
+    uLong           z_adler;    // checksum of data since last full flush
+    size_t          z_total;    // bytes since last full flush
+    bool            z_pending;  // data since last flush of any kind
+    unsigned        z_bufcount;
+
+    // compressor for messages sent to a single client
+    z_stream        z_private;
+#endif
 } mvd_server_t;
 
 static mvd_server_t     mvd;
@@ -88,8 +102,8 @@ static mvd_server_t     mvd;
 static LIST_DECL(gtv_client_list);
 static LIST_DECL(gtv_active_list);
 
-static LIST_DECL(gtv_white_list);
-static LIST_DECL(gtv_black_list);
+static ADDRLIST_DECL(gtv_white_list);
+static ADDRLIST_DECL(gtv_black_list);
 
 static cvar_t   *sv_mvd_enable;
 static cvar_t   *sv_mvd_maxclients;
@@ -116,8 +130,11 @@ static void     mvd_error(const char *reason);
 
 static void     write_stream(gtv_client_t *client, void *data, size_t len);
 static void     write_message(gtv_client_t *client, gtv_serverop_t op);
+static void     write_shared(void *data, size_t len);
+static void     write_shared_message(gtv_serverop_t op);
 #if USE_ZLIB
-static void     flush_stream(gtv_client_t *client, int flush);
+static void     flush_shared(int flush);
+static unsigned shared_maxbuf(void);
 #endif
 
 static void     rec_stop(void);
@@ -810,12 +827,13 @@ static void suspend_streams(void)
 {
     gtv_client_t *client;
 
-    FOR_EACH_ACTIVE_GTV(client) {
-        // send stream suspend marker
-        write_message(client, GTS_STREAM_DATA);
+    // send stream suspend marker
+    write_shared_message(GTS_STREAM_DATA);
 #if USE_ZLIB
-        flush_stream(client, Z_SYNC_FLUSH);
+    flush_shared(Z_SYNC_FLUSH);
 #endif
+
+    FOR_EACH_ACTIVE_GTV(client) {
         NET_UpdateStream(&client->stream);
     }
 
@@ -838,12 +856,13 @@ static void resume_streams(void)
         return;
     }
 
-    FOR_EACH_ACTIVE_GTV(client) {
-        // send gamestate
-        write_message(client, GTS_STREAM_DATA);
+    // send gamestate
+    write_shared_message(GTS_STREAM_DATA);
 #if USE_ZLIB
-        flush_stream(client, Z_SYNC_FLUSH);
+    flush_shared(Z_SYNC_FLUSH);
 #endif
+
+    FOR_EACH_ACTIVE_GTV(client) {
         NET_UpdateStream(&client->stream);
     }
 
@@ -1062,16 +1081,17 @@ void SV_MvdEndFrame(void)
     header[2] = GTS_STREAM_DATA;
 
     // send frame to clients
-    FOR_EACH_ACTIVE_GTV(client) {
-        write_stream(client, header, sizeof(header));
-        write_stream(client, mvd.message.data, mvd.message.cursize);
-        write_stream(client, msg_write.data, msg_write.cursize);
-        write_stream(client, mvd.datagram.data, mvd.datagram.cursize);
+    write_shared(header, sizeof(header));
+    write_shared(mvd.message.data, mvd.message.cursize);
+    write_shared(msg_write.data, msg_write.cursize);
+    write_shared(mvd.datagram.data, mvd.datagram.cursize);
 #if USE_ZLIB
-        if (++client->bufcount > client->maxbuf) {
-            flush_stream(client, Z_SYNC_FLUSH);
-        }
+    if (++mvd.z_bufcount > shared_maxbuf()) {
+        flush_shared(Z_SYNC_FLUSH);
+    }
 #endif
+
+    FOR_EACH_ACTIVE_GTV(client) {
         NET_UpdateStream(&client->stream);
     }
 
@@ -1320,42 +1340,35 @@ static void remove_client(gtv_client_t *client)
 }
 
 #if USE_ZLIB
-static void flush_stream(gtv_client_t *client, int flush)
+static void start_stream(gtv_client_t *client)
 {
-    fifo_t *fifo = &client->stream.send;
-    z_streamp z = &client->z;
-    byte *data;
-    size_t len;
-    int ret;
+    static const byte header[2] = { 0x78, 0x9c };
 
-    if (client->state <= cs_zombie) {
-        return;
+    // client switches to inflating only after parsing hello, so defer
+    // zlib header until the first deflated data is sent
+    if (!client->deflating) {
+        FIFO_Write(&client->stream.send, header, sizeof(header));
+        client->deflating = true;
     }
-    if (!z->state) {
-        return;
-    }
-
-    z->next_in = NULL;
-    z->avail_in = 0;
+}
 
-    do {
-        data = FIFO_Reserve(fifo, &len);
-        if (!len) {
-            // FIXME: this is not an error when flushing
-            return;
-        }
+static void finish_stream(gtv_client_t *client)
+{
+    uLong adler = client->adler;
+    byte trailer[6];
 
-        z->next_out = data;
-        z->avail_out = (uInt)len;
+    start_stream(client);
 
-        ret = deflate(z, flush);
+    // empty final block, followed by zlib checksum
+    trailer[0] = 0x03;
+    trailer[1] = 0x00;
+    trailer[2] = adler >> 24;
+    trailer[3] = adler >> 16;
+    trailer[4] = adler >> 8;
+    trailer[5] = adler;
 
-        len -= z->avail_out;
-        if (len) {
-            FIFO_Commit(fifo, len);
-            client->bufcount = 0;
-        }
-    } while (ret == Z_OK);
+    FIFO_Write(&client->stream.send, trailer, sizeof(trailer));
+    client->deflate = false;
 }
 #endif
 
@@ -1372,10 +1385,12 @@ static void drop_client(gtv_client_t *client, const char *error)
     }
 
 #if USE_ZLIB
-    if (client->z.state) {
+    if (client->deflate) {
         // finish zlib stream
-        flush_stream(client, Z_FINISH);
-        deflateEnd(&client->z);
+        if (client->state == cs_spawned) {
+            flush_shared(Z_FULL_FLUSH);
+        }
+        finish_stream(client);
     }
 #endif
 
@@ -1387,8 +1402,6 @@ static void drop_client(gtv_client_t *client, const char *error)
 
 static void write_stream(gtv_client_t *client, void *data, size_t len)
 {
-    fifo_t *fifo = &client->stream.send;
-
     if (client->state <= cs_zombie) {
         return;
     }
@@ -1397,40 +1410,151 @@ static void write_stream(gtv_client_t *client, void *data, size_t len)
         return;
     }
 
+    if (FIFO_Write(&client->stream.send, data, len) != len) {
 #if USE_ZLIB
-    if (client->z.state) {
-        z_streamp z = &client->z;
+        client->deflate = false;
+#endif
+        drop_client(client, "overflowed");
+    }
+}
 
-        z->next_in = data;
-        z->avail_in = (uInt)len;
+#if USE_ZLIB
+/*
+==================
+deflate_shared
 
-        do {
-            data = FIFO_Reserve(fifo, &len);
-            if (!len) {
-                drop_client(client, "overflowed");
-                return;
-            }
+Runs shared compressor and copies output to all deflating active clients.
+Clients join and leave the shared stream only at full flush points.
+==================
+*/
+static void deflate_shared(int flush)
+{
+    z_streamp z = &mvd.z;
+    gtv_client_t *client;
+    byte buffer[0x2000];
+    size_t len;
 
-            z->next_out = data;
-            z->avail_out = (uInt)len;
+    do {
+        z->next_out = buffer;
+        z->avail_out = sizeof(buffer);
+
+        deflate(z, flush);
 
-            if (deflate(z, Z_NO_FLUSH) != Z_OK) {
-                drop_client(client, "deflate() failed");
-                return;
+        len = sizeof(buffer) - z->avail_out;
+        if (len) {
+            FOR_EACH_ACTIVE_GTV(client) {
+                if (client->deflate) {
+                    write_stream(client, buffer, len);
+                }
             }
+            mvd.z_bufcount = 0;
+        }
+    } while (z->avail_in || !z->avail_out);
+}
+
+static void flush_shared(int flush)
+{
+    gtv_client_t *client;
+
+    if (flush == Z_FULL_FLUSH ? !mvd.z_total : !mvd.z_pending) {
+        return;
+    }
+
+    mvd.z.next_in = NULL;
+    mvd.z.avail_in = 0;
+
+    deflate_shared(flush);
+    mvd.z_pending = false;
 
-            len -= z->avail_out;
-            if (len) {
-                FIFO_Commit(fifo, len);
-                client->bufcount = 0;
+    if (flush == Z_FULL_FLUSH) {
+        // shared chunk is complete, account it to attached clients
+        FOR_EACH_ACTIVE_GTV(client) {
+            if (client->deflate) {
+                client->adler = adler32_combine(client->adler, mvd.z_adler,
+                                                (z_off_t)mvd.z_total);
             }
-        } while (z->avail_in);
-    } else
-#endif
-    if (FIFO_Write(fifo, data, len) != len) {
-        drop_client(client, "overflowed");
+        }
+        mvd.z_adler = adler32(0, NULL, 0);
+        mvd.z_total = 0;
+    }
+}
+
+// flush as often as the most impatient client wants
+static unsigned shared_maxbuf(void)
+{
+    gtv_client_t *client;
+    unsigned maxbuf = UINT_MAX;
+
+    FOR_EACH_ACTIVE_GTV(client) {
+        if (client->deflate) {
+            maxbuf = min(maxbuf, client->maxbuf);
+        }
+    }
+
+    return maxbuf;
+}
+
+static void write_private(gtv_client_t *client, void *data, size_t len, int flush)
+{
+    fifo_t *fifo = &client->stream.send;
+    z_streamp z = &mvd.z_private;
+
+    if (client->state <= cs_zombie) {
+        return;
+    }
+
+    start_stream(client);
+
+    client->adler = adler32(client->adler, data, len);
+
+    z->next_in = data;
+    z->avail_in = (uInt)len;
+
+    do {
+        data = FIFO_Reserve(fifo, &len);
+        if (!len) {
+            deflateReset(z);
+            client->deflate = false;
+            drop_client(client, "overflowed");
+            return;
+        }
+
+        z->next_out = data;
+        z->avail_out = (uInt)len;
+
+        deflate(z, flush);
+
+        len -= z->avail_out;
+        if (len) {
+            FIFO_Commit(fifo, len);
+        }
+    } while (z->avail_in || !z->avail_out);
+}
+
+static bool init_deflate(void)
+{
+    mvd.z.zalloc = SV_zalloc;
+    mvd.z.zfree = SV_zfree;
+    if (deflateInit2(&mvd.z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        memset(&mvd.z, 0, sizeof(mvd.z));
+        return false;
+    }
+
+    mvd.z_private.zalloc = SV_zalloc;
+    mvd.z_private.zfree = SV_zfree;
+    if (deflateInit2(&mvd.z_private, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        deflateEnd(&mvd.z);
+        memset(&mvd.z, 0, sizeof(mvd.z));
+        memset(&mvd.z_private, 0, sizeof(mvd.z_private));
+        return false;
     }
+
+    mvd.z_adler = adler32(0, NULL, 0);
+    return true;
 }
+#endif
 
 static void write_message(gtv_client_t *client, gtv_serverop_t op)
 {
@@ -1438,11 +1562,68 @@ static void write_message(gtv_client_t *client, gtv_serverop_t op)
 
     WL16(header, msg_write.cursize + 1);
     header[2] = op;
-    write_stream(client, header, sizeof(header));
 
+#if USE_ZLIB
+    if (client->deflate) {
+        // pending shared data must go out first
+        if (client->state == cs_spawned) {
+            flush_shared(Z_FULL_FLUSH);
+        }
+        write_private(client, header, sizeof(header), Z_NO_FLUSH);
+        write_private(client, msg_write.data, msg_write.cursize, Z_FULL_FLUSH);
+        return;
+    }
+#endif
+
+    write_stream(client, header, sizeof(header));
     write_stream(client, msg_write.data, msg_write.cursize);
 }
 
+static void write_shared(void *data, size_t len)
+{
+    gtv_client_t *client;
+#if USE_ZLIB
+    bool packed = false;
+#endif
+
+    if (!len) {
+        return;
+    }
+
+    FOR_EACH_ACTIVE_GTV(client) {
+#if USE_ZLIB
+        if (client->deflate) {
+            packed = true;
+            continue;
+        }
+#endif
+        write_stream(client, data, len);
+    }
+
+#if USE_ZLIB
+    if (packed) {
+        mvd.z_adler = adler32(mvd.z_adler, data, len);
+        mvd.z_total += len;
+        mvd.z_pending = true;
+
+        mvd.z.next_in = data;
+        mvd.z.avail_in = (uInt)len;
+        deflate_shared(Z_NO_FLUSH);
+    }
+#endif
+}
+
+static void write_shared_message(gtv_serverop_t op)
+{
+    byte header[3];
+
+    WL16(header, msg_write.cursize + 1);
+    header[2] = op;
+    write_shared(header, sizeof(header));
+
+    write_shared(msg_write.data, msg_write.cursize);
+}
+
 static bool auth_client(const gtv_client_t *client, const char *password)
 {
     if (SV_MatchAddress(&gtv_white_list, &client->stream.address))
@@ -1523,12 +1704,13 @@ static void parse_hello(gtv_client_t *client)
 #if USE_ZLIB
     // the rest of the stream will be deflated
     if (flags & GTF_DEFLATE) {
-        client->z.zalloc = SV_zalloc;
-        client->z.zfree = SV_zfree;
-        if (deflateInit(&client->z, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        if (!mvd.z.state && !init_deflate()) {
             drop_client(client, "deflateInit failed");
             return;
         }
+        client->deflate = true;
+        client->deflating = false;
+        client->adler = adler32(0, NULL, 0);
     }
 #endif
 
@@ -1544,10 +1726,6 @@ static void parse_ping(gtv_client_t *client)
 
     // send ping reply
     write_message(client, GTS_PONG);
-
-#if USE_ZLIB
-    flush_stream(client, Z_SYNC_FLUSH);
-#endif
 }
 
 static void parse_stream_start(gtv_client_t *client)
@@ -1567,9 +1745,6 @@ static void parse_stream_start(gtv_client_t *client)
 
     maxbuf = MSG_ReadShort();
     client->maxbuf = max(maxbuf, 10);
-    client->state = cs_spawned;
-
-    List_Append(&gtv_active_list, &client->active);
 
     // send ack to client
     write_message(client, GTS_STREAM_START);
@@ -1589,9 +1764,20 @@ static void parse_stream_start(gtv_client_t *client)
         write_message(client, GTS_STREAM_DATA);
     }
 
+    if (client->state != cs_primed) {
+        return;
+    }
+
 #if USE_ZLIB
-    flush_stream(client, Z_SYNC_FLUSH);
+    // join shared stream at a full flush point
+    if (client->deflate) {
+        flush_shared(Z_FULL_FLUSH);
+    }
 #endif
+
+    client->state = cs_spawned;
+
+    List_Append(&gtv_active_list, &client->active);
 }
 
 static void parse_stream_stop(gtv_client_t *client)
@@ -1601,15 +1787,19 @@ static void parse_stream_stop(gtv_client_t *client)
         return;
     }
 
+#if USE_ZLIB
+    // leave shared stream at a full flush point
+    if (client->deflate) {
+        flush_shared(Z_FULL_FLUSH);
+    }
+#endif
+
     client->state = cs_primed;
 
     List_Delete(&client->active);
 
     // send ack to client
     write_message(client, GTS_STREAM_STOP);
-#if USE_ZLIB
-    flush_stream(client, Z_SYNC_FLUSH);
-#endif
 }
 
 static void parse_stringcmd(gtv_client_t *client)
@@ -2027,8 +2217,8 @@ void SV_MvdMapChanged(void)
         }
 
         // send gamestate to all MVD clients
+        write_shared_message(GTS_STREAM_DATA);
         FOR_EACH_ACTIVE_GTV(client) {
-            write_message(client, GTS_STREAM_DATA);
             NET_UpdateStream(&client->stream);
         }
     }
@@ -2184,6 +2374,13 @@ void SV_MvdShutdown(error_type_t type)
     // close server TCP socket
     NET_Listen(false);
 
+#if USE_ZLIB
+    if (mvd.z.state) {
+        deflateEnd(&mvd.z);
+        deflateEnd(&mvd.z_private);
+    }
+#endif
+
     memset(&mvd, 0, sizeof(mvd));
 }
 
@@ -79,6 +79,8 @@ typedef struct gtv_s {
     int64_t         demosize, demoofs;
     float           demoprogress;
     bool            demowait;
+    qhandle_t       demoscanfile;
+    mvd_t           *demoscan;  // shadow channel building snapshots ahead
 } gtv_t;
 
 static const char *const gtv_states[GTV_NUM_STATES] = {
@@ -108,6 +110,8 @@ unsigned    mvd_last_activity;
 
 jmp_buf     mvd_jmpbuf;
 
+static jmp_buf  mvd_scanjmp;
+
 #if USE_DEBUG
 cvar_t      *mvd_shownet;
 #endif
@@ -120,6 +124,9 @@ static cvar_t  *mvd_buffer_size;
 static cvar_t  *mvd_username;
 static cvar_t  *mvd_password;
 static cvar_t  *mvd_snaps;
+static cvar_t  *mvd_snapscan;
+
+static void demo_scan_stop(gtv_t *gtv);
 
 // ====================================================================
 
@@ -168,6 +175,12 @@ static void MVD_Destroy(mvd_t *mvd)
 {
     mvd_client_t *client, *next;
 
+    // parse error in snapshot scanner only stops the scan
+    if (mvd->gtv && mvd->gtv->demoscan == mvd) {
+        demo_scan_stop(mvd->gtv);
+        return;
+    }
+
     // update channel menus
     if (!LIST_EMPTY(&mvd->entry)) {
         mvd_dirty = true;
@@ -197,6 +210,12 @@ void MVD_Destroyf(mvd_t *mvd, const char *fmt, ...)
     Q_vsnprintf(text, sizeof(text), fmt, argptr);
     va_end(argptr);
 
+    // errors in scanner copy only stop the scan
+    if (mvd->demoscanning) {
+        Com_DPrintf("[%s] Snapshot scan failed: %s\n", mvd->name, text);
+        longjmp(mvd_scanjmp, -1);
+    }
+
     Com_Printf("[%s] =X= %s\n", mvd->name, text);
 
     // notify spectators
@@ -544,36 +563,26 @@ static int demo_read_first(qhandle_t f)
 #define MIN_SNAPSHOTS   64
 #define MAX_SNAPSHOTS   250000000
 
-// periodically builds a fake demo packet used to reconstruct delta compression
-// state, configstrings and layouts at the given server frame.
-static void demo_emit_snapshot(mvd_t *mvd)
+static bool demo_need_snapshot(const mvd_t *mvd, int framenum)
 {
-    mvd_snap_t *snap;
-    gtv_t *gtv;
-    int64_t pos;
-    char *from, *to;
-    size_t len;
-    int i;
-
     if (mvd_snaps->integer <= 0)
-        return;
-
-    if (mvd->framenum < mvd->last_snapshot + mvd_snaps->integer * BASE_FRAMERATE)
-        return;
-
-    if (mvd->numsnapshots >= MAX_SNAPSHOTS)
-        return;
+        return false;
 
-    gtv = mvd->gtv;
-    if (!gtv)
-        return;
+    if (framenum < mvd->last_snapshot + mvd_snaps->integer * BASE_FRAMERATE)
+        return false;
 
-    if (!gtv->demosize)
-        return;
+    return mvd->numsnapshots < MAX_SNAPSHOTS;
+}
 
-    pos = FS_Tell(gtv->demoplayback);
-    if (pos < gtv->demoofs)
-        return;
+// builds a fake demo packet used to reconstruct delta compression state,
+// configstrings and layouts at the current frame of `mvd', and appends it to
+// snapshot list of `dst'.
+static void demo_build_snapshot(mvd_t *mvd, mvd_t *dst, int64_t pos)
+{
+    mvd_snap_t *snap;
+    char *from, *to;
+    size_t len;
+    int i;
 
     // write baseline frame
     MSG_WriteByte(mvd_frame);
@@ -635,18 +644,41 @@ static void demo_emit_snapshot(mvd_t *mvd)
         snap->msglen = msg_write.cursize;
         memcpy(snap->data, msg_write.data, msg_write.cursize);
 
-        if (!mvd->snapshots)
-            mvd->snapshots = MVD_Malloc(sizeof(mvd->snapshots[0]) * MIN_SNAPSHOTS);
+        if (!dst->snapshots)
+            dst->snapshots = MVD_Malloc(sizeof(dst->snapshots[0]) * MIN_SNAPSHOTS);
         else
-            mvd->snapshots = Z_Realloc(mvd->snapshots, sizeof(mvd->snapshots[0]) * Q_ALIGN(mvd->numsnapshots + 1, MIN_SNAPSHOTS));
-        mvd->snapshots[mvd->numsnapshots++] = snap;
+            dst->snapshots = Z_Realloc(dst->snapshots, sizeof(dst->snapshots[0]) * Q_ALIGN(dst->numsnapshots + 1, MIN_SNAPSHOTS));
+        dst->snapshots[dst->numsnapshots++] = snap;
 
         Com_DPrintf("[%d] snaplen %u\n", mvd->framenum, msg_write.cursize);
     }
 
     SZ_Clear(&msg_write);
 
-    mvd->last_snapshot = mvd->framenum;
+    dst->last_snapshot = mvd->framenum;
+}
+
+// periodically saves snapshots at the given server frame.
+static void demo_emit_snapshot(mvd_t *mvd)
+{
+    gtv_t *gtv;
+    int64_t pos;
+
+    if (!demo_need_snapshot(mvd, mvd->framenum))
+        return;
+
+    gtv = mvd->gtv;
+    if (!gtv)
+        return;
+
+    if (!gtv->demosize)
+        return;
+
+    pos = FS_Tell(gtv->demoplayback);
+    if (pos < gtv->demoofs)
+        return;
+
+    demo_build_snapshot(mvd, mvd, pos);
 }
 
 static mvd_snap_t *demo_find_snapshot(mvd_t *mvd, int64_t dest, bool byte_seek)
@@ -672,6 +704,129 @@ static mvd_snap_t *demo_find_snapshot(mvd_t *mvd, int64_t dest, bool byte_seek)
     return mvd->snapshots[max(r, 0)];
 }
 
+/*
+Snapshot scanner walks the demo ahead of playback position through a separate
+file handle, parsing into a private copy of channel state taken right after
+gamestate. It runs for a limited time each frame and fills snapshot list of
+the real channel, so that seeks don't have to parse the whole demo up to the
+destination point.
+*/
+static void demo_scan_stop(gtv_t *gtv)
+{
+    mvd_t *scan = gtv->demoscan;
+
+    if (!scan)
+        return;
+
+    scan->gtv = NULL;
+    MVD_Free(scan);
+    gtv->demoscan = NULL;
+
+    FS_CloseFile(gtv->demoscanfile);
+    gtv->demoscanfile = 0;
+}
+
+static void demo_scan_start(gtv_t *gtv)
+{
+    mvd_t *mvd = gtv->mvd;
+    mvd_t *scan;
+    qhandle_t f;
+    int64_t ret;
+    int i;
+
+    demo_scan_stop(gtv);
+
+    if (mvd_snaps->integer <= 0 || mvd_snapscan->integer <= 0)
+        return;
+
+    if (!gtv->demosize)
+        return;
+
+    ret = FS_OpenFile(gtv->demoentry->string, &f, FS_MODE_READ | FS_FLAG_GZIP);
+    if (!f) {
+        Com_DPrintf("[%s] Couldn't open %s for scanning: %s\n",
+                    gtv->name, gtv->demoentry->string, Q_ErrorString(ret));
+        return;
+    }
+
+    ret = FS_Seek(f, FS_Tell(gtv->demoplayback), SEEK_SET);
+    if (ret < 0) {
+        Com_DPrintf("[%s] Couldn't seek %s for scanning: %s\n",
+                    gtv->name, gtv->demoentry->string, Q_ErrorString(ret));
+        FS_CloseFile(f);
+        return;
+    }
+
+    // copy channel state, dropping everything not needed for parsing
+    scan = MVD_Malloc(sizeof(*scan));
+    memcpy(scan, mvd, sizeof(*scan));
+    List_Init(&scan->entry);
+    List_Init(&scan->clients);
+    scan->ge.edicts = scan->edicts;
+    scan->read_frame = NULL;
+    scan->forward_cmd = NULL;
+    scan->demorecording = 0;
+    scan->demoname = NULL;
+    scan->demoseeking = true;
+    scan->demoscanning = true;
+    scan->snapshots = NULL;
+    scan->numsnapshots = 0;
+    memset(&scan->delay, 0, sizeof(scan->delay));
+    memset(&scan->cm, 0, sizeof(scan->cm));
+
+    scan->players = MVD_Malloc(sizeof(scan->players[0]) * mvd->maxclients);
+    memcpy(scan->players, mvd->players, sizeof(scan->players[0]) * mvd->maxclients);
+    for (i = 0; i < mvd->maxclients; i++)
+        scan->players[i].configstrings = NULL;
+    if (mvd->dummy)
+        scan->dummy = scan->players + mvd->clientNum;
+
+    gtv->demoscan = scan;
+    gtv->demoscanfile = f;
+}
+
+static void demo_scan_frame(gtv_t *gtv)
+{
+    mvd_t *mvd = gtv->mvd;
+    mvd_t *scan = gtv->demoscan;
+    unsigned start;
+    int ret;
+
+    if (!scan)
+        return;
+
+    if (mvd_snaps->integer <= 0 || mvd_snapscan->integer <= 0) {
+        demo_scan_stop(gtv);
+        return;
+    }
+
+    if (setjmp(mvd_scanjmp)) {
+        demo_scan_stop(gtv);
+        return;
+    }
+
+    start = Sys_Milliseconds();
+    do {
+        ret = demo_read_message(gtv->demoscanfile);
+
+        // stop at end of file or at next map
+        if (ret <= 0 || (msg_read_buffer[0] & SVCMD_MASK) == mvd_serverdata) {
+            if (ret < 0)
+                Com_DPrintf("[%s] Couldn't scan %s: %s\n", gtv->name,
+                            gtv->demoentry->string, Q_ErrorString(ret));
+            Com_DPrintf("[%s] Scanned up to frame %d, %d snapshots\n",
+                        gtv->name, scan->framenum, mvd->numsnapshots);
+            demo_scan_stop(gtv);
+            return;
+        }
+
+        MVD_ParseMessage(scan);
+
+        if (demo_need_snapshot(mvd, scan->framenum))
+            demo_build_snapshot(scan, mvd, FS_Tell(gtv->demoscanfile));
+    } while (Sys_Milliseconds() - start < mvd_snapscan->integer);
+}
+
 static void demo_update(gtv_t *gtv)
 {
     if (gtv->demosize) {
@@ -707,6 +862,8 @@ static bool demo_read_frame(mvd_t *mvd)
         MVD_Destroyf(mvd, "End of MVD stream reached");
     }
 
+    demo_scan_frame(gtv);
+
     if (gtv->demowait) {
         gtv->demowait = false;
         return false;
@@ -732,7 +889,8 @@ static bool demo_read_frame(mvd_t *mvd)
 
     demo_update(gtv);
 
-    MVD_ParseMessage(mvd);
+    if (MVD_ParseMessage(mvd))
+        demo_scan_start(gtv);
     demo_emit_snapshot(mvd);
     return true;
 
@@ -806,6 +964,7 @@ static void demo_play_next(gtv_t *gtv, string_entry_t *entry)
     }
 
     demo_emit_snapshot(gtv->mvd);
+    demo_scan_start(gtv);
 }
 
 static void demo_free_playlist(gtv_t *gtv)
@@ -824,6 +983,8 @@ static void demo_destroy(gtv_t *gtv)
 {
     mvd_t *mvd = gtv->mvd;
 
+    demo_scan_stop(gtv);
+
     // destroy any associated MVD channel
     if (mvd) {
         mvd->gtv = NULL;
@@ -2380,6 +2541,7 @@ static void MVD_Seek_f(void)
         if (gamestate) {
             // got a gamestate, abort seek
             Com_DPrintf("got gamestate while seeking!\n");
+            demo_scan_start(gtv);
             goto done;
         }
     }
@@ -2718,6 +2880,7 @@ void MVD_Register(void)
     mvd_username = Cvar_Get("mvd_username", "unnamed", 0);
     mvd_password = Cvar_Get("mvd_password", "", CVAR_PRIVATE);
     mvd_snaps = Cvar_Get("mvd_snaps", "10", 0);
+    mvd_snapscan = Cvar_Get("mvd_snapscan", "10", 0);
 
     Cmd_Register(c_mvd);
 }
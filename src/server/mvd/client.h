@@ -141,6 +141,7 @@ typedef struct mvd_s {
     qhandle_t   demorecording;
     char        *demoname;
     bool        demoseeking;
+    bool        demoscanning;   // private copy used by snapshot scanner
     int         last_snapshot;
     mvd_snap_t  **snapshots;
     int         numsnapshots;
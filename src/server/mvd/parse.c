@@ -126,7 +126,8 @@ static void MVD_ParseMulticast(mvd_t *mvd, multicast_t to, int extrabits)
 {
     mvd_client_t    *client;
     client_t        *cl;
-    visrow_t        mask;
+    visrow_t        temp;
+    const visrow_t  *mask = NULL;
     const mleaf_t   *leaf1, *leaf2;
     vec3_t          org;
     bool            reliable = false;
@@ -155,7 +156,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, multicast_t to, int extrabits)
 
     if (to) {
         leaf1 = CM_LeafNum(&mvd->cm, leafnum);
-        BSP_ClusterVis(mvd->cm.cache, &mask, leaf1->cluster, MULTICAST_PVS - to);
+        mask = BSP_GetClusterVis(mvd->cm.cache, &temp, leaf1->cluster, MULTICAST_PVS - to);
     }
 
     // send the data to all relevent clients
@@ -177,7 +178,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, multicast_t to, int extrabits)
                 continue;
             if (leaf2->cluster == -1)
                 continue;
-            if (!Q_IsBitSet(mask.b, leaf2->cluster))
+            if (!Q_IsBitSet(mask->b, leaf2->cluster))
                 continue;
         }
 
@@ -428,7 +429,8 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
     vec3_t      origin, org;
     mvd_client_t        *client;
     client_t    *cl;
-    visrow_t    mask;
+    visrow_t    temp;
+    const visrow_t  *mask = NULL;
     const mleaf_t       *leaf1, *leaf2;
     message_packet_t    *msg;
     edict_t     *entity;
@@ -493,7 +495,7 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
     leaf1 = NULL;
     if (!(extrabits & 1)) {
         leaf1 = CM_PointLeaf(&mvd->cm, origin);
-        BSP_ClusterVis(mvd->cm.cache, &mask, leaf1->cluster, DVIS_PHS);
+        mask = BSP_GetClusterVis(mvd->cm.cache, &temp, leaf1->cluster, DVIS_PHS);
     }
 
     FOR_EACH_MVDCL(client, mvd) {
@@ -512,7 +514,7 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
                 continue;
             if (leaf2->cluster == -1)
                 continue;
-            if (!Q_IsBitSet(mask.b, leaf2->cluster))
+            if (!Q_IsBitSet(mask->b, leaf2->cluster))
                 continue;
         }
 
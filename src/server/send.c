@@ -18,6 +18,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // sv_send.c
 
 #include "server.h"
+#include "system/pthread.h"
+
+#include <setjmp.h>
 
 /*
 =============================================================================
@@ -239,6 +242,142 @@ void SV_BroadcastCommand(const char *fmt, ...)
 }
 
 
+/*
+===============================================================================
+
+MULTICAST CLIENT LEAFS
+
+Leafs of clients are only looked up again when clients move, and clients are
+sorted into buckets by cluster, so that multicasts test visibility once per
+occupied cluster instead of walking the BSP tree for each client.
+
+===============================================================================
+*/
+
+typedef struct {
+    int     cluster;
+    int     first;
+    int     count;
+} leafbucket_t;
+
+typedef struct {
+    const mleaf_t   *leaf;
+    vec3_t          origin;
+} clientleaf_t;
+
+static struct {
+    int             spawncount;
+    int             numbuckets;
+    leafbucket_t    buckets[MAX_CLIENTS];
+    client_t        *clients[MAX_CLIENTS];  // sorted by cluster
+    int             areas[MAX_CLIENTS];
+    clientleaf_t    leafs[MAX_CLIENTS];     // indexed by client slot
+} leafcache;
+
+static void build_leaf_buckets(void)
+{
+    leafbucket_t *bucket = NULL;
+    const mleaf_t *leaf;
+    client_t *client;
+    int i, j, count = 0;
+    int clusters[MAX_CLIENTS];
+
+    FOR_EACH_CLIENT(client) {
+        leaf = leafcache.leafs[client - svs.client_pool].leaf;
+        if (!leaf || leaf->cluster == -1)
+            continue;
+
+        // insertion sort by cluster, client count is small
+        for (i = count; i > 0 && clusters[i - 1] > leaf->cluster; i--) {
+            leafcache.clients[i] = leafcache.clients[i - 1];
+            leafcache.areas[i] = leafcache.areas[i - 1];
+            clusters[i] = clusters[i - 1];
+        }
+        leafcache.clients[i] = client;
+        leafcache.areas[i] = leaf->area;
+        clusters[i] = leaf->cluster;
+        count++;
+    }
+
+    for (i = j = 0; i < count; i++) {
+        if (!bucket || bucket->cluster != clusters[i]) {
+            bucket = &leafcache.buckets[j++];
+            bucket->cluster = clusters[i];
+            bucket->first = i;
+            bucket->count = 0;
+        }
+        bucket->count++;
+    }
+
+    leafcache.numbuckets = j;
+}
+
+static void update_client_leafs(void)
+{
+    bool changed = false;
+    const mleaf_t *leaf;
+    clientleaf_t *cl;
+    client_t *client;
+
+    // leaf pointers are invalid after map change
+    if (leafcache.spawncount != sv.spawncount) {
+        memset(leafcache.leafs, 0, sizeof(leafcache.leafs));
+        leafcache.spawncount = sv.spawncount;
+        changed = true;
+    }
+
+    FOR_EACH_CLIENT(client) {
+        cl = &leafcache.leafs[client - svs.client_pool];
+
+        if (client->state < cs_primed) {
+            if (cl->leaf) {
+                cl->leaf = NULL;
+                changed = true;
+            }
+            continue;
+        }
+
+        if (cl->leaf && VectorCompare(client->edict->s.origin, cl->origin))
+            continue;
+
+        leaf = CM_PointLeaf(&sv.cm, client->edict->s.origin);
+        VectorCopy(client->edict->s.origin, cl->origin);
+
+        if (!cl->leaf || cl->leaf->cluster != leaf->cluster || cl->leaf->area != leaf->area)
+            changed = true;
+        cl->leaf = leaf;
+    }
+
+    if (changed)
+        build_leaf_buckets();
+}
+
+/*
+=================
+SV_ClientsInVis
+
+Fills `clients' with primed clients that are in clusters set in `mask' and
+in areas connected to `area'. Returns number of clients found.
+=================
+*/
+int SV_ClientsInVis(client_t **clients, const visrow_t *mask, int area)
+{
+    const leafbucket_t *bucket;
+    int i, j, count = 0;
+
+    update_client_leafs();
+
+    for (i = 0, bucket = leafcache.buckets; i < leafcache.numbuckets; i++, bucket++) {
+        if (!Q_IsBitSet(mask->b, bucket->cluster))
+            continue;
+        for (j = bucket->first; j < bucket->first + bucket->count; j++)
+            if (CM_AreasConnected(&sv.cm, area, leafcache.areas[j]))
+                clients[count++] = leafcache.clients[j];
+    }
+
+    return count;
+}
+
 /*
 =================
 SV_Multicast
@@ -255,10 +394,11 @@ MULTICAST_PHS    send to clients potentially hearable from org
 */
 void SV_Multicast(const vec3_t origin, multicast_t to)
 {
-    client_t        *client;
-    visrow_t        mask;
+    client_t        *client, *clients[MAX_CLIENTS];
+    visrow_t        temp;
+    const visrow_t  *mask;
     const mleaf_t   *leaf1 = NULL;
-    int             flags = 0;
+    int             i, count, flags = 0;
 
     if (to < MULTICAST_ALL || to > MULTICAST_PVS_R)
         Com_Error(ERR_DROP, "%s: bad to: %d", __func__, to);
@@ -281,11 +421,17 @@ void SV_Multicast(const vec3_t origin, multicast_t to)
 
     if (to) {
         leaf1 = CM_PointLeaf(&sv.cm, origin);
-        BSP_ClusterVis(sv.cm.cache, &mask, leaf1->cluster, MULTICAST_PVS - to);
+        mask = BSP_GetClusterVis(sv.cm.cache, &temp, leaf1->cluster, MULTICAST_PVS - to);
+        count = SV_ClientsInVis(clients, mask, leaf1->area);
+    } else {
+        count = 0;
+        FOR_EACH_CLIENT(client)
+            clients[count++] = client;
     }
 
     // send the data to all relevent clients
-    FOR_EACH_CLIENT(client) {
+    for (i = 0; i < count; i++) {
+        client = clients[i];
         if (client->state < cs_primed) {
             continue;
         }
@@ -294,16 +440,6 @@ void SV_Multicast(const vec3_t origin, multicast_t to)
             continue;
         }
 
-        if (to) {
-            const mleaf_t *leaf2 = CM_PointLeaf(&sv.cm, client->edict->s.origin);
-            if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
-                continue;
-            if (leaf2->cluster == -1)
-                continue;
-            if (!Q_IsBitSet(mask.b, leaf2->cluster))
-                continue;
-        }
-
         SV_ClientAddMessage(client, flags);
     }
 
@@ -315,7 +451,15 @@ void SV_Multicast(const vec3_t origin, multicast_t to)
 }
 
 #if USE_ZLIB
-static bool can_auto_compress(const client_t *client)
+/*
+=======================
+SV_CanAutoCompress
+
+Returns true if messages with MSG_COMPRESS_AUTO may be compressed for the
+client, not counting message size.
+=======================
+*/
+bool SV_CanAutoCompress(const client_t *client)
 {
     if (!client->has_zlib)
         return false;
@@ -328,6 +472,14 @@ static bool can_auto_compress(const client_t *client)
             return false;
     }
 
+    return true;
+}
+
+static bool can_auto_compress(const client_t *client)
+{
+    if (!SV_CanAutoCompress(client))
+        return false;
+
     // compress only sufficiently large layouts
     if (msg_write.cursize < client->netchan.maxpacketlen / 2)
         return false;
@@ -374,11 +526,39 @@ static byte *get_compressed_data(void)
     return svs.z_buffer;
 }
 #else
+bool SV_CanAutoCompress(const client_t *client)
+{
+    return false;
+}
+
 #define can_auto_compress(c)    false
 #define compress_message(c)     0
 #define get_compressed_data()   NULL
 #endif
 
+/*
+=======================
+SV_PackMessage
+
+Returns contents of the current write buffer, compressed for the given client
+if requested and if that makes it smaller. Compressed data is only valid until
+the next call.
+=======================
+*/
+const byte *SV_PackMessage(const client_t *client, int flags, int *len)
+{
+    if ((flags & MSG_COMPRESS_AUTO) && can_auto_compress(client)) {
+        flags |= MSG_COMPRESS;
+    }
+
+    if ((flags & MSG_COMPRESS) && (*len = compress_message(client)) && *len < msg_write.cursize) {
+        return get_compressed_data();
+    }
+
+    *len = msg_write.cursize;
+    return msg_write.data;
+}
+
 /*
 =======================
 SV_ClientAddMessage
@@ -390,6 +570,7 @@ unless told otherwise.
 */
 void SV_ClientAddMessage(client_t *client, int flags)
 {
+    const byte *data;
     int len;
 
     Q_assert(!msg_write.overflowed);
@@ -398,16 +579,13 @@ void SV_ClientAddMessage(client_t *client, int flags)
         return;
     }
 
-    if ((flags & MSG_COMPRESS_AUTO) && can_auto_compress(client)) {
-        flags |= MSG_COMPRESS;
-    }
+    data = SV_PackMessage(client, flags, &len);
+    client->AddMessage(client, data, len, flags & MSG_RELIABLE);
 
-    if ((flags & MSG_COMPRESS) && (len = compress_message(client)) && len < msg_write.cursize) {
-        client->AddMessage(client, get_compressed_data(), len, flags & MSG_RELIABLE);
+    if (data != msg_write.data) {
         SV_DPrintf(1, "Compressed %sreliable message to %s: %u into %d\n",
                    (flags & MSG_RELIABLE) ? "" : "un", client->name, msg_write.cursize, len);
     } else {
-        client->AddMessage(client, msg_write.data, msg_write.cursize, flags & MSG_RELIABLE);
         SV_DPrintf(2, "Added %sreliable message to %s: %u bytes\n",
                    (flags & MSG_RELIABLE) ? "" : "un", client->name, msg_write.cursize);
     }
@@ -710,11 +888,10 @@ static void repack_unreliables(client_t *client, unsigned maxsize)
     }
 }
 
-static void write_datagram_old(client_t *client)
+static unsigned frame_maxsize_old(const client_t *client)
 {
-    message_packet_t *msg;
-    unsigned maxsize, cursize;
-    bool ret;
+    const message_packet_t *msg;
+    unsigned maxsize;
 
     // determine how much space is left for unreliable data
     maxsize = client->netchan.maxpacketlen;
@@ -731,16 +908,13 @@ static void write_datagram_old(client_t *client)
     }
     Q_assert(maxsize <= client->netchan.maxpacketlen);
 
-    // send over all the relevant entity_state_t
-    // and the player_state_t
-    if (client->protocol == PROTOCOL_VERSION_DEFAULT)
-        ret = SV_WriteFrameToClient_Default(client, maxsize);
-    else
-        ret = SV_WriteFrameToClient_Enhanced(client, maxsize);
-    if (!ret) {
-        SV_DPrintf(1, "Frame %d overflowed for %s\n", client->framenum, client->name);
-        SZ_Clear(&msg_write);
-    }
+    return maxsize;
+}
+
+// frame data must be already written
+static void write_datagram_old(client_t *client, unsigned maxsize)
+{
+    unsigned cursize;
 
     // now write unreliable messages
     // it is necessary for this to be after the WriteFrame
@@ -800,18 +974,11 @@ static void add_message_new(client_t *client, const byte *data,
     }
 }
 
+// frame data must be already written
 static void write_datagram_new(client_t *client)
 {
     int cursize;
 
-    // send over all the relevant entity_state_t
-    // and the player_state_t
-    if (!SV_WriteFrameToClient_Enhanced(client, msg_write.maxsize)) {
-        // should never really happen
-        Com_WPrintf("Frame overflowed for %s\n", client->name);
-        SZ_Clear(&msg_write);
-    }
-
     // now write unreliable messages
     // for this client out to the message
     // it is necessary for this to be after the WriteFrame
@@ -846,7 +1013,6 @@ static void write_datagram_new(client_t *client)
     SZ_Clear(&msg_write);
 }
 
-
 /*
 ===============================================================================
 
@@ -865,6 +1031,42 @@ static void finish_frame(client_t *client)
     client->msg_unreliable_bytes = 0;
 }
 
+static unsigned frame_maxsize(const client_t *client)
+{
+    if (client->netchan.type == NETCHAN_NEW)
+        return MAX_MSGLEN;
+
+    return frame_maxsize_old(client);
+}
+
+// send over all the relevant entity_state_t
+// and the player_state_t
+static bool write_frame(client_t *client, unsigned maxsize)
+{
+    if (client->netchan.type == NETCHAN_OLD && client->protocol == PROTOCOL_VERSION_DEFAULT)
+        return SV_WriteFrameToClient_Default(client, maxsize);
+
+    return SV_WriteFrameToClient_Enhanced(client, maxsize);
+}
+
+static void write_datagram(client_t *client, unsigned maxsize, bool frame_ok)
+{
+    if (client->netchan.type == NETCHAN_NEW) {
+        if (!frame_ok) {
+            // should never really happen
+            Com_WPrintf("Frame overflowed for %s\n", client->name);
+            SZ_Clear(&msg_write);
+        }
+        write_datagram_new(client);
+    } else {
+        if (!frame_ok) {
+            SV_DPrintf(1, "Frame %d overflowed for %s\n", client->framenum, client->name);
+            SZ_Clear(&msg_write);
+        }
+        write_datagram_old(client, maxsize);
+    }
+}
+
 #if USE_DEBUG && USE_FPS
 static void check_key_sync(const client_t *client)
 {
@@ -880,6 +1082,230 @@ static void check_key_sync(const client_t *client)
 }
 #endif
 
+/*
+===============================================================================
+
+PARALLEL FRAME BUILDING
+
+Client frames are built and delta compressed by worker threads, each one
+having its own msg_write pointed to a per-client job buffer. Main thread
+then merges encoded frames back in client list order, appends unreliable
+and reliable messages and transmits datagrams as usual.
+
+Game DLL is never called from worker threads. If game exports per-client
+entity visibility callbacks, frames are built serially.
+
+===============================================================================
+*/
+
+typedef struct {
+    client_t    *client;
+    unsigned    maxsize;
+    unsigned    cursize;
+    bool        frame_ok;
+    bool        failed;     // Com_Error raised while building
+    error_type_t    error_code;
+    char        error[MAXERRORMSG];
+    uint64_t    build_time, encode_time;
+    byte        *data;      // [MAX_MSGLEN]
+} frame_job_t;
+
+static struct {
+    int             num_threads;
+    pthread_t       threads[SV_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t  work_cond;
+    pthread_cond_t  done_cond;
+    bool            terminate;
+    int             num_jobs;
+    int             next_job;
+    int             jobs_done;
+    frame_job_t     *jobs;      // [svs.maxclients]
+    byte            *buffers;   // [svs.maxclients * MAX_MSGLEN]
+} frame_pool;
+
+static q_thread_local frame_job_t  *current_job;
+static q_thread_local jmp_buf      job_abort;
+
+// record error to be raised on main thread once all jobs are done
+static void frame_job_error(error_type_t code, const char *msg)
+{
+    frame_job_t *job = current_job;
+
+    job->failed = true;
+    job->error_code = code;
+    Q_strlcpy(job->error, msg, sizeof(job->error));
+    longjmp(job_abort, -1);
+}
+
+static void build_frame_job(frame_job_t *job)
+{
+    int profdepth = com_profdepth;
+    uint64_t time;
+
+    job->failed = false;
+    current_job = job;
+    if (setjmp(job_abort)) {
+        // discard zones opened by the job only
+        Com_SetErrorFunc(NULL);
+        com_profdepth = profdepth;
+        return;
+    }
+    Com_SetErrorFunc(frame_job_error);
+
+    SZ_Init(&msg_write, job->data, MAX_MSGLEN, "msg_write");
+    msg_write.allowoverflow = true;
+
+    PROF_BEGIN("SV_BuildClientFrame");
+    time = SV_BenchTime();
+    SV_BuildClientFrame(job->client);
+    job->build_time = SV_BenchTime() - time;
+    PROF_END();
+
+    PROF_BEGIN("write_frame");
+    time = SV_BenchTime();
+    job->frame_ok = write_frame(job->client, job->maxsize);
+    job->encode_time = SV_BenchTime() - time;
+    PROF_END();
+
+    job->cursize = msg_write.cursize;
+
+    Com_SetErrorFunc(NULL);
+}
+
+// called with lock held
+static void run_frame_jobs(void)
+{
+    frame_job_t *job;
+
+    while (frame_pool.next_job < frame_pool.num_jobs) {
+        job = &frame_pool.jobs[frame_pool.next_job++];
+
+        pthread_mutex_unlock(&frame_pool.lock);
+        build_frame_job(job);
+        pthread_mutex_lock(&frame_pool.lock);
+
+        if (++frame_pool.jobs_done == frame_pool.num_jobs)
+            pthread_cond_signal(&frame_pool.done_cond);
+    }
+}
+
+static void *frame_thread_func(void *arg)
+{
+    pthread_mutex_lock(&frame_pool.lock);
+    while (1) {
+        while (frame_pool.next_job >= frame_pool.num_jobs && !frame_pool.terminate)
+            pthread_cond_wait(&frame_pool.work_cond, &frame_pool.lock);
+
+        if (frame_pool.terminate)
+            break;
+
+        run_frame_jobs();
+    }
+    pthread_mutex_unlock(&frame_pool.lock);
+
+    return NULL;
+}
+
+static void build_frames_parallel(int num_jobs)
+{
+    sizebuf_t saved = msg_write;
+    int i;
+
+    pthread_mutex_lock(&frame_pool.lock);
+    frame_pool.num_jobs = num_jobs;
+    frame_pool.next_job = 0;
+    frame_pool.jobs_done = 0;
+    pthread_cond_broadcast(&frame_pool.work_cond);
+
+    // main thread helps too
+    run_frame_jobs();
+
+    while (frame_pool.jobs_done < frame_pool.num_jobs)
+        pthread_cond_wait(&frame_pool.done_cond, &frame_pool.lock);
+
+    frame_pool.num_jobs = 0;
+    pthread_mutex_unlock(&frame_pool.lock);
+
+    msg_write = saved;
+
+    // all workers are idle now, safe to abort the frame
+    for (i = 0; i < num_jobs; i++)
+        if (frame_pool.jobs[i].failed)
+            Com_Error(frame_pool.jobs[i].error_code, "%s", frame_pool.jobs[i].error);
+}
+
+static bool can_build_parallel(void)
+{
+    if (!frame_pool.num_threads)
+        return false;
+
+    // game callbacks are not thread safe
+    if (gex && gex->apiversion >= GAME_API_VERSION_EX_ENTITY_VISIBLE &&
+        (gex->EntityVisibleToClient || gex->CustomizeEntityToClient))
+        return false;
+
+    return true;
+}
+
+void SV_InitFrameThreads(void)
+{
+    int i, count = min(sv_threads->integer, SV_MAX_THREADS);
+
+    if (count < 1 || frame_pool.num_threads)
+        return;
+
+    pthread_mutex_init(&frame_pool.lock, NULL);
+    pthread_cond_init(&frame_pool.work_cond, NULL);
+    pthread_cond_init(&frame_pool.done_cond, NULL);
+    frame_pool.terminate = false;
+    frame_pool.num_jobs = frame_pool.next_job = frame_pool.jobs_done = 0;
+
+    frame_pool.jobs = SV_Mallocz(sizeof(frame_pool.jobs[0]) * svs.maxclients);
+    frame_pool.buffers = SV_Malloc(MAX_MSGLEN * svs.maxclients);
+    for (i = 0; i < svs.maxclients; i++)
+        frame_pool.jobs[i].data = frame_pool.buffers + MAX_MSGLEN * i;
+
+    for (i = 0; i < count; i++) {
+        if (pthread_create(&frame_pool.threads[i], NULL, frame_thread_func, NULL)) {
+            Com_EPrintf("Couldn't create frame thread %d\n", i);
+            break;
+        }
+    }
+
+    frame_pool.num_threads = i;
+    if (!i) {
+        SV_ShutdownFrameThreads();
+        return;
+    }
+
+    Com_DPrintf("Started %d frame threads\n", i);
+}
+
+void SV_ShutdownFrameThreads(void)
+{
+    int i;
+
+    if (!frame_pool.jobs)
+        return;
+
+    pthread_mutex_lock(&frame_pool.lock);
+    frame_pool.terminate = true;
+    pthread_cond_broadcast(&frame_pool.work_cond);
+    pthread_mutex_unlock(&frame_pool.lock);
+
+    for (i = 0; i < frame_pool.num_threads; i++)
+        Q_assert(!pthread_join(frame_pool.threads[i], NULL));
+
+    pthread_mutex_destroy(&frame_pool.lock);
+    pthread_cond_destroy(&frame_pool.work_cond);
+    pthread_cond_destroy(&frame_pool.done_cond);
+
+    Z_Freep(&frame_pool.jobs);
+    Z_Freep(&frame_pool.buffers);
+    frame_pool.num_threads = 0;
+}
+
 /*
 =======================
 SV_SendClientMessages
@@ -891,7 +1317,19 @@ Clients in earlier connection state are handled in SV_SendAsyncPackets.
 void SV_SendClientMessages(void)
 {
     client_t    *client;
-    int         cursize;
+    frame_job_t *job;
+    unsigned    maxsize;
+    int         i, cursize, num_jobs = 0;
+    bool        parallel = can_build_parallel();
+    bool        frame_ok;
+    uint64_t    time;
+
+    // gather entity state for culling once for all clients
+    SV_PrepareCullEntities();
+    SV_ClearDeltaCache();
+
+    // collect outgoing datagrams to send them all at once
+    NET_BeginSendBatch(NS_SERVER);
 
     // send a message to each connected client
     FOR_EACH_CLIENT(client) {
@@ -921,18 +1359,31 @@ void SV_SendClientMessages(void)
         // don't write any frame data until all fragments are sent
         if (client->netchan.fragment_pending) {
             client->frameflags |= FF_SUPPRESSED;
+            time = SV_BenchTime();
             cursize = Netchan_TransmitNextFragment(&client->netchan);
+            SV_BenchAccum(BENCH_TRANSMIT, &time);
             SV_CalcSendTime(client, cursize);
             goto advance;
         }
 
+        maxsize = frame_maxsize(client);
+
+        // leave it to worker threads
+        if (parallel) {
+            job = &frame_pool.jobs[num_jobs++];
+            job->client = client;
+            job->maxsize = maxsize;
+            continue;
+        }
+
         // build the new frame and write it
+        time = SV_BenchTime();
         SV_BuildClientFrame(client);
-
-        if (client->netchan.type == NETCHAN_NEW)
-            write_datagram_new(client);
-        else
-            write_datagram_old(client);
+        SV_BenchAccum(BENCH_BUILD, &time);
+        frame_ok = write_frame(client, maxsize);
+        SV_BenchAccum(BENCH_ENCODE, &time);
+        write_datagram(client, maxsize, frame_ok);
+        SV_BenchAccum(BENCH_TRANSMIT, &time);
 
 advance:
         // advance for next frame
@@ -942,6 +1393,32 @@ finish:
         // clear all unreliable messages still left
         finish_frame(client);
     }
+
+    if (num_jobs) {
+        build_frames_parallel(num_jobs);
+
+        // merge encoded frames in client list order
+        for (i = 0; i < num_jobs; i++) {
+            job = &frame_pool.jobs[i];
+            client = job->client;
+
+            SV_BenchAdd(BENCH_BUILD, job->build_time);
+            SV_BenchAdd(BENCH_ENCODE, job->encode_time);
+
+            time = SV_BenchTime();
+            if (job->frame_ok)
+                SZ_Write(&msg_write, job->data, job->cursize);
+            write_datagram(client, job->maxsize, job->frame_ok);
+            SV_BenchAccum(BENCH_TRANSMIT, &time);
+
+            client->framenum++;
+            finish_frame(client);
+        }
+    }
+
+    time = SV_BenchTime();
+    NET_FlushSendBatch();
+    SV_BenchAccum(BENCH_TRANSMIT, &time);
 }
 
 static void write_pending_download(client_t *client)
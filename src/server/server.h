@@ -36,6 +36,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/net/chan.h"
 #include "common/net/net.h"
 #include "common/pmove.h"
+#include "common/profile.h"
 #include "common/prompt.h"
 #include "common/protocol.h"
 #include "common/zone.h"
@@ -134,6 +135,32 @@ typedef struct {
 #endif
 } server_entity_t;
 
+// entity culling flags, see SV_PrepareCullEntities
+#define CULL_FREE       BIT(0)
+#define CULL_NOCLIENT   BIT(1)
+#define CULL_NOEFFECTS  BIT(2)
+#define CULL_GIB        BIT(3)
+#define CULL_GIB_EXT    BIT(4)
+#define CULL_FLARE      BIT(5)
+#define CULL_NOCULL     BIT(6)
+#define CULL_BEAM       BIT(7)
+#define CULL_SOUND      BIT(8)
+#define CULL_MODEL      BIT(9)
+
+// structure-of-arrays mirror of edict fields needed for culling, so that
+// building client frames doesn't need to walk sparse edicts per client.
+// link data is updated by PF_LinkEdict, the rest once per server frame.
+typedef struct {
+    int         num_edicts;
+    uint16_t    flags[MAX_EDICTS];
+    byte        areas[2][MAX_EDICTS];
+    int8_t      num_clusters[MAX_EDICTS];
+    int         headnode[MAX_EDICTS];
+    int         linkcount[MAX_EDICTS];
+    float       origin[3][MAX_EDICTS];
+    int         clusters[MAX_EDICTS][MAX_ENT_CLUSTERS];
+} cull_entities_t;
+
 // variable server FPS
 #if USE_FPS
 #define SV_FRAMERATE        sv.framerate
@@ -170,6 +197,8 @@ typedef struct {
     configstring_t  configstrings[MAX_CONFIGSTRINGS];
 
     server_entity_t entities[MAX_EDICTS];
+
+    cull_entities_t cull;
 } server_t;
 
 #define EDICT_NUM2(ge, n) ((edict_t *)((byte *)(ge)->edicts + (ge)->edict_size*(n)))
@@ -318,6 +347,10 @@ typedef struct client_s {
     int             suppress_count;                 // number of messages rate suppressed
     unsigned        send_time, send_delta;          // used to rate drop async packets
 
+    // entity update scheduling
+    unsigned        ents_deferred;      // updates deferred by distance
+    unsigned        ents_throttled;     // updates deferred by bandwidth
+
     // current download
     byte            *download;      // file being downloaded
     int             downloadsize;   // total bytes (can't use EOF because of paks)
@@ -407,11 +440,23 @@ typedef struct {
     list_t      entry;
     netadr_t    addr;
     netadr_t    mask;
+    int         bits;   // mask prefix length
+    unsigned    seq;    // position in list, first match wins
     unsigned    hits;
     time_t      time;   // time of the last hit
     char        comment[1];
 } addrmatch_t;
 
+typedef struct addrnode_s addrnode_t;
+
+typedef struct {
+    list_t      list;       // entries in order of addition
+    addrnode_t  *trie[2];   // IPv4 and IPv6 prefix tries
+    unsigned    nextseq;
+} addrlist_t;
+
+#define ADDRLIST_DECL(x)    addrlist_t x = { .list = { &x.list, &x.list } }
+
 typedef struct {
     list_t  entry;
     char    string[1];
@@ -499,8 +544,8 @@ typedef struct {
 
 extern master_t     sv_masters[MAX_MASTERS];    // address of the master server
 
-extern list_t       sv_banlist;
-extern list_t       sv_blacklist;
+extern addrlist_t   sv_banlist;
+extern addrlist_t   sv_blacklist;
 extern list_t       sv_cmdlist_connect;
 extern list_t       sv_cmdlist_begin;
 extern list_t       sv_lrconlist;
@@ -537,6 +582,13 @@ extern cvar_t       *sv_max_download_size;
 extern cvar_t       *sv_max_packet_entities;
 extern cvar_t       *sv_trunc_packet_entities;
 extern cvar_t       *sv_prioritize_entities;
+extern cvar_t       *sv_threads;
+extern cvar_t       *sv_broadphase;
+extern cvar_t       *sv_delta_cache;
+extern cvar_t       *sv_gamestate_cache;
+extern cvar_t       *sv_entity_tiers;
+extern cvar_t       *sv_entity_tier_dist;
+extern cvar_t       *sv_entity_budget;
 
 extern cvar_t       *sv_strafejump_hack;
 #if USE_PACKETDUP
@@ -584,7 +636,11 @@ bool SV_RateLimited(ratelimit_t *r);
 void SV_RateRecharge(ratelimit_t *r);
 void SV_RateInit(ratelimit_t *r, const char *s);
 
-addrmatch_t *SV_MatchAddress(const list_t *list, const netadr_t *address);
+addrmatch_t *SV_MatchAddress(const addrlist_t *list, const netadr_t *address);
+addrmatch_t *SV_FindMatch(const addrlist_t *list, const netadr_t *addr, int bits);
+void SV_AddMatch(addrlist_t *list, addrmatch_t *match);
+void SV_RemoveMatch(addrlist_t *list, addrmatch_t *match);
+void SV_ClearMatches(addrlist_t *list);
 
 int SV_CountClients(void);
 
@@ -596,6 +652,12 @@ void SV_zfree(voidpf opaque, voidpf address);
 void sv_sec_timeout_changed(cvar_t *self);
 void sv_min_timeout_changed(cvar_t *self);
 
+void SV_RunWorldFrame(void);
+
+#if USE_TESTS
+client_t *SV_AddFakeClient(const char *userinfo, int qport);
+#endif
+
 //
 // sv_init.c
 //
@@ -625,15 +687,23 @@ void SV_FlushRedirect(int redirected, const char *outputbuf, size_t len);
 void SV_SendClientMessages(void);
 void SV_SendAsyncPackets(void);
 
+int SV_ClientsInVis(client_t **clients, const visrow_t *mask, int area);
 void SV_Multicast(const vec3_t origin, multicast_t to);
 void SV_ClientPrintf(client_t *cl, int level, const char *fmt, ...) q_printf(3, 4);
 void SV_BroadcastPrintf(int level, const char *fmt, ...) q_printf(2, 3);
 void SV_ClientCommand(client_t *cl, const char *fmt, ...) q_printf(2, 3);
 void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
+bool SV_CanAutoCompress(const client_t *client);
+const byte *SV_PackMessage(const client_t *client, int flags, int *len);
 void SV_ClientAddMessage(client_t *client, int flags);
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
 
+#define SV_MAX_THREADS  16
+
+void SV_InitFrameThreads(void);
+void SV_ShutdownFrameThreads(void);
+
 //
 // sv_mvd.c
 //
@@ -722,6 +792,8 @@ void AC_Info_f(void);
 // sv_user.c
 //
 void SV_New_f(void);
+void SV_ConfigstringChanged(int index, size_t len);
+void SV_ShutdownGamestateCache(void);
 void SV_Begin_f(void);
 void SV_ExecuteClientMessage(client_t *cl);
 void SV_CloseDownload(client_t *client);
@@ -739,9 +811,10 @@ cvarban_t *SV_CheckInfoBans(const char *info, bool match_only);
 extern const cmd_option_t o_record[];
 #endif
 
-void SV_AddMatch_f(list_t *list);
-void SV_DelMatch_f(list_t *list);
-void SV_ListMatches_f(list_t *list);
+void SV_AddMatch_f(addrlist_t *list);
+void SV_DelMatch_f(addrlist_t *list);
+void SV_ListMatches_f(addrlist_t *list);
+void SV_LoadMatches_f(addrlist_t *list);
 client_t *SV_GetPlayer(const char *s, bool partial);
 void SV_PrintMiscInfo(void);
 
@@ -762,6 +835,11 @@ static inline void SV_CheckEntityNumber(edict_t *ent, int e, const char *func)
 
 #define SV_CheckEntityNumber(ent, e) SV_CheckEntityNumber(ent, e, __func__)
 
+void SV_ClearDeltaCache(void);
+void SV_ShutdownDeltaCache(void);
+void SV_DeltaStats_f(void);
+void SV_UpdateCullEntity(const edict_t *ent, int e);
+void SV_PrepareCullEntities(void);
 void SV_BuildClientFrame(client_t *client);
 bool SV_WriteFrameToClient_Default(client_t *client, unsigned maxsize);
 bool SV_WriteFrameToClient_Enhanced(client_t *client, unsigned maxsize);
@@ -794,6 +872,30 @@ void SV_RegisterSavegames(void);
 #define SV_RegisterSavegames()          (void)0
 #endif
 
+//
+// bench.c
+//
+#if USE_TESTS
+typedef enum {
+    BENCH_GAME,
+    BENCH_BUILD,
+    BENCH_ENCODE,
+    BENCH_TRANSMIT,
+    BENCH_MVD,
+
+    BENCH_NUM_PHASES
+} bench_phase_t;
+
+uint64_t SV_BenchTime(void);
+void SV_BenchAdd(bench_phase_t phase, uint64_t usec);
+void SV_BenchAccum(bench_phase_t phase, uint64_t *time);
+void SV_BenchFrames_f(void);
+#else
+#define SV_BenchTime()              0
+#define SV_BenchAdd(phase, usec)    (void)0
+#define SV_BenchAccum(phase, time)  (void)(time)
+#endif
+
 //
 // ugly gclient_(old|new)_t accessors
 //
@@ -862,6 +964,8 @@ int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs, edict_t **list, int maxc
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
+void SV_AreaStats_f(void);
+
 //===================================================================
 
 //
@@ -99,6 +99,255 @@ static void SV_CreateBaselines(void)
     }
 }
 
+/*
+Gamestate messages are kept encoded (and compressed) per protocol variant and
+replayed to every client using the same variant. Configstring messages are
+built in segments of GS_SEGMENT_SIZE indices that never share a message, so
+that changing a configstring only needs its own segment to be rebuilt.
+Baselines are compared against those the cache was built from, since entity
+state keeps changing after map load.
+*/
+
+#define GS_SEGMENT_SHIFT    8
+#define GS_SEGMENT_SIZE     (1 << GS_SEGMENT_SHIFT)
+#define GS_MAX_SEGMENTS     ((MAX_CONFIGSTRINGS + GS_SEGMENT_SIZE - 1) >> GS_SEGMENT_SHIFT)
+
+#define GS_CACHE_SIZE       4
+
+typedef enum {
+    GS_OLD,         // svc_configstring and svc_spawnbaseline packets
+    GS_STREAM,      // svc_configstringstream and svc_baselinestream
+    GS_GAMESTATE    // single svc_gamestate
+} gstype_t;
+
+typedef struct {
+    byte        *data;      // messages prefixed with 16-bit length
+    size_t      size;
+    size_t      maxsize;
+    bool        valid;
+} gsbuf_t;
+
+typedef struct {
+    gstype_t    type;
+    int         esFlags;
+    int         maxpacketlen;
+    bool        has_zlib;
+    bool        auto_compress;
+} gskey_t;
+
+typedef struct {
+    gskey_t     key;
+    bool        inuse;
+    int         spawncount;
+    unsigned    lastused;
+    // configstring messages, or raw svc_gamestate configstring data
+    gsbuf_t     segments[GS_MAX_SEGMENTS];
+    // baseline messages, or the entire svc_gamestate message
+    gsbuf_t     baselines;
+    entity_packed_t *bases[SV_BASELINES_CHUNKS];
+} gscache_t;
+
+static gscache_t    gs_cache[GS_CACHE_SIZE];
+static unsigned     gs_sequence;
+static gsbuf_t      *gs_record;     // when set, messages are recorded here
+
+static const entity_packed_t    gs_nullchunk[SV_BASELINES_PER_CHUNK];
+
+static void gs_write(gsbuf_t *buf, const void *data, size_t len)
+{
+    if (buf->size + len > buf->maxsize) {
+        buf->maxsize = Q_ALIGN(buf->size + len, 4096);
+        buf->data = Z_ReallocArray(buf->data, buf->maxsize, 1, TAG_SERVER);
+    }
+    memcpy(buf->data + buf->size, data, len);
+    buf->size += len;
+}
+
+static void gs_replay(const gsbuf_t *buf)
+{
+    const byte *data = buf->data;
+    const byte *end = data + buf->size;
+    int len;
+
+    while (data < end) {
+        len = RL16(data);
+        data += 2;
+        sv_client->AddMessage(sv_client, data, len, true);
+        data += len;
+    }
+}
+
+static void add_gamestate_msg(void)
+{
+    const byte *data;
+    byte hdr[2];
+    int len;
+
+    if (!gs_record) {
+        SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+        return;
+    }
+
+    Q_assert(!msg_write.overflowed);
+
+    if (!msg_write.cursize) {
+        return;
+    }
+
+    data = SV_PackMessage(sv_client, MSG_GAMESTATE, &len);
+    WL16(hdr, len);
+    gs_write(gs_record, hdr, sizeof(hdr));
+    gs_write(gs_record, data, len);
+
+    SZ_Clear(&msg_write);
+}
+
+static gstype_t gamestate_type(void)
+{
+    if (sv_client->netchan.type == NETCHAN_OLD)
+        return GS_OLD;
+    if (sv_client->version >= PROTOCOL_VERSION_Q2PRO_EXTENDED_LIMITS)
+        return GS_STREAM;
+    return GS_GAMESTATE;
+}
+
+static void invalidate_cache(gscache_t *cache)
+{
+    int i;
+
+    for (i = 0; i < GS_MAX_SEGMENTS; i++)
+        cache->segments[i].valid = false;
+    cache->baselines.valid = false;
+}
+
+static gscache_t *find_gamestate_cache(void)
+{
+    gscache_t *cache, *oldest;
+    gskey_t key;
+    int i;
+
+    if (!sv_gamestate_cache->integer)
+        return NULL;
+
+    // MVD spectators get configstrings and baselines of the channel
+    if (sv.state != ss_game || sv_client->configstrings != sv.configstrings)
+        return NULL;
+
+    memset(&key, 0, sizeof(key));
+    key.type = gamestate_type();
+    key.esFlags = sv_client->esFlags;
+    // everything SV_PackMessage may base compression on
+    key.has_zlib = sv_client->has_zlib;
+    key.auto_compress = SV_CanAutoCompress(sv_client);
+    key.maxpacketlen = sv_client->netchan.maxpacketlen;
+
+    oldest = gs_cache;
+    for (i = 0, cache = gs_cache; i < GS_CACHE_SIZE; i++, cache++) {
+        if (cache->inuse && !memcmp(&cache->key, &key, sizeof(key)))
+            goto found;
+        if (cache->lastused < oldest->lastused)
+            oldest = cache;
+    }
+
+    cache = oldest;
+    memcpy(&cache->key, &key, sizeof(key));
+    cache->inuse = true;
+    invalidate_cache(cache);
+
+found:
+    if (cache->spawncount != sv.spawncount) {
+        cache->spawncount = sv.spawncount;
+        invalidate_cache(cache);
+    }
+    cache->lastused = ++gs_sequence;
+    return cache;
+}
+
+/*
+================
+SV_ConfigstringChanged
+
+Called when configstring `index' has been set to a string of `len' characters.
+Long strings may spill over into following configstrings.
+================
+*/
+void SV_ConfigstringChanged(int index, size_t len)
+{
+    int i, j, first, last;
+
+    first = index >> GS_SEGMENT_SHIFT;
+    last = (index + len / MAX_QPATH) >> GS_SEGMENT_SHIFT;
+    last = min(last, GS_MAX_SEGMENTS - 1);
+
+    for (i = 0; i < GS_CACHE_SIZE; i++) {
+        gscache_t *cache = &gs_cache[i];
+
+        if (!cache->inuse)
+            continue;
+
+        for (j = first; j <= last; j++)
+            cache->segments[j].valid = false;
+
+        if (cache->key.type == GS_GAMESTATE)
+            cache->baselines.valid = false;
+    }
+}
+
+void SV_ShutdownGamestateCache(void)
+{
+    int i, j;
+
+    for (i = 0; i < GS_CACHE_SIZE; i++) {
+        gscache_t *cache = &gs_cache[i];
+
+        for (j = 0; j < GS_MAX_SEGMENTS; j++)
+            Z_Free(cache->segments[j].data);
+        Z_Free(cache->baselines.data);
+        for (j = 0; j < SV_BASELINES_CHUNKS; j++)
+            Z_Free(cache->bases[j]);
+    }
+
+    memset(gs_cache, 0, sizeof(gs_cache));
+    gs_sequence = 0;
+}
+
+// NULL chunk is equal to chunk of empty baselines
+static bool baselines_match(const gscache_t *cache)
+{
+    const entity_packed_t *a, *b;
+    int i;
+
+    for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
+        a = sv_client->baselines[i];
+        b = cache->bases[i];
+        if (a == b)
+            continue;
+        if (memcmp(a ? a : gs_nullchunk, b ? b : gs_nullchunk, sizeof(gs_nullchunk)))
+            return false;
+    }
+
+    return true;
+}
+
+static void copy_baselines(gscache_t *cache)
+{
+    const entity_packed_t *src;
+    entity_packed_t **dst;
+    int i;
+
+    for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
+        src = sv_client->baselines[i];
+        dst = &cache->bases[i];
+        if (src) {
+            if (!*dst)
+                *dst = SV_Malloc(sizeof(gs_nullchunk));
+            memcpy(*dst, src, sizeof(gs_nullchunk));
+        } else if (*dst) {
+            memset(*dst, 0, sizeof(gs_nullchunk));
+        }
+    }
+}
+
 static void maybe_flush_msg(size_t size)
 {
     size += msg_write.cursize;
@@ -107,17 +356,17 @@ static void maybe_flush_msg(size_t size)
         size = ZPACKET_HEADER + deflateBound(&svs.z, size);
 #endif
     if (size > sv_client->netchan.maxpacketlen)
-        SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+        add_gamestate_msg();
 }
 
-static void write_configstrings(void)
+static void write_configstrings(int start, int end)
 {
     int         i;
     const char *string;
     size_t      length;
 
     // write a packet full of data
-    for (i = 0; i < sv_client->csr->end; i++) {
+    for (i = start; i < end; i++) {
         string = sv_client->configstrings[i];
         if (!string[0]) {
             continue;
@@ -133,7 +382,7 @@ static void write_configstrings(void)
         MSG_WriteByte(0);
     }
 
-    SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+    add_gamestate_msg();
 }
 
 static void write_baseline(const entity_packed_t *base)
@@ -164,19 +413,17 @@ static void write_baselines(void)
         }
     }
 
-    SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+    add_gamestate_msg();
 }
 
-static void write_configstring_stream(void)
+static void write_configstring_stream(int start, int end)
 {
     int         i;
     const char *string;
     size_t      length;
 
-    MSG_WriteByte(svc_configstringstream);
-
     // write a packet full of data
-    for (i = 0; i < sv_client->csr->end; i++) {
+    for (i = start; i < end; i++) {
         string = sv_client->configstrings[i];
         if (!string[0]) {
             continue;
@@ -186,7 +433,10 @@ static void write_configstring_stream(void)
         // check if this configstring will overflow
         if (msg_write.cursize + length + 5 > msg_write.maxsize) {
             MSG_WriteShort(sv_client->csr->end);
-            SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+            add_gamestate_msg();
+        }
+
+        if (!msg_write.cursize) {
             MSG_WriteByte(svc_configstringstream);
         }
 
@@ -195,8 +445,10 @@ static void write_configstring_stream(void)
         MSG_WriteByte(0);
     }
 
-    MSG_WriteShort(sv_client->csr->end);
-    SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+    if (msg_write.cursize) {
+        MSG_WriteShort(sv_client->csr->end);
+        add_gamestate_msg();
+    }
 }
 
 static void write_baseline_stream(void)
@@ -219,7 +471,7 @@ static void write_baseline_stream(void)
             // check if this baseline will overflow
             if (msg_write.cursize + MAX_PACKETENTITY_BYTES > msg_write.maxsize) {
                 MSG_WriteShort(0);
-                SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+                add_gamestate_msg();
                 MSG_WriteByte(svc_baselinestream);
             }
             write_baseline(base);
@@ -227,20 +479,16 @@ static void write_baseline_stream(void)
     }
 
     MSG_WriteShort(0);
-    SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+    add_gamestate_msg();
 }
 
-static void write_gamestate(void)
+static void write_gamestate_configstrings(int start, int end)
 {
-    const entity_packed_t   *base;
-    int         i, j;
+    int         i;
     size_t      length;
     const char  *string;
 
-    MSG_WriteByte(svc_gamestate);
-
-    // write configstrings
-    for (i = 0; i < sv_client->csr->end; i++) {
+    for (i = start; i < end; i++) {
         string = sv_client->configstrings[i];
         if (!string[0]) {
             continue;
@@ -250,9 +498,13 @@ static void write_gamestate(void)
         MSG_WriteData(string, length);
         MSG_WriteByte(0);
     }
-    MSG_WriteShort(i);      // end of configstrings
+}
+
+static void write_gamestate_baselines(void)
+{
+    const entity_packed_t   *base;
+    int         i, j;
 
-    // write baselines
     for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
         base = sv_client->baselines[i];
         if (!base) {
@@ -266,8 +518,119 @@ static void write_gamestate(void)
         }
     }
     MSG_WriteShort(0);   // end of baselines
+}
+
+static void write_gamestate(void)
+{
+    MSG_WriteByte(svc_gamestate);
+    write_gamestate_configstrings(0, sv_client->csr->end);
+    MSG_WriteShort(sv_client->csr->end);    // end of configstrings
+    write_gamestate_baselines();
+    add_gamestate_msg();
+}
+
+static void build_segment(gscache_t *cache, int seg)
+{
+    gsbuf_t *buf = &cache->segments[seg];
+    int start = seg << GS_SEGMENT_SHIFT;
+    int end = min(start + GS_SEGMENT_SIZE, sv_client->csr->end);
+    size_t cursize;
+
+    buf->size = 0;
+    buf->valid = true;
+
+    if (cache->key.type == GS_GAMESTATE) {
+        // raw data is appended to svc_gamestate being built
+        cursize = msg_write.cursize;
+        write_gamestate_configstrings(start, end);
+        gs_write(buf, msg_write.data + cursize, msg_write.cursize - cursize);
+        return;
+    }
+
+    gs_record = buf;
+    if (cache->key.type == GS_OLD)
+        write_configstrings(start, end);
+    else
+        write_configstring_stream(start, end);
+    gs_record = NULL;
+}
+
+static void send_cached_gamestate(gscache_t *cache)
+{
+    int i, numsegs;
+    gsbuf_t *buf;
+
+    numsegs = (sv_client->csr->end + GS_SEGMENT_SIZE - 1) >> GS_SEGMENT_SHIFT;
+
+    if (cache->key.type == GS_GAMESTATE) {
+        buf = &cache->baselines;
+        if (!buf->valid || !baselines_match(cache)) {
+            copy_baselines(cache);
+            MSG_WriteByte(svc_gamestate);
+            for (i = 0; i < numsegs; i++) {
+                buf = &cache->segments[i];
+                if (buf->valid)
+                    MSG_WriteData(buf->data, buf->size);
+                else
+                    build_segment(cache, i);
+            }
+            MSG_WriteShort(sv_client->csr->end);    // end of configstrings
+            write_gamestate_baselines();
+
+            buf = gs_record = &cache->baselines;
+            buf->size = 0;
+            buf->valid = true;
+            add_gamestate_msg();
+            gs_record = NULL;
+        }
+        gs_replay(buf);
+        return;
+    }
+
+    for (i = 0; i < numsegs; i++) {
+        buf = &cache->segments[i];
+        if (!buf->valid)
+            build_segment(cache, i);
+        gs_replay(buf);
+    }
+
+    buf = &cache->baselines;
+    if (!buf->valid || !baselines_match(cache)) {
+        copy_baselines(cache);
+        buf->size = 0;
+        buf->valid = true;
+        gs_record = buf;
+        if (cache->key.type == GS_OLD)
+            write_baselines();
+        else
+            write_baseline_stream();
+        gs_record = NULL;
+    }
+    gs_replay(buf);
+}
+
+static void send_gamestate(void)
+{
+    gscache_t *cache = find_gamestate_cache();
 
-    SV_ClientAddMessage(sv_client, MSG_GAMESTATE);
+    if (cache) {
+        send_cached_gamestate(cache);
+        return;
+    }
+
+    switch (gamestate_type()) {
+    case GS_OLD:
+        write_configstrings(0, sv_client->csr->end);
+        write_baselines();
+        break;
+    case GS_STREAM:
+        write_configstring_stream(0, sv_client->csr->end);
+        write_baseline_stream();
+        break;
+    default:
+        write_gamestate();
+        break;
+    }
 }
 
 static void stuff_cmds(const list_t *list)
@@ -472,15 +835,7 @@ void SV_New_f(void)
         return;
 
     // send gamestate
-    if (sv_client->netchan.type == NETCHAN_OLD) {
-        write_configstrings();
-        write_baselines();
-    } else if (sv_client->version >= PROTOCOL_VERSION_Q2PRO_EXTENDED_LIMITS) {
-        write_configstring_stream();
-        write_baseline_stream();
-    } else {
-        write_gamestate();
-    }
+    send_gamestate();
 
     // send next command
     SV_ClientCommand(sv_client, "precache %i\n", sv_client->spawncount);
@@ -1157,8 +1512,8 @@ static void SV_SetLastFrame(int lastframe)
 
             if (frame->number == lastframe) {
                 // save time for ping calc
-                if (frame->sentTime <= com_eventTime)
-                    frame->latency = com_eventTime - frame->sentTime;
+                if (frame->sentTime <= net_from_time)
+                    frame->latency = net_from_time - frame->sentTime;
             }
         }
 
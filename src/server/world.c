@@ -28,6 +28,84 @@ FIXME: this use of "area" is different from the bsp file use
 ===============================================================================
 */
 
+typedef struct {
+    const char  *name;
+    void        (*clear)(const vec3_t mins, const vec3_t maxs);
+    void        (*link)(edict_t *ent);
+    void        (*query)(void);
+    void        (*info)(void);
+} broadphase_t;
+
+static const broadphase_t   *sv_broadphase_api;
+
+static const vec_t  *area_mins, *area_maxs;
+static edict_t      **area_list;
+static int          area_count, area_maxcount;
+static int          area_type;
+
+static struct {
+    uint64_t    queries;
+    uint64_t    candidates;
+    uint64_t    results;
+    uint64_t    links;
+    int         maxcandidates;
+    int         curcandidates;
+} area_stats;
+
+static inline void SV_LinkToList(list_t *solid, list_t *trigger, edict_t *ent)
+{
+    if (ent->solid == SOLID_TRIGGER)
+        List_Append(trigger, &ent->area);
+    else
+        List_Append(solid, &ent->area);
+}
+
+/*
+====================
+SV_AreaEdicts_list
+
+Appends edicts from the given list that touch the query box.
+Returns false if the output list is full.
+====================
+*/
+static bool SV_AreaEdicts_list(list_t *start)
+{
+    edict_t     *check;
+
+    LIST_FOR_EACH(edict_t, check, start, area) {
+        area_stats.curcandidates++;
+        if (check->solid == SOLID_NOT)
+            continue;        // deactivated
+        if (check->absmin[0] > area_maxs[0]
+            || check->absmin[1] > area_maxs[1]
+            || check->absmin[2] > area_maxs[2]
+            || check->absmax[0] < area_mins[0]
+            || check->absmax[1] < area_mins[1]
+            || check->absmax[2] < area_mins[2])
+            continue;        // not touching
+
+        if (area_count == area_maxcount) {
+            Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
+            return false;
+        }
+
+        area_list[area_count] = check;
+        area_count++;
+    }
+
+    return true;
+}
+
+/*
+===============================================================================
+
+AREA NODE TREE
+
+Fixed depth uniform subdivision of the world bounds. Entities are linked
+into the first node they cross.
+===============================================================================
+*/
+
 typedef struct areanode_s {
     int     axis;       // -1 = leaf node
     float   dist;
@@ -42,11 +120,6 @@ typedef struct areanode_s {
 static areanode_t   sv_areanodes[AREA_NODES];
 static int          sv_numareanodes;
 
-static const vec_t  *area_mins, *area_maxs;
-static edict_t      **area_list;
-static int          area_count, area_maxcount;
-static int          area_type;
-
 /*
 ===============
 SV_CreateAreaNode
@@ -92,6 +165,199 @@ static areanode_t *SV_CreateAreaNode(int depth, const vec3_t mins, const vec3_t
     return anode;
 }
 
+static void SV_ClearAreaNodes(const vec3_t mins, const vec3_t maxs)
+{
+    memset(sv_areanodes, 0, sizeof(sv_areanodes));
+    sv_numareanodes = 0;
+
+    SV_CreateAreaNode(0, mins, maxs);
+}
+
+static void SV_LinkAreaNodes(edict_t *ent)
+{
+    areanode_t *node;
+
+    // find the first node that the ent's box crosses
+    node = sv_areanodes;
+    while (1) {
+        if (node->axis == -1)
+            break;
+        if (ent->absmin[node->axis] > node->dist)
+            node = node->children[0];
+        else if (ent->absmax[node->axis] < node->dist)
+            node = node->children[1];
+        else
+            break;        // crosses the node
+    }
+
+    SV_LinkToList(&node->solid_edicts, &node->trigger_edicts, ent);
+}
+
+static void SV_AreaNodes_r(areanode_t *node)
+{
+    // touch linked edicts
+    if (area_type == AREA_SOLID) {
+        if (!SV_AreaEdicts_list(&node->solid_edicts))
+            return;
+    } else {
+        if (!SV_AreaEdicts_list(&node->trigger_edicts))
+            return;
+    }
+
+    if (node->axis == -1)
+        return;        // terminal node
+
+    // recurse down both sides
+    if (area_maxs[node->axis] > node->dist)
+        SV_AreaNodes_r(node->children[0]);
+    if (area_mins[node->axis] < node->dist)
+        SV_AreaNodes_r(node->children[1]);
+}
+
+static void SV_QueryAreaNodes(void)
+{
+    SV_AreaNodes_r(sv_areanodes);
+}
+
+static void SV_AreaNodesInfo(void)
+{
+    Com_Printf("%d nodes, depth %d\n", sv_numareanodes, AREA_DEPTH);
+}
+
+static const broadphase_t sv_areanode_api = {
+    .name = "areanode",
+    .clear = SV_ClearAreaNodes,
+    .link = SV_LinkAreaNodes,
+    .query = SV_QueryAreaNodes,
+    .info = SV_AreaNodesInfo,
+};
+
+/*
+===============================================================================
+
+LOOSE GRID
+
+Horizontal grid sized from the world bounds. Each entity is linked into
+exactly one cell containing its center, so that it fits into the single
+`area' link of edict_t. Cells are loose: entities may extend up to half
+a cell outside of their cell, queries are expanded by the same amount.
+Entities larger than a cell are kept in a separate list checked by every
+query.
+===============================================================================
+*/
+
+#define AREA_GRID_MAX       32      // max cells per axis
+#define AREA_GRID_MINCELL   128     // min cell size in world units
+
+typedef struct {
+    list_t  trigger_edicts;
+    list_t  solid_edicts;
+} areacell_t;
+
+static struct {
+    vec2_t      origin;
+    float       cellsize;
+    float       invsize;
+    int         size[2];
+    areacell_t  large;
+    areacell_t  cells[AREA_GRID_MAX * AREA_GRID_MAX];
+} sv_areagrid;
+
+static bool SV_AreaEdicts_cell(areacell_t *cell)
+{
+    if (area_type == AREA_SOLID)
+        return SV_AreaEdicts_list(&cell->solid_edicts);
+    return SV_AreaEdicts_list(&cell->trigger_edicts);
+}
+
+static inline int SV_GridCoord(float v, int axis)
+{
+    int i = floorf((v - sv_areagrid.origin[axis]) * sv_areagrid.invsize);
+    return Q_clip(i, 0, sv_areagrid.size[axis] - 1);
+}
+
+static void SV_ClearAreaGrid(const vec3_t mins, const vec3_t maxs)
+{
+    float   size[2], cellsize;
+    int     i;
+
+    size[0] = max(maxs[0] - mins[0], 1);
+    size[1] = max(maxs[1] - mins[1], 1);
+
+    cellsize = max(size[0], size[1]) / AREA_GRID_MAX;
+    cellsize = max(cellsize, AREA_GRID_MINCELL);
+
+    sv_areagrid.origin[0] = mins[0];
+    sv_areagrid.origin[1] = mins[1];
+    sv_areagrid.cellsize = cellsize;
+    sv_areagrid.invsize = 1.0f / cellsize;
+    for (i = 0; i < 2; i++) {
+        sv_areagrid.size[i] = ceilf(size[i] / cellsize);
+        sv_areagrid.size[i] = Q_clip(sv_areagrid.size[i], 1, AREA_GRID_MAX);
+    }
+
+    List_Init(&sv_areagrid.large.trigger_edicts);
+    List_Init(&sv_areagrid.large.solid_edicts);
+    for (i = 0; i < AREA_GRID_MAX * AREA_GRID_MAX; i++) {
+        List_Init(&sv_areagrid.cells[i].trigger_edicts);
+        List_Init(&sv_areagrid.cells[i].solid_edicts);
+    }
+}
+
+static void SV_LinkAreaGrid(edict_t *ent)
+{
+    areacell_t  *cell;
+    int         x, y;
+
+    if (ent->absmax[0] - ent->absmin[0] > sv_areagrid.cellsize ||
+        ent->absmax[1] - ent->absmin[1] > sv_areagrid.cellsize) {
+        cell = &sv_areagrid.large;
+    } else {
+        x = SV_GridCoord(0.5f * (ent->absmin[0] + ent->absmax[0]), 0);
+        y = SV_GridCoord(0.5f * (ent->absmin[1] + ent->absmax[1]), 1);
+        cell = &sv_areagrid.cells[y * sv_areagrid.size[0] + x];
+    }
+
+    SV_LinkToList(&cell->solid_edicts, &cell->trigger_edicts, ent);
+}
+
+static void SV_QueryAreaGrid(void)
+{
+    float   margin = 0.5f * sv_areagrid.cellsize;
+    int     x1, y1, x2, y2, x, y;
+
+    if (!SV_AreaEdicts_cell(&sv_areagrid.large))
+        return;
+
+    x1 = SV_GridCoord(area_mins[0] - margin, 0);
+    y1 = SV_GridCoord(area_mins[1] - margin, 1);
+    x2 = SV_GridCoord(area_maxs[0] + margin, 0);
+    y2 = SV_GridCoord(area_maxs[1] + margin, 1);
+
+    for (y = y1; y <= y2; y++) {
+        areacell_t *cell = &sv_areagrid.cells[y * sv_areagrid.size[0]];
+        for (x = x1; x <= x2; x++)
+            if (!SV_AreaEdicts_cell(&cell[x]))
+                return;
+    }
+}
+
+static void SV_AreaGridInfo(void)
+{
+    Com_Printf("%dx%d cells of %.f units\n", sv_areagrid.size[0],
+               sv_areagrid.size[1], sv_areagrid.cellsize);
+}
+
+static const broadphase_t sv_areagrid_api = {
+    .name = "grid",
+    .clear = SV_ClearAreaGrid,
+    .link = SV_LinkAreaGrid,
+    .query = SV_QueryAreaGrid,
+    .info = SV_AreaGridInfo,
+};
+
+//===========================================================================
+
 /*
 ===============
 SV_ClearWorld
@@ -100,12 +366,18 @@ SV_ClearWorld
 */
 void SV_ClearWorld(void)
 {
-    memset(sv_areanodes, 0, sizeof(sv_areanodes));
-    sv_numareanodes = 0;
+    if (sv_broadphase->integer == 1)
+        sv_broadphase_api = &sv_areagrid_api;
+    else
+        sv_broadphase_api = &sv_areanode_api;
+
+    memset(&area_stats, 0, sizeof(area_stats));
 
     if (sv.cm.cache) {
         const mmodel_t *cm = &sv.cm.cache->models[0];
-        SV_CreateAreaNode(0, cm->mins, cm->maxs);
+        sv_broadphase_api->clear(cm->mins, cm->maxs);
+    } else {
+        sv_broadphase_api->clear(vec3_origin, vec3_origin);
     }
 
     // make sure all entities are unlinked
@@ -259,7 +531,6 @@ static uint32_t SV_PackSolid32(const edict_t *ent)
 
 void PF_LinkEdict(edict_t *ent)
 {
-    areanode_t *node;
     server_entity_t *sent;
     int entnum;
 #if USE_FPS
@@ -322,6 +593,8 @@ void PF_LinkEdict(edict_t *ent)
     }
     ent->linkcount++;
 
+    SV_UpdateCullEntity(ent, entnum);
+
 #if USE_FPS
     // save origin for later recovery
     i = sv.framenum & ENT_HISTORY_MASK;
@@ -332,72 +605,9 @@ void PF_LinkEdict(edict_t *ent)
     if (ent->solid == SOLID_NOT)
         return;
 
-// find the first node that the ent's box crosses
-    node = sv_areanodes;
-    while (1) {
-        if (node->axis == -1)
-            break;
-        if (ent->absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if (ent->absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break;        // crosses the node
-    }
-
     // link it in
-    if (ent->solid == SOLID_TRIGGER)
-        List_Append(&node->trigger_edicts, &ent->area);
-    else
-        List_Append(&node->solid_edicts, &ent->area);
-}
-
-
-/*
-====================
-SV_AreaEdicts_r
-
-====================
-*/
-static void SV_AreaEdicts_r(areanode_t *node)
-{
-    list_t      *start;
-    edict_t     *check;
-
-    // touch linked edicts
-    if (area_type == AREA_SOLID)
-        start = &node->solid_edicts;
-    else
-        start = &node->trigger_edicts;
-
-    LIST_FOR_EACH(edict_t, check, start, area) {
-        if (check->solid == SOLID_NOT)
-            continue;        // deactivated
-        if (check->absmin[0] > area_maxs[0]
-            || check->absmin[1] > area_maxs[1]
-            || check->absmin[2] > area_maxs[2]
-            || check->absmax[0] < area_mins[0]
-            || check->absmax[1] < area_mins[1]
-            || check->absmax[2] < area_mins[2])
-            continue;        // not touching
-
-        if (area_count == area_maxcount) {
-            Com_WPrintf("SV_AreaEdicts: MAXCOUNT\n");
-            return;
-        }
-
-        area_list[area_count] = check;
-        area_count++;
-    }
-
-    if (node->axis == -1)
-        return;        // terminal node
-
-    // recurse down both sides
-    if (area_maxs[node->axis] > node->dist)
-        SV_AreaEdicts_r(node->children[0]);
-    if (area_mins[node->axis] < node->dist)
-        SV_AreaEdicts_r(node->children[1]);
+    sv_broadphase_api->link(ent);
+    area_stats.links++;
 }
 
 /*
@@ -415,11 +625,47 @@ int SV_AreaEdicts(const vec3_t mins, const vec3_t maxs,
     area_maxcount = maxcount;
     area_type = areatype;
 
-    SV_AreaEdicts_r(sv_areanodes);
+    area_stats.curcandidates = 0;
+    sv_broadphase_api->query();
+
+    area_stats.queries++;
+    area_stats.candidates += area_stats.curcandidates;
+    area_stats.results += area_count;
+    area_stats.maxcandidates = max(area_stats.maxcandidates, area_stats.curcandidates);
 
     return area_count;
 }
 
+/*
+================
+SV_AreaStats_f
+================
+*/
+void SV_AreaStats_f(void)
+{
+    if (!sv_broadphase_api) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&area_stats, 0, sizeof(area_stats));
+        return;
+    }
+
+    Com_Printf("Broadphase: %s, ", sv_broadphase_api->name);
+    sv_broadphase_api->info();
+
+    Com_Printf("%"PRIu64" links, %"PRIu64" queries\n", area_stats.links, area_stats.queries);
+    if (!area_stats.queries)
+        return;
+
+    Com_Printf("%.2f candidates and %.2f results per query, %d max candidates\n",
+               (double)area_stats.candidates / area_stats.queries,
+               (double)area_stats.results / area_stats.queries,
+               area_stats.maxcandidates);
+}
+
 
 //===========================================================================
 
@@ -42,10 +42,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <SDL.h>
 #endif
 
-#if USE_CLIENT
 #include <pthread.h>
 static pthread_t main_thread;
-#endif
 
 cvar_t  *sys_basedir;
 cvar_t  *sys_libdir;
@@ -71,12 +69,10 @@ void Sys_DebugBreak(void)
     raise(SIGTRAP);
 }
 
-#if USE_CLIENT
 bool Sys_IsMainThread(void)
 {
     return pthread_equal(main_thread, pthread_self());
 }
-#endif
 
 unsigned Sys_Milliseconds(void)
 {
@@ -85,6 +81,13 @@ unsigned Sys_Milliseconds(void)
     return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * UINT64_C(1000000) + ts.tv_nsec / 1000;
+}
+
 /*
 =================
 Sys_Quit
@@ -452,9 +455,7 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
-#if USE_CLIENT
     main_thread = pthread_self();
-#endif
 
     Qcommon_Init(argc, argv);
 
@@ -868,6 +868,14 @@ unsigned Sys_Milliseconds(void)
     return tm.QuadPart * 1000ULL / timer_freq.QuadPart;
 }
 
+uint64_t Sys_Microseconds(void)
+{
+    LARGE_INTEGER tm;
+    QueryPerformanceCounter(&tm);
+    return tm.QuadPart / timer_freq.QuadPart * 1000000ULL +
+           tm.QuadPart % timer_freq.QuadPart * 1000000ULL / timer_freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }